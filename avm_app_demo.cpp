@@ -5,104 +5,171 @@
  * copyright: ADAS_EYES all right reserved
  */
 
+#include "avm_pipeline.h"
+#include "blend_simd.h"
 #include "common.h"
+#include "frame_source.h"
+#include "map_cache.h"
+#include "stitch_lut.h"
+#include "stitch_pipeline.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
-// 视角控制参数
-struct ViewpointParams {
-  float height; // 视角高度 (0.0-1.0)
-  float angle;  // 围绕车辆旋转角度 (0-360度)
-  float tilt;   // 视角倾斜度 (-30到30度)
-  float zoom;   // 缩放系数 (0.5-2.0)
-};
-
 // #define DEBUG
-#define AWB_LUN_BANLANCE_ENALE 1
-
-// 函数声明：处理一帧图像
-cv::Mat processFrame(const std::string &data_path, cv::Mat &car_img,
-                     std::vector<cv::Mat> &merge_weights_img,
-                     CameraPrms prms[4], const ViewpointParams &viewParams);
 
-// 在图像上显示处理时间和FPS
-void displayStats(cv::Mat &img, double process_time, double fps,
+// 在图像上显示加载时间、处理时间、FPS和队列占用
+void displayStats(cv::Mat &img, const StitchedFrame &frame, double wait_time,
+                  double fps, double latency, const QueueStatus &capture,
+                  const QueueStatus &output, int threads,
                   const ViewpointParams &viewParams);
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    std::cout << "usage:\n\t" << argv[0] << " path\n";
+  const int64 start_tick = cv::getTickCount(); // 统计启动到首帧的时间
+  std::vector<std::string> args;
+  int num_threads = 4;
+  int awb_step = 4;
+  int capture_depth = 2;
+  int output_depth = 2;
+  int lut_cache = 8;
+  double scale = 1.0;
+  StitchOptions stitch;
+  std::string trace_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--threads=", 0) == 0) {
+      num_threads = std::atoi(arg.c_str() + 10);
+    } else if (arg.rfind("--awb-step=", 0) == 0) {
+      awb_step = std::max(std::atoi(arg.c_str() + 11), 1);
+    } else if (arg.rfind("--capture-depth=", 0) == 0) {
+      capture_depth = std::max(std::atoi(arg.c_str() + 16), 1);
+    } else if (arg.rfind("--output-depth=", 0) == 0) {
+      output_depth = std::max(std::atoi(arg.c_str() + 15), 1);
+    } else if (arg.rfind("--lut-cache=", 0) == 0) {
+      lut_cache = std::max(std::atoi(arg.c_str() + 12), 1);
+    } else if (arg.rfind("--remap=", 0) == 0) {
+      RemapMode mode;
+      if (!parse_remap_mode(arg.substr(8), mode)) {
+        std::cerr << "unknown remap " << arg << "\r\n";
+        return -1;
+      }
+      stitch.remap = mode;
+    } else if (arg.rfind("--bands=", 0) == 0) {
+      stitch.bands = std::max(std::atoi(arg.c_str() + 8), 1);
+    } else if (arg.rfind("--scale=", 0) == 0) {
+      scale = std::atof(arg.c_str() + 8);
+    } else if (arg.rfind("--trace=", 0) == 0) {
+      trace_path = arg.substr(8);
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.size() != 1 && args.size() != 2) {
+    std::cout << "usage:\n\t" << argv[0]
+              << " path [source] [--threads=N] [--awb-step=N] "
+                 "[--capture-depth=N] [--output-depth=N] [--lut-cache=N] "
+                 "[--scale=S] [--remap=M] [--bands=N] [--trace=file.json]\n"
+              << "\tsource: png:<pattern> | video:<pattern> | "
+                 "nv12:<pattern>@WxH | yuyv:<pattern>@WxH | "
+                 "synthetic[:WxH][:nv12|:yuyv]\n"
+              << "\t{cam} in the pattern is the camera name, {idx} the "
+                 "frame number\n"
+              << "\t--threads: stitching threads incl. main, 0 = all cores "
+                 "(default 4)\n"
+              << "\t--awb-step: white balance statics grid step, 1 = every "
+                 "pixel (default 4)\n"
+              << "\t--capture-depth / --output-depth: pipeline queue depths, "
+                 "the oldest frame is dropped when full (default 2)\n"
+              << "\t--lut-cache: view luts kept for fast view switches "
+                 "(default 8)\n"
+              << "\t--scale: mosaic size for small displays, (0, 1], "
+                 "stitched at that size (default 1)\n"
+              << "\t--remap: bilinear | nearest | opencv, frame sampling "
+                 "kernel (default bilinear)\n"
+              << "\t--bands: overlap corner blend levels, 1 = per pixel "
+                 "alpha, 2+ = multi-band (default 1)\n"
+              << "\t--trace: write a chrome trace on exit (needs "
+                 "AVM_ENABLE_TRACE)\n";
     return -1;
   }
   std::cout << argv[0] << " app start running..." << std::endl;
-  std::string data_path = std::string(argv[1]);
+
+  // 热点路径跟踪, 编译时未开启则为空操作
+  if (!trace_path.empty()) {
+    trace_thread_name("main");
+    trace_start();
+  }
+  std::string data_path = args[0];
+  set_undist_map_cache_dir(data_path + "/cache");
+  // 1-4. 车辆图像、权重图 (8 位定点)、相机参数和默认视角的查找表,
+  //      从标定包映射, 不再逐个解析 yaml / png
+  RigBundle bundle;
   cv::Mat car_img;
-  cv::Mat merge_weights_img[4];
-  float *w_ptr[4];
+  std::vector<cv::Mat> weights_vector;
   CameraPrms prms[4];
-
-  // 1. 读取车辆图像
-  car_img = cv::imread(data_path + "/images/car.png");
-  cv::resize(car_img, car_img, cv::Size(xr - xl, yb - yt));
-
-  // 2. 读取权重图
-  cv::Mat weights = cv::imread(data_path + "/yaml/weights.png", -1);
-
-  if (weights.channels() != 4) {
-    std::cerr << "imread weights failed " << weights.channels() << "\r\n";
+  StitchLut default_lut;
+  if (!loadAvmBundle(data_path, bundle, car_img, weights_vector, prms,
+                     default_lut)) {
     return -1;
   }
-
-  // 3. 处理权重图
-  std::vector<cv::Mat> weights_vector;
-  for (int i = 0; i < 4; ++i) {
-    merge_weights_img[i] =
-        cv::Mat(weights.size(), CV_32FC1, cv::Scalar(0, 0, 0));
-    w_ptr[i] = (float *)merge_weights_img[i].data;
-    weights_vector.push_back(merge_weights_img[i]);
+  const double ms = 1000.0 / cv::getTickFrequency();
+  std::cout << "rig data loaded in " << (cv::getTickCount() - start_tick) * ms
+            << " ms" << (bundle.isOpen() ? " (bundle)" : "") << std::endl;
+  std::cout << "blend isa: " << blend_isa_name(blend_best_isa())
+            << ", remap: " << remap_mode_name(stitch.remap) << std::endl;
+
+  // 5. 帧源: 后台线程解码, 与拼接计算分离
+  std::string source_spec = args.size() == 2
+                                ? args[1]
+                                : "png:" + data_path + "/images/{cam}.png";
+  // 环形缓冲需容纳采集队列、拼接中和采集中的各一组帧
+  auto source = create_frame_source(source_spec, true, capture_depth + 2);
+  if (!source || !source->start()) {
+    return -1;
   }
 
-  int pixel_index = 0;
-  for (int h = 0; h < weights.rows; ++h) {
-    uchar *uc_pixel = weights.data + h * weights.step;
-    for (int w = 0; w < weights.cols; ++w) {
-      w_ptr[0][pixel_index] = uc_pixel[0] / 255.0f;
-      w_ptr[1][pixel_index] = uc_pixel[1] / 255.0f;
-      w_ptr[2][pixel_index] = uc_pixel[2] / 255.0f;
-      w_ptr[3][pixel_index] = uc_pixel[3] / 255.0f;
-      uc_pixel += 4;
-      ++pixel_index;
-    }
-  }
+  // 6. 常驻线程池, 每帧不再创建线程
+  ThreadPool pool(num_threads);
+  std::cout << "stitch threads: " << pool.size() << std::endl;
 
-  // 4. 读取相机参数
-  for (int i = 0; i < 4; ++i) {
-    auto &prm = prms[i];
-    prm.name = camera_names[i];
-    auto ok = read_prms(data_path + "/yaml/" + prm.name + ".yaml", prm);
-    if (!ok) {
-      return -1;
-    }
+  // 7. 流水线: 采集、拼接、显示三级并行, 级间为无锁队列,
+  //    下一级跟不上时丢弃最旧的帧, 延迟不超过队列深度
+  StitchPipeline pipeline(*source, car_img, weights_vector, prms, pool,
+                          awb_step, capture_depth, output_depth, lut_cache,
+                          scale);
+  pipeline.setStitchOptions(stitch);
+
+  // 视角参数初始化
+  ViewpointParams viewParams = default_view; // 默认为顶视图
+  if (!pipeline.start(viewParams, &default_lut)) {
+    return -1;
   }
+  // 常用视角的查找表在后台预先生成
+  pipeline.lutCache().prebake(default_view_presets());
 
   // 创建窗口
   cv::namedWindow("ADAS_EYES_360_VIEW", cv::WINDOW_NORMAL);
   cv::resizeWindow("ADAS_EYES_360_VIEW", 800, 600);
 
   // 计时相关变量
-  double process_time = 0;
   double fps = 0;
   int frame_count = 0;
   double total_time = 0;
+  int64 last_tick = cv::getTickCount();
   char key = 0;
 
-  // 视角参数初始化
-  ViewpointParams viewParams = {1.0f, 0.0f, 0.0f, 1.0f}; // 默认为顶视图
+  // 退出时打印各阶段平均耗时和队列占用
+  StageTimes stage_sum = {0, 0, 0};
+  double load_sum = 0, wait_sum = 0, process_sum = 0, latency_sum = 0;
+  double capture_fill = 0, output_fill = 0;
+  int64_t frames_done = 0;
 
-  // 主循环
+  // 主循环 (显示级)
   while (key != 'q' && key != 27) { // 'q'或Esc键退出
 
     //
+    ViewpointParams lastViewParams = viewParams;
     switch (key) {
     case 'w': // 增加高度（更俯视）
       viewParams.height = std::min(viewParams.height + 0.05f, 1.0f);
@@ -124,49 +191,138 @@ int main(int argc, char **argv) {
       break;
     }
 
-    int64 start = cv::getTickCount();
-
-    // 处理帧
-    cv::Mat result =
-        processFrame(data_path, car_img, weights_vector, prms, viewParams);
+    // 已缓存的视角下一帧即切换, 否则后台生成, 期间沿用当前查找表
+    if (viewParams.height != lastViewParams.height ||
+        viewParams.angle != lastViewParams.angle ||
+        viewParams.tilt != lastViewParams.tilt ||
+        viewParams.zoom != lastViewParams.zoom) {
+      pipeline.setView(viewParams);
+    }
 
-    // 计算处理时间
-    int64 end = cv::getTickCount();
-    process_time = (end - start) * 1000 / cv::getTickFrequency(); // 毫秒
+    // 取一张拼接好的结果
+    StitchedFrame *frame = pipeline.acquire();
+    if (!frame) {
+      break;
+    }
 
-    // 计算FPS
+    // 按实际显示间隔计算FPS
+    int64 now = cv::getTickCount();
+    if (frames_done == 0) {
+      std::cout << "first frame after " << (now - start_tick) * ms << " ms"
+                << std::endl;
+    }
     frame_count++;
-    total_time += process_time;
+    total_time += (now - last_tick) * ms;
+    last_tick = now;
     if (total_time >= 1000) { // 每秒更新一次FPS
       fps = frame_count * 1000.0 / total_time;
       frame_count = 0;
       total_time = 0;
     }
 
+    // 从解码完成到显示的端到端延迟
+    double latency = (now - frame->ready_tick) * ms;
+    QueueStatus capture = pipeline.captureStatus();
+    QueueStatus output = pipeline.outputStatus();
+
+    stage_sum.balance += frame->times.balance;
+    stage_sum.body += frame->times.body;
+    stage_sum.corner += frame->times.corner;
+    load_sum += frame->load_ms;
+    wait_sum += frame->wait_ms;
+    process_sum += frame->process_ms;
+    latency_sum += latency;
+    capture_fill += capture.size;
+    output_fill += output.size;
+    ++frames_done;
+
     // 在图像上显示处理时间和FPS
-    displayStats(result, process_time, fps, viewParams);
+    displayStats(frame->mosaic, *frame, pipeline.lastWaitMs(), fps, latency,
+                 capture, output, pool.size(), viewParams);
 
     // 显示图像
-    cv::imshow("ADAS_EYES_360_VIEW", result);
+    {
+      AVM_TRACE_SCOPE("imshow");
+      cv::imshow("ADAS_EYES_360_VIEW", frame->mosaic);
 
-    // 等待按键
-    key = cv::waitKey(1);
+      // 等待按键
+      key = cv::waitKey(1);
+    }
+    pipeline.release(frame);
   }
 
+  pipeline.stop();
+  source->stop();
   cv::destroyAllWindows();
+
+  if (!trace_path.empty()) {
+    trace_stop();
+    if (!trace_write_chrome(trace_path)) {
+      std::cerr << "trace not written, build with -DAVM_ENABLE_TRACE=ON\r\n";
+    }
+  }
+
+  if (frames_done > 0) {
+    double n = (double)frames_done;
+    QueueStatus capture = pipeline.captureStatus();
+    QueueStatus output = pipeline.outputStatus();
+    std::cout << std::fixed << std::setprecision(2) << "frames: " << frames_done
+              << ", threads: " << pool.size() << "\n"
+              << "  load (background): " << load_sum / n << " ms\n"
+              << "  stitch wait:       " << wait_sum / n << " ms\n"
+              << "  balance:           " << stage_sum.balance / n << " ms\n"
+              << "  body:              " << stage_sum.body / n << " ms\n"
+              << "  corner:            " << stage_sum.corner / n << " ms\n"
+              << "  process total:     " << process_sum / n << " ms\n"
+              << "  latency:           " << latency_sum / n << " ms\n"
+              << "  capture queue:     " << capture_fill / n << " / "
+              << capture.capacity << " avg, " << capture.dropped << " of "
+              << capture.pushed << " dropped\n"
+              << "  output queue:      " << output_fill / n << " / "
+              << output.capacity << " avg, " << output.dropped << " of "
+              << output.pushed << " dropped\n";
+    ViewLutCacheStats luts = pipeline.lutCache().stats();
+    std::cout << "  view luts:         " << luts.size << " / " << luts.capacity
+              << " cached, " << luts.hits << " hits, " << luts.misses
+              << " misses, " << luts.builds << " built, " << luts.build_ms
+              << " ms avg" << std::endl;
+  }
   std::cout << argv[0] << " app finished" << std::endl;
   return 0;
 }
 
-// 在图像上显示处理时间和FPS
-void displayStats(cv::Mat &img, double process_time, double fps,
+// 在图像上显示加载时间、处理时间、FPS和队列占用
+void displayStats(cv::Mat &img, const StitchedFrame &frame, double wait_time,
+                  double fps, double latency, const QueueStatus &capture,
+                  const QueueStatus &output, int threads,
                   const ViewpointParams &viewParams) {
   std::stringstream ss;
   ss << "Processing time: " << std::fixed << std::setprecision(1)
-     << process_time << " ms";
+     << frame.process_ms << " ms (latency " << latency << " ms)";
   cv::putText(img, ss.str(), cv::Point(20, 30), cv::FONT_HERSHEY_SIMPLEX, 0.7,
               cv::Scalar(0, 0, 255), 2);
 
+  // 解码在后台完成, wait 为显示级实际等待拼接结果的时间
+  ss.str("");
+  ss << "Load time: " << std::fixed << std::setprecision(1) << frame.load_ms
+     << " ms (wait " << wait_time << " ms)";
+  cv::putText(img, ss.str(), cv::Point(20, 120), cv::FONT_HERSHEY_SIMPLEX, 0.7,
+              cv::Scalar(0, 0, 255), 2);
+
+  ss.str("");
+  ss << "Stages: awb " << std::fixed << std::setprecision(1)
+     << frame.times.balance << " body " << frame.times.body << " corner "
+     << frame.times.corner << " ms (" << threads << " threads)";
+  cv::putText(img, ss.str(), cv::Point(20, 150), cv::FONT_HERSHEY_SIMPLEX, 0.7,
+              cv::Scalar(0, 0, 255), 2);
+
+  ss.str("");
+  ss << "Queues: capture " << capture.size << "/" << capture.capacity
+     << " output " << output.size << "/" << output.capacity << " dropped "
+     << capture.dropped + output.dropped;
+  cv::putText(img, ss.str(), cv::Point(20, 180), cv::FONT_HERSHEY_SIMPLEX, 0.7,
+              cv::Scalar(0, 0, 255), 2);
+
   ss.str("");
   ss << "FPS: " << std::fixed << std::setprecision(1) << fps;
   cv::putText(img, ss.str(), cv::Point(20, 60), cv::FONT_HERSHEY_SIMPLEX, 0.7,
@@ -176,120 +332,8 @@ void displayStats(cv::Mat &img, double process_time, double fps,
   ss.str("");
   ss << "View: H=" << std::fixed << std::setprecision(2) << viewParams.height
      << " A=" << std::setprecision(0) << viewParams.angle
-     << " Z=" << std::setprecision(1) << viewParams.zoom;
+     << " Z=" << std::setprecision(1) << viewParams.zoom
+     << (frame.view_pending ? " (building)" : "");
   cv::putText(img, ss.str(), cv::Point(20, 90), cv::FONT_HERSHEY_SIMPLEX, 0.7,
               cv::Scalar(0, 0, 255), 2);
 }
-
-cv::Mat calculateViewMatrix(const cv::Mat &baseMatrix,
-                            const ViewpointParams &viewParams) {
-  // 确保使用float类型
-  cv::Mat viewMatrix;
-  baseMatrix.convertTo(viewMatrix, CV_32F);
-
-  // 根据角度调整
-  float angleRad = viewParams.angle * CV_PI / 180.0;
-  cv::Mat rotMat = cv::Mat::eye(3, 3, CV_32F);
-  rotMat.at<float>(0, 0) = cos(angleRad);
-  rotMat.at<float>(0, 1) = -sin(angleRad);
-  rotMat.at<float>(1, 0) = sin(angleRad);
-  rotMat.at<float>(1, 1) = cos(angleRad);
-
-  // 应用变换
-  viewMatrix = rotMat * viewMatrix;
-
-  // 应用缩放
-  viewMatrix *= viewParams.zoom;
-
-  return viewMatrix;
-}
-
-// 处理一帧图像的函数
-cv::Mat processFrame(const std::string &data_path, cv::Mat &car_img,
-                     std::vector<cv::Mat> &merge_weights_img,
-                     CameraPrms prms[4], const ViewpointParams &viewParams) {
-  cv::Mat origin_dir_img[4];
-  cv::Mat undist_dir_img[4];
-  cv::Mat out_put_img =
-      cv::Mat(cv::Size(total_w, total_h), CV_8UC3, cv::Scalar(0, 0, 0));
-
-  // 1.读取图片并进行亮度均衡和自动白平衡
-  std::vector<cv::Mat *> srcs;
-  for (int i = 0; i < 4; ++i) {
-    auto &prm = prms[i];
-    origin_dir_img[i] = cv::imread(data_path + "/images/" + prm.name + ".png");
-    srcs.push_back(&origin_dir_img[i]);
-  }
-
-#if AWB_LUN_BANLANCE_ENALE
-  awb_and_lum_banlance(srcs);
-#endif
-
-  // 2.去畸变处理
-  for (int i = 0; i < 4; ++i) {
-    auto &prm = prms[i];
-    cv::Mat &src = origin_dir_img[i];
-
-    undist_by_remap(src, src, prm);
-
-    // 计算动态视角投影矩阵
-    cv::Mat dynamicMatrix = calculateViewMatrix(prm.project_matrix, viewParams);
-
-    // 应用变换后的投影矩阵
-    cv::warpPerspective(src, src, dynamicMatrix, project_shapes[prm.name]);
-
-    if (camera_flip_mir[i] == "r+") {
-      cv::rotate(src, src, cv::ROTATE_90_CLOCKWISE);
-    } else if (camera_flip_mir[i] == "r-") {
-      cv::rotate(src, src, cv::ROTATE_90_COUNTERCLOCKWISE);
-    } else if (camera_flip_mir[i] == "m") {
-      cv::rotate(src, src, cv::ROTATE_180);
-    }
-    undist_dir_img[i] = src.clone();
-  }
-
-  // 3.开始合成
-  // 3.1 放置车辆图像
-  car_img.copyTo(out_put_img(cv::Rect(xl, yt, car_img.cols, car_img.rows)));
-
-  // 3.2 复制四个方向的图像
-  for (int i = 0; i < 4; ++i) {
-    cv::Rect roi;
-    if (std::string(camera_names[i]) == "front") {
-      roi = cv::Rect(xl, 0, xr - xl, yt);
-      undist_dir_img[i](roi).copyTo(out_put_img(roi));
-    } else if (std::string(camera_names[i]) == "left") {
-      roi = cv::Rect(0, yt, xl, yb - yt);
-      undist_dir_img[i](roi).copyTo(out_put_img(roi));
-    } else if (std::string(camera_names[i]) == "right") {
-      roi = cv::Rect(0, yt, xl, yb - yt);
-      undist_dir_img[i](roi).copyTo(
-          out_put_img(cv::Rect(xr, yt, total_w - xr, yb - yt)));
-    } else if (std::string(camera_names[i]) == "back") {
-      roi = cv::Rect(xl, 0, xr - xl, yt);
-      undist_dir_img[i](roi).copyTo(out_put_img(cv::Rect(xl, yb, xr - xl, yt)));
-    }
-  }
-
-  // 3.3 合成四个角的图像
-  cv::Rect roi;
-  // 左上
-  roi = cv::Rect(0, 0, xl, yt);
-  merge_image(undist_dir_img[0](roi), undist_dir_img[1](roi),
-              merge_weights_img[2], out_put_img(roi));
-  // 右上
-  roi = cv::Rect(xr, 0, xl, yt);
-  merge_image(undist_dir_img[0](roi), undist_dir_img[3](cv::Rect(0, 0, xl, yt)),
-              merge_weights_img[1], out_put_img(cv::Rect(xr, 0, xl, yt)));
-  // 左下
-  roi = cv::Rect(0, yb, xl, yt);
-  merge_image(undist_dir_img[2](cv::Rect(0, 0, xl, yt)), undist_dir_img[1](roi),
-              merge_weights_img[0], out_put_img(roi));
-  // 右下
-  roi = cv::Rect(xr, 0, xl, yt);
-  merge_image(undist_dir_img[2](roi),
-              undist_dir_img[3](cv::Rect(0, yb, xl, yt)), merge_weights_img[3],
-              out_put_img(cv::Rect(xr, yb, xl, yt)));
-
-  return out_put_img;
-}
\ No newline at end of file
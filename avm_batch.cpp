@@ -0,0 +1,413 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "avm_pipeline.h"
+#include "common.h"
+#include "frame_source.h"
+#include "stitch_lut.h"
+#include "thread_pool.h"
+#include "yuv_stitch.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// 无界面批量拼接: 读取任务清单, 不显示, 直接写出 png 序列或视频.
+// 拼接调用与 avm_app 完全相同 (默认顶视图, 同样的白平衡步长),
+// 写出的是叠加统计文字之前的结果图, png 输出逐像素一致.
+//
+// 清单每行一个任务, '#' 开头为注释:
+//   <帧源> <输出>
+//   帧源: png:<pattern> | video:<pattern>, 与 avm_app 相同
+//   输出: 以 .avi/.mp4/.mkv 结尾写视频, 否则为目录, 写 000000.png ...
+//         --nv12 时目录中写原始 nv12 帧 000000.nv12 ..., 可直接送编码器
+//   --scales=1,0.5 时每种尺寸各写一份, 第一种写到 <输出>, 其余写到
+//   <输出>_<尺寸> (视频为 <名字>_<尺寸>.<扩展名>), 小尺寸直接按缩放后的
+//   查找表从源图采样, 不从全尺寸结果缩小
+
+struct BatchOptions {
+  int workers = 1;
+  int threads = 0; // 每个进程的拼接线程, 0 = 核数 / 进程数
+  int awb_step = 4;
+  int png_level = 1;
+  bool nv12 = false; // 输出原始 nv12, yuv 帧源不经过 bgr
+  double fps = 30;
+  std::vector<double> scales = {1.0}; // 输出尺寸, 相对全尺寸
+  StitchOptions stitch;               // 采样内核和角融合层数
+};
+
+struct BatchJob {
+  std::string source;
+  std::string output;
+};
+
+// 每个工作进程通过管道回报的统计
+struct WorkerStats {
+  int64_t jobs;
+  int64_t failed;
+  int64_t frames;
+  double stitch_s; // 仅 processFrame
+  double write_s;  // 编码和写盘
+};
+
+static bool readManifest(const std::string &path, std::vector<BatchJob> &jobs) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    std::cerr << "open manifest failed " << path << "\r\n";
+    return false;
+  }
+
+  std::string line;
+  for (int n = 1; std::getline(ifs, line); ++n) {
+    std::stringstream ss(line);
+    BatchJob job;
+    if (!(ss >> job.source) || job.source[0] == '#') {
+      continue;
+    }
+    if (!(ss >> job.output)) {
+      std::cerr << path << ":" << n << " missing output\r\n";
+      return false;
+    }
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+static bool isVideoOutput(const std::string &path) {
+  std::string ext = std::filesystem::path(path).extension().string();
+  return ext == ".avi" || ext == ".mp4" || ext == ".mkv";
+}
+
+// 第 k 种尺寸的输出路径, 第一种即清单中的路径
+static std::string levelOutput(const std::string &output, double scale,
+                               size_t k) {
+  if (k == 0) {
+    return output;
+  }
+  std::ostringstream suffix;
+  suffix << "_" << scale;
+  std::filesystem::path path(output);
+  if (isVideoOutput(output)) {
+    return (path.parent_path() /
+            (path.stem().string() + suffix.str() + path.extension().string()))
+        .string();
+  }
+  return output + suffix.str();
+}
+
+static bool runJob(const BatchJob &job, const BatchOptions &opt,
+                   std::vector<StitchLevel> &levels, ThreadPool &pool,
+                   WorkerStats &stats) {
+  auto source = create_frame_source(job.source, false);
+  if (!source || !source->start()) {
+    return false;
+  }
+
+  const bool video = isVideoOutput(job.output);
+  if (video && opt.nv12) {
+    std::cerr << "--nv12 writes frame files, not " << job.output << "\r\n";
+    return false;
+  }
+  std::vector<std::string> outputs;
+  for (size_t k = 0; k < levels.size(); ++k) {
+    outputs.push_back(levelOutput(job.output, levels[k].scale, k));
+    if (video) {
+      continue;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(outputs[k], ec);
+    if (ec) {
+      std::cerr << "create output dir failed " << outputs[k] << "\r\n";
+      return false;
+    }
+  }
+  std::vector<cv::VideoWriter> writers(levels.size());
+
+  const double ms = 1000.0 / cv::getTickFrequency();
+  const std::vector<int> png_params = {cv::IMWRITE_PNG_COMPRESSION,
+                                       opt.png_level};
+  std::vector<uchar> png;
+  int64_t frames_done = 0;
+
+  std::vector<cv::Mat> nv12(levels.size());
+  while (FrameSet *frames = source->acquire()) {
+    int64 t0 = cv::getTickCount();
+    if (opt.nv12 && frames->format != PIX_BGR) {
+      for (size_t k = 0; k < levels.size(); ++k) {
+        StitchLevel &level = levels[k];
+        processFrameNv12(*frames, level.car_img, level.merge_weights_img,
+                         level.lut, level.scratch, pool, opt.awb_step,
+                         nv12[k], level.times);
+      }
+    } else {
+      processFrameLevels(*frames, levels, pool, opt.awb_step);
+      for (size_t k = 0; opt.nv12 && k < levels.size(); ++k) {
+        bgr_to_nv12(levels[k].mosaic, nv12[k]);
+      }
+    }
+    const int64_t index = frames->index;
+    source->release(frames);
+    int64 t1 = cv::getTickCount();
+
+    bool ok = true;
+    for (size_t k = 0; ok && k < levels.size(); ++k) {
+      const cv::Mat &result = opt.nv12 ? nv12[k] : levels[k].mosaic;
+      const std::string &output = outputs[k];
+      if (video) {
+        cv::VideoWriter &writer = writers[k];
+        if (!writer.isOpened()) {
+          std::string ext = std::filesystem::path(output).extension().string();
+          int fourcc = ext == ".mp4"
+                           ? cv::VideoWriter::fourcc('m', 'p', '4', 'v')
+                           : cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+          ok = writer.open(output, fourcc, opt.fps, result.size());
+        }
+        if (ok) {
+          writer.write(result);
+        }
+      } else if (opt.nv12) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%06lld.nv12", (long long)index);
+        std::ofstream ofs(output + name, std::ios::binary);
+        ok = ofs.write((const char *)result.data,
+                       result.total() * result.elemSize())
+                 .good();
+      } else {
+        char name[32];
+        snprintf(name, sizeof(name), "/%06lld.png", (long long)index);
+        ok = cv::imencode(".png", result, png, png_params);
+        std::ofstream ofs(output + name, std::ios::binary);
+        ok = ok && ofs.write((const char *)png.data(), png.size());
+      }
+      if (!ok) {
+        std::cerr << "write output failed " << output << "\r\n";
+      }
+    }
+    int64 t2 = cv::getTickCount();
+
+    if (!ok) {
+      return false;
+    }
+    stats.stitch_s += (t1 - t0) * ms / 1000.0;
+    stats.write_s += (t2 - t1) * ms / 1000.0;
+    ++stats.frames;
+    ++frames_done;
+  }
+
+  source->stop();
+  return frames_done > 0;
+}
+
+// 一个工作进程: 处理清单中下标 % workers == shard 的任务
+static WorkerStats runShard(const std::string &data_path,
+                            const std::vector<BatchJob> &jobs, int shard,
+                            const BatchOptions &opt) {
+  WorkerStats stats = {0, 0, 0, 0, 0};
+
+  // 标定包由父进程准备好, 各进程映射同一文件, 页面共享
+  RigBundle bundle;
+  cv::Mat car_img;
+  std::vector<cv::Mat> weights;
+  CameraPrms prms[4];
+  StitchLut lut; // 与 avm_app 默认视角一致
+  if (!loadAvmBundle(data_path, bundle, car_img, weights, prms, lut)) {
+    stats.failed = 1;
+    return stats;
+  }
+
+  // 每种输出尺寸一套查找表和缩放后的车辆图、权重, 全尺寸沿用标定包
+  std::vector<StitchLevel> levels(opt.scales.size());
+  for (size_t k = 0; k < levels.size(); ++k) {
+    StitchLevel &level = levels[k];
+    if (opt.scales[k] == 1.0) {
+      level.scale = 1.0;
+      level.lut = lut;
+      level.car_img = car_img;
+      level.merge_weights_img = weights;
+    } else if (!makeStitchLevel(prms, default_view, opt.scales[k], car_img,
+                                weights, level)) {
+      stats.failed = 1;
+      return stats;
+    }
+    level.scratch.options = opt.stitch;
+  }
+
+  int threads = opt.threads;
+  if (threads <= 0) {
+    int hw = (int)std::thread::hardware_concurrency();
+    threads = std::max(hw / opt.workers, 1);
+  }
+  ThreadPool pool(threads);
+
+  for (size_t i = shard; i < jobs.size(); i += opt.workers) {
+    ++stats.jobs;
+    if (!runJob(jobs[i], opt, levels, pool, stats)) {
+      std::cerr << "job failed: " << jobs[i].source << "\r\n";
+      ++stats.failed;
+    }
+  }
+  return stats;
+}
+
+int main(int argc, char **argv) {
+  BatchOptions opt;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--workers=", 0) == 0) {
+      opt.workers = std::max(std::atoi(arg.c_str() + 10), 1);
+    } else if (arg.rfind("--threads=", 0) == 0) {
+      opt.threads = std::atoi(arg.c_str() + 10);
+    } else if (arg.rfind("--awb-step=", 0) == 0) {
+      opt.awb_step = std::max(std::atoi(arg.c_str() + 11), 1);
+    } else if (arg.rfind("--png-level=", 0) == 0) {
+      opt.png_level = std::atoi(arg.c_str() + 12);
+    } else if (arg == "--nv12") {
+      opt.nv12 = true;
+    } else if (arg.rfind("--fps=", 0) == 0) {
+      opt.fps = std::atof(arg.c_str() + 6);
+    } else if (arg.rfind("--remap=", 0) == 0) {
+      RemapMode mode;
+      if (!parse_remap_mode(arg.substr(8), mode)) {
+        std::cerr << "unknown remap " << arg << "\r\n";
+        return -1;
+      }
+      opt.stitch.remap = mode;
+    } else if (arg.rfind("--bands=", 0) == 0) {
+      opt.stitch.bands = std::max(std::atoi(arg.c_str() + 8), 1);
+    } else if (arg.rfind("--scales=", 0) == 0) {
+      opt.scales.clear();
+      std::stringstream ss(arg.substr(9));
+      std::string item;
+      while (std::getline(ss, item, ',')) {
+        double scale = std::atof(item.c_str());
+        if (scale <= 0 || scale > 1) {
+          std::cerr << "scale must be in (0, 1]: " << item << "\r\n";
+          return -1;
+        }
+        opt.scales.push_back(scale);
+      }
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.size() != 2) {
+    std::cout << "usage:\n\t" << argv[0]
+              << " path manifest [--workers=N] [--threads=N] [--awb-step=N]"
+                 " [--png-level=N] [--fps=F] [--nv12] [--scales=S,...]"
+                 " [--remap=M] [--bands=N]\n"
+              << "\tmanifest lines: <source> <output dir | video file>\n"
+              << "\t--workers: processes the manifest is split across "
+                 "(default 1)\n"
+              << "\t--threads: stitching threads per process, 0 = cores / "
+                 "workers (default 0)\n"
+              << "\t--nv12: write raw nv12 frames, yuv sources are stitched "
+                 "without going through bgr\n"
+              << "\t--scales: output sizes, one output each, the extra ones "
+                 "suffixed _<scale> (default 1)\n"
+              << "\t--remap: bilinear | nearest | opencv, frame sampling "
+                 "kernel, same default as avm_app\n"
+              << "\t--bands: overlap corner blend levels, 1 = per pixel "
+                 "alpha, 2+ = multi-band (default 1)\n";
+    return -1;
+  }
+  if (opt.scales.empty()) {
+    std::cerr << "no output scale\r\n";
+    return -1;
+  }
+  const std::string data_path = args[0];
+
+  std::vector<BatchJob> jobs;
+  if (!readManifest(args[1], jobs)) {
+    return -1;
+  }
+  if (jobs.empty()) {
+    std::cerr << "empty manifest\r\n";
+    return -1;
+  }
+  opt.workers = std::min(opt.workers, (int)jobs.size());
+
+  // 多进程前先检查/生成标定包, 避免各进程同时重建
+  if (opt.workers > 1) {
+    RigBundle bundle;
+    if (!bundle.open(rig_bundle_path(data_path),
+                     rig_source_checksum(data_path))) {
+      write_rig_bundle(rig_bundle_path(data_path), data_path);
+    }
+  }
+
+  int64 t0 = cv::getTickCount();
+  WorkerStats total = {0, 0, 0, 0, 0};
+
+  if (opt.workers == 1) {
+    total = runShard(data_path, jobs, 0, opt);
+  } else {
+    // fork 在创建任何线程之前进行, 子进程各自加载数据和线程池
+    std::vector<pid_t> pids;
+    std::vector<int> fds;
+    for (int k = 0; k < opt.workers; ++k) {
+      int fd[2];
+      if (pipe(fd) != 0) {
+        std::cerr << "pipe failed\r\n";
+        return -1;
+      }
+      pid_t pid = fork();
+      if (pid < 0) {
+        std::cerr << "fork failed\r\n";
+        return -1;
+      }
+      if (pid == 0) {
+        close(fd[0]);
+        WorkerStats stats = runShard(data_path, jobs, k, opt);
+        ssize_t n = write(fd[1], &stats, sizeof(stats));
+        close(fd[1]);
+        _exit(n == (ssize_t)sizeof(stats) && stats.failed == 0 ? 0 : 1);
+      }
+      close(fd[1]);
+      pids.push_back(pid);
+      fds.push_back(fd[0]);
+    }
+
+    for (int k = 0; k < opt.workers; ++k) {
+      WorkerStats stats = {0, 0, 0, 0, 0};
+      if (read(fds[k], &stats, sizeof(stats)) != (ssize_t)sizeof(stats)) {
+        stats.failed = 1; // worker died before reporting
+      }
+      close(fds[k]);
+      int status = 0;
+      waitpid(pids[k], &status, 0);
+
+      total.jobs += stats.jobs;
+      total.failed += stats.failed;
+      total.frames += stats.frames;
+      total.stitch_s += stats.stitch_s;
+      total.write_s += stats.write_s;
+    }
+  }
+
+  const double wall_s = (cv::getTickCount() - t0) / cv::getTickFrequency();
+  double mosaic_px = 0; // 每组源帧写出的像素, 所有尺寸之和
+  for (double scale : opt.scales) {
+    mosaic_px += total_w * scale * total_h * scale;
+  }
+  std::cout << std::fixed << std::setprecision(2) << "jobs: " << total.jobs
+            << " (" << total.failed << " failed), frames: " << total.frames
+            << ", workers: " << opt.workers << "\n"
+            << "  wall time:  " << wall_s << " s\n"
+            << "  throughput: " << total.frames / wall_s << " fps, "
+            << total.frames * mosaic_px / wall_s / 1e6 << " Mpx/s\n";
+  if (total.frames > 0) {
+    std::cout << "  stitch:     " << total.stitch_s * 1000 / total.frames
+              << " ms/frame\n"
+              << "  write:      " << total.write_s * 1000 / total.frames
+              << " ms/frame\n";
+  }
+  std::cout << std::flush;
+  return total.failed == 0 ? 0 : 1;
+}
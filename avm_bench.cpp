@@ -0,0 +1,785 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "avm_pipeline.h"
+#include "blend_simd.h"
+#include "common.h"
+#include "frame_source.h"
+#include "multiband_blend.h"
+#include "remap_simd.h"
+#include "stitch_lut.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <set>
+
+// 2D 拼接各阶段的基准测试, 不含解码和窗口显示
+//   avm_bench <data path> [--iters=N] [--warmup=N] [--threads=N]
+//             [--sizes=WxH,...] [--awb-step=N] [--json=out.json]
+//             [--bands=N] [--blend-budget=MS]
+//   avm_bench --check [--seed=N]
+
+// 一个阶段在一种输入上的结果
+struct BenchResult {
+  std::string input;   // data 或 synthetic
+  cv::Size frame_size; // 相机帧尺寸
+  std::string stage;
+  double median_ms;
+  double p99_ms;
+  double mean_ms;
+  double min_ms;
+  int64_t out_pixels;  // 每次迭代写出的像素数
+  double bytes_per_px; // 每个输出像素的读写字节数 (按数据流估算)
+};
+
+struct BenchOptions {
+  int iters = 50;
+  int warmup = 3;
+  int threads = 4;
+  int awb_step = 4;
+  std::vector<cv::Size> sizes = {cv::Size(960, 640), cv::Size(1280, 720),
+                                 cv::Size(1920, 1080)};
+  std::string json_path;
+  int bands = 4;              // 生产环境的角融合层数
+  double blend_budget_ms = 0; // 四个角多频段融合的每帧预算, 0 = 不检查
+  bool check = false;         // 只做 simd 与标量的逐字节比较
+  uint64_t seed = 1;          // --check 的随机种子
+};
+
+// 一组输入帧及其对应的标定参数
+struct BenchInput {
+  std::string name;
+  CameraPrms prms[4];
+  FrameSet frames;
+};
+
+static bool parseSizes(const std::string &arg, std::vector<cv::Size> &sizes) {
+  sizes.clear();
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    int w = 0, h = 0;
+    if (sscanf(item.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+      return false;
+    }
+    sizes.push_back(cv::Size(w, h));
+  }
+  return true;
+}
+
+// 把标定缩放到另一种分辨率: 内参和平移按像素缩放,
+// 畸变系数在归一化坐标下不变, 投影矩阵的输入坐标同样缩放
+static void scaleCameraPrms(const CameraPrms &src, const cv::Size &size,
+                            CameraPrms &dst) {
+  const double sx = (double)size.width / src.size.width;
+  const double sy = (double)size.height / src.size.height;
+
+  dst = src;
+  dst.camera_matrix = src.camera_matrix.clone();
+  dst.shift_xy = src.shift_xy.clone();
+  dst.size = size;
+
+  double *k = dst.camera_matrix.ptr<double>();
+  k[0] *= sx;
+  k[2] *= sx;
+  k[4] *= sy;
+  k[5] *= sy;
+
+  float *shift = dst.shift_xy.ptr<float>();
+  shift[0] *= (float)sx;
+  shift[1] *= (float)sy;
+
+  cv::Mat h, s = cv::Mat::eye(3, 3, CV_64F);
+  src.project_matrix.convertTo(h, CV_64F);
+  s.at<double>(0, 0) = 1.0 / sx;
+  s.at<double>(1, 1) = 1.0 / sy;
+  dst.project_matrix = h * s;
+}
+
+static double percentile(const std::vector<double> &sorted, double q) {
+  int idx = (int)std::ceil(q * sorted.size()) - 1;
+  idx = std::min(std::max(idx, 0), (int)sorted.size() - 1);
+  return sorted[idx];
+}
+
+// setup 在每次迭代前执行, 不计时
+static BenchResult runStage(const BenchInput &input, const std::string &stage,
+                            const BenchOptions &opt, int64_t out_pixels,
+                            double bytes_per_px,
+                            const std::function<void()> &setup,
+                            const std::function<void()> &body) {
+  const double ms = 1000.0 / cv::getTickFrequency();
+  std::vector<double> times;
+
+  for (int i = 0; i < opt.warmup + opt.iters; ++i) {
+    if (setup) {
+      setup();
+    }
+    int64 t0 = cv::getTickCount();
+    body();
+    int64 t1 = cv::getTickCount();
+    if (i >= opt.warmup) {
+      times.push_back((t1 - t0) * ms);
+    }
+  }
+
+  std::sort(times.begin(), times.end());
+  double sum = 0;
+  for (double t : times) {
+    sum += t;
+  }
+
+  BenchResult r;
+  r.input = input.name;
+  r.frame_size = input.frames.img[0].size();
+  r.stage = stage;
+  r.median_ms = percentile(times, 0.5);
+  r.p99_ms = percentile(times, 0.99);
+  r.mean_ms = sum / times.size();
+  r.min_ms = times.front();
+  r.out_pixels = out_pixels;
+  r.bytes_per_px = bytes_per_px;
+
+  std::cout << std::left << std::setw(10) << r.input << std::setw(11)
+            << (std::to_string(r.frame_size.width) + "x" +
+                std::to_string(r.frame_size.height))
+            << std::setw(22) << r.stage << std::right << std::fixed
+            << std::setprecision(3) << std::setw(10) << r.median_ms
+            << std::setw(10) << r.p99_ms << std::setw(10)
+            << r.out_pixels / (r.median_ms * 1000.0) << std::setw(8)
+            << std::setprecision(1) << r.bytes_per_px << std::endl;
+  return r;
+}
+
+static void benchInput(BenchInput &input, cv::Mat &car_img,
+                       const cv::Mat &weights, ThreadPool &pool,
+                       const BenchOptions &opt,
+                       std::vector<BenchResult> &results) {
+  int64_t frame_px = 0, undist_px = 0, project_px = 0;
+  for (int i = 0; i < 4; ++i) {
+    frame_px += input.frames.img[i].total();
+    undist_px += input.prms[i].size.area();
+    project_px += project_shapes.at(input.prms[i].name).area();
+  }
+
+  // 1. 去畸变: 读 map1 (4) + map2 (2) + 源像素 (3), 写 3
+  cv::Mat undist[4];
+  results.push_back(runStage(input, "undist_by_remap", opt, undist_px, 12,
+                             nullptr, [&] {
+                               for (int i = 0; i < 4; ++i) {
+                                 undist_by_remap(input.frames.img[i], undist[i],
+                                                 input.prms[i]);
+                               }
+                             }));
+
+  // 2. 透视投影: 读源像素 3, 写 3
+  cv::Mat project[4];
+  results.push_back(runStage(
+      input, "warpPerspective", opt, project_px, 6, nullptr, [&] {
+        for (int i = 0; i < 4; ++i) {
+          cv::warpPerspective(undist[i], project[i],
+                              input.prms[i].project_matrix,
+                              project_shapes.at(input.prms[i].name));
+        }
+      }));
+
+  // 3. 重叠角融合, 原始浮点权重、三通道 8 位权重与紧凑单通道权重
+  //    浮点: 读 3 + 3 + 权重 4, 写 3; 三通道: 读 3 + 3 + 权重 3, 写 3;
+  //    紧凑: 读 3 + 3 + 权重 1, 写 3
+  std::vector<cv::Mat> float_weights(4), c3_weights, fixed_weights;
+  for (int i = 0; i < 4; ++i) {
+    cv::Mat plane;
+    cv::extractChannel(weights, plane, i);
+    plane.convertTo(float_weights[i], CV_32F, 1 / 255.0);
+  }
+  load_blend_weights_c3(weights, c3_weights);
+  load_blend_weights(weights, fixed_weights);
+
+  const cv::Size corner_size = weights.size();
+  cv::Mat corner_a(corner_size, CV_8UC3), corner_b(corner_size, CV_8UC3);
+  cv::Mat corner_out(corner_size, CV_8UC3);
+  cv::randu(corner_a, 0, 256);
+  cv::randu(corner_b, 0, 256);
+  const int64_t corner_px = 4 * (int64_t)corner_size.area();
+
+  results.push_back(runStage(input, "merge_image", opt, corner_px, 13, nullptr,
+                             [&] {
+                               for (int i = 0; i < 4; ++i) {
+                                 merge_image(corner_a, corner_b,
+                                             float_weights[i], corner_out);
+                               }
+                             }));
+  results.push_back(runStage(input, "blend_image_c3", opt, corner_px, 12,
+                             nullptr, [&] {
+                               for (int i = 0; i < 4; ++i) {
+                                 blend_image(corner_a, corner_b,
+                                             c3_weights[i], corner_out);
+                               }
+                             }));
+  results.push_back(runStage(input, "blend_image", opt, corner_px, 10, nullptr,
+                             [&] {
+                               for (int i = 0; i < 4; ++i) {
+                                 blend_image(corner_a, corner_b,
+                                             fixed_weights[i], corner_out);
+                               }
+                             }));
+
+  // 多频段融合, 四个角在线程池上并行, 与 stitch_by_lut 相同.
+  // 每个角一个预先分配的融合器, 权重金字塔只建一次 (不计时).
+  // 读两份样本 6, 写 3; 金字塔每层每像素约 12 次 16 位三通道访问
+  // (差分、下采样、拉普拉斯、加权、重建), 各层像素合计约 4/3
+  // --bands 总要计时, 预算检查看的就是它; 超出这个角尺寸的层数上限时
+  // 不计时, 预算检查判失败
+  const int max_bands = multiband_max_bands(corner_size);
+  std::vector<int> band_counts;
+  for (int bands = 2; bands <= std::min(5, max_bands); ++bands) {
+    band_counts.push_back(bands);
+  }
+  if (opt.bands > max_bands) {
+    std::cerr << "--bands=" << opt.bands << " exceeds " << max_bands
+              << " levels of the " << corner_size.width << "x"
+              << corner_size.height << " corner\r\n";
+  } else if (std::find(band_counts.begin(), band_counts.end(), opt.bands) ==
+             band_counts.end()) {
+    band_counts.insert(std::upper_bound(band_counts.begin(), band_counts.end(),
+                                        opt.bands),
+                       opt.bands);
+  }
+  for (int bands : band_counts) {
+    std::unique_ptr<MultiBandBlender> blenders[4];
+    for (int i = 0; i < 4; ++i) {
+      blenders[i] = std::make_unique<MultiBandBlender>(corner_size, bands);
+      blenders[i]->prepare(fixed_weights[i]);
+    }
+    cv::Mat outs[4];
+    for (int i = 0; i < 4; ++i) {
+      outs[i].create(corner_size, CV_8UC3);
+    }
+    results.push_back(runStage(
+        input, "multiband_blend_" + std::to_string(bands), opt, corner_px,
+        9 + 12 * 6 * 4 / 3.0, nullptr, [&] {
+          pool.parallelFor(4, [&](int i) {
+            blenders[i]->blend(corner_a, corner_b, outs[i]);
+          });
+        }));
+  }
+
+  // 4. 白平衡. 原地修改, 每次迭代前恢复源图 (不计时)
+  //    整帧: 统计读 3, 增益读 3 写 3; 稀疏: 只读网格上的像素
+  FrameSet work;
+  std::vector<cv::Mat *> srcs;
+  for (int i = 0; i < 4; ++i) {
+    srcs.push_back(&work.img[i]);
+  }
+  results.push_back(runStage(
+      input, "awb_and_lum_banlance", opt, frame_px, 9,
+      [&] {
+        for (int i = 0; i < 4; ++i) {
+          input.frames.img[i].copyTo(work.img[i]);
+        }
+      },
+      [&] { awb_and_lum_banlance(srcs, &pool); }));
+
+  GainLut luts[4];
+  std::vector<cv::Mat *> raw;
+  for (int i = 0; i < 4; ++i) {
+    raw.push_back(&input.frames.img[i]);
+  }
+  results.push_back(runStage(input, "awb_gain_luts", opt, frame_px,
+                             3.0 / (opt.awb_step * opt.awb_step), nullptr,
+                             [&] {
+                               awb_gain_luts(raw, luts, opt.awb_step, &pool);
+                             }));
+
+  // 5. 完整的一帧. 每个 lut 像素读紧凑表 (5) + 源 (3), 角区域采两次再
+  //    读回两份样本和权重 (9), 车辆图读 3, 全部写 3
+  ViewpointParams view = {1.0f, 0.0f, 0.0f, 1.0f};
+  StitchLut lut;
+  if (!updateStitchLut(input.prms, view, lut)) {
+    return;
+  }
+  StitchScratch scratch;
+  StageTimes stage_times;
+
+  // 查找表每像素实际存的字节, 即 remap_lut_bytes
+  auto lutBytes = [](const LutRegion &r) {
+    return (int)(r.remap.xy.elemSize() + r.remap.frac.elemSize());
+  };
+  auto frameBytes = [&](const StitchLut &l) {
+    double bytes = 0;
+    for (int i = 0; i < 4; ++i) {
+      bytes += l.body[i].roi.area() * (lutBytes(l.body[i]) + 3 + 3);
+      bytes += l.corner[i][0].roi.area() *
+               (lutBytes(l.corner[i][0]) + lutBytes(l.corner[i][1]) +
+                2 * (3 + 3) + 9 + 3);
+    }
+    bytes += l.car.area() * (3 + 3);
+    return bytes + frame_px * 3.0 / (opt.awb_step * opt.awb_step);
+  };
+  const int64_t mosaic_px = lut.size.area();
+
+  // 查表采样的三种内核, 八个区域都采一遍 (不含白平衡和融合).
+  //   opencv: 读 map1 (4) + map2 (2) + 源 3, 写 3. 查找表里不存 map1 /
+  //           map2, 计时前由 remap_lut_maps 展开, 展开不计时
+  //   分块紧凑表: 读坐标 (4) + 小数 (1) + 源 3, 写 3
+  std::vector<const LutRegion *> regions;
+  int64_t region_px = 0;
+  for (int i = 0; i < 4; ++i) {
+    regions.push_back(&lut.body[i]);
+    regions.push_back(&lut.corner[i][0]);
+    regions.push_back(&lut.corner[i][1]);
+  }
+  for (const LutRegion *r : regions) {
+    region_px += r->roi.area();
+  }
+  std::vector<cv::Mat> samples(regions.size());
+  std::vector<cv::Mat> map1(regions.size()), map2(regions.size());
+  for (size_t k = 0; k < regions.size(); ++k) {
+    remap_lut_maps(regions[k]->remap, map1[k], map2[k]);
+  }
+  results.push_back(runStage(input, "remap_opencv", opt, region_px, 12,
+                             nullptr, [&] {
+                               for (size_t k = 0; k < regions.size(); ++k) {
+                                 const LutRegion &r = *regions[k];
+                                 cv::remap(input.frames.img[r.cam],
+                                           samples[k], map1[k], map2[k],
+                                           cv::INTER_LINEAR,
+                                           cv::BORDER_CONSTANT);
+                               }
+                             }));
+  const RemapMode tiled_modes[2] = {REMAP_BILINEAR, REMAP_NEAREST};
+  for (RemapMode mode : tiled_modes) {
+    results.push_back(runStage(
+        input, std::string("remap_tiled_") + remap_mode_name(mode), opt,
+        region_px, lutBytes(*regions[0]) + 6, nullptr, [&] {
+          for (size_t k = 0; k < regions.size(); ++k) {
+            const LutRegion &r = *regions[k];
+            remap_tiled(input.frames.img[r.cam], r.remap, samples[k], mode);
+          }
+        }));
+  }
+
+  results.push_back(runStage(input, "processFrame", opt, mosaic_px,
+                             frameBytes(lut) / mosaic_px, nullptr, [&] {
+                               processFrame(input.frames, car_img,
+                                            fixed_weights, lut, scratch, pool,
+                                            opt.awb_step, stage_times);
+                             }));
+
+  // 角区域改用多频段融合后的完整一帧, 融合器和金字塔在自己的 scratch 里
+  if (opt.bands > 1) {
+    StitchScratch banded;
+    banded.options.bands = opt.bands;
+    results.push_back(runStage(
+        input, "processFrame_bands" + std::to_string(opt.bands), opt,
+        mosaic_px, frameBytes(lut) / mosaic_px, nullptr, [&] {
+          processFrame(input.frames, car_img, fixed_weights, lut, banded,
+                       pool, opt.awb_step, stage_times);
+        }));
+  }
+
+  // 6. 半尺寸预览: 缩放后的查找表直接采样, 对比全尺寸拼接再缩小
+  StitchLevel half;
+  if (!makeStitchLevel(input.prms, view, 0.5, car_img, fixed_weights, half)) {
+    return;
+  }
+  const int64_t half_px = half.lut.size.area();
+  results.push_back(runStage(input, "processFrame_x0.5", opt, half_px,
+                             frameBytes(half.lut) / half_px, nullptr, [&] {
+                               processFrame(input.frames, half.car_img,
+                                            half.merge_weights_img, half.lut,
+                                            half.scratch, pool, opt.awb_step,
+                                            half.mosaic, half.times);
+                             }));
+  cv::Mat full, shrunk;
+  results.push_back(runStage(
+      input, "processFrame+resize", opt, half_px,
+      (frameBytes(lut) + mosaic_px * 3 + half_px * 3) / half_px, nullptr,
+      [&] {
+        processFrame(input.frames, car_img, fixed_weights, lut, scratch, pool,
+                     opt.awb_step, full, stage_times);
+        cv::resize(full, shrunk, half.lut.size, 0, 0, cv::INTER_AREA);
+      }));
+}
+
+static bool writeJson(const std::string &path, const BenchOptions &opt,
+                      int threads, const std::vector<BenchResult> &results) {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    std::cerr << "open json failed " << path << "\r\n";
+    return false;
+  }
+
+  ofs << std::fixed << std::setprecision(4);
+  ofs << "{\n"
+      << "  \"version\": 1,\n"
+      << "  \"opencv\": \"" << CV_VERSION << "\",\n"
+      << "  \"blend_isa\": \"" << blend_isa_name(blend_best_isa()) << "\",\n"
+      << "  \"threads\": " << threads << ",\n"
+      << "  \"iters\": " << opt.iters << ",\n"
+      << "  \"warmup\": " << opt.warmup << ",\n"
+      << "  \"awb_step\": " << opt.awb_step << ",\n"
+      << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult &r = results[i];
+    ofs << "    {\"input\": \"" << r.input << "\", \"width\": "
+        << r.frame_size.width << ", \"height\": " << r.frame_size.height
+        << ", \"stage\": \"" << r.stage << "\", \"median_ms\": " << r.median_ms
+        << ", \"p99_ms\": " << r.p99_ms << ", \"mean_ms\": " << r.mean_ms
+        << ", \"min_ms\": " << r.min_ms << ", \"out_pixels\": " << r.out_pixels
+        << ", \"mpix_per_s\": " << r.out_pixels / (r.median_ms * 1000.0)
+        << ", \"fps\": " << 1000.0 / r.median_ms
+        << ", \"bytes_per_px\": " << r.bytes_per_px << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  ofs << "  ]\n}\n";
+  return (bool)ofs;
+}
+
+// --check: 每个 simd 路径与标量路径逐字节比较, 随机查找表和随机帧.
+// 头文件里写的 "bit-exact" 由这里保证, 任何一个样本不同即失败
+struct CheckCase {
+  cv::Size frame; // 源帧, 取自一块更宽的图, 行有填充
+  cv::Size out;   // 查找表 / 输出, 故意不是分块的整数倍
+};
+
+static int64_t countMismatch(const cv::Mat &a, const cv::Mat &b) {
+  if (a.size() != b.size() || a.type() != b.type()) {
+    return std::max<int64_t>((int64_t)a.total() * a.elemSize(), 1);
+  }
+  cv::Mat ne;
+  cv::compare(a.reshape(1), b.reshape(1), ne, cv::CMP_NE);
+  return cv::countNonZero(ne);
+}
+
+static bool reportCheck(const std::string &kernel, BlendIsa isa,
+                        int64_t mismatched) {
+  std::cout << std::left << std::setw(28) << kernel << std::setw(8)
+            << blend_isa_name(isa)
+            << (mismatched == 0 ? std::string("ok")
+                                : std::to_string(mismatched) +
+                                      " mismatched samples")
+            << std::endl;
+  return mismatched == 0;
+}
+
+// 坐标覆盖帧外两个像素, 边界和帧内的快速路径都会走到
+static RemapLut randomRemapLut(cv::RNG &rng, cv::Size out, cv::Size frame) {
+  RemapLut lut;
+  lut.xy.create(out, CV_16SC2);
+  lut.frac.create(out, CV_8UC1);
+  for (int y = 0; y < out.height; ++y) {
+    short *xy = lut.xy.ptr<short>(y);
+    for (int x = 0; x < out.width; ++x) {
+      xy[2 * x + 0] = (short)rng.uniform(-3, frame.width + 2);
+      xy[2 * x + 1] = (short)rng.uniform(-3, frame.height + 2);
+    }
+  }
+  rng.fill(lut.frac, cv::RNG::UNIFORM, 0, 256);
+  return lut;
+}
+
+static cv::Mat randomFrame(cv::RNG &rng, cv::Size size) {
+  cv::Mat wide(size.height + 2, size.width + 7, CV_8UC3);
+  rng.fill(wide, cv::RNG::UNIFORM, 0, 256);
+  return wide(cv::Rect(3, 1, size.width, size.height));
+}
+
+static bool runCheck(uint64_t seed) {
+  cv::RNG rng(seed);
+  std::vector<BlendIsa> isas;
+  const BlendIsa simd[3] = {BLEND_ISA_SSE41, BLEND_ISA_AVX2, BLEND_ISA_NEON};
+  for (BlendIsa isa : simd) {
+    if (blend_isa_supported(isa)) {
+      isas.push_back(isa);
+    }
+  }
+  std::cout << "check seed " << seed << ", best isa "
+            << blend_isa_name(blend_best_isa()) << std::endl;
+  if (isas.empty()) {
+    std::cout << "no simd path on this cpu, nothing to compare" << std::endl;
+    return true;
+  }
+
+  const CheckCase cases[] = {
+      {cv::Size(4, 3), cv::Size(1, 1)},
+      {cv::Size(64, 48), cv::Size(63, 17)},
+      {cv::Size(333, 219), cv::Size(203, 77)},
+      {cv::Size(1280, 720), cv::Size(640, 481)},
+  };
+  GainLut gain;
+  for (int k = 0; k < 256; ++k) {
+    gain.b[k] = (uchar)rng.uniform(0, 256);
+    gain.g[k] = (uchar)rng.uniform(0, 256);
+    gain.r[k] = (uchar)rng.uniform(0, 256);
+  }
+
+  bool ok = true;
+  for (BlendIsa isa : isas) {
+    // 查表采样, 不带和带增益
+    int64_t plain = 0, gained = 0;
+    for (const CheckCase &c : cases) {
+      const cv::Mat frame = randomFrame(rng, c.frame);
+      const RemapLut lut = randomRemapLut(rng, c.out, c.frame);
+      cv::Mat ref, out;
+      remap_tiled(frame, lut, ref, REMAP_BILINEAR, nullptr, BLEND_ISA_SCALAR);
+      remap_tiled(frame, lut, out, REMAP_BILINEAR, nullptr, isa);
+      plain += countMismatch(ref, out);
+      remap_tiled(frame, lut, ref, REMAP_BILINEAR, &gain, BLEND_ISA_SCALAR);
+      remap_tiled(frame, lut, out, REMAP_BILINEAR, &gain, isa);
+      gained += countMismatch(ref, out);
+    }
+    ok &= reportCheck("remap_tiled_bilinear", isa, plain);
+    ok &= reportCheck("remap_tiled_bilinear_gain", isa, gained);
+
+    // 8 位融合, 长度覆盖每种向量宽度的尾部
+    const int lengths[] = {1, 7, 15, 16, 33, 100, 4099};
+    int64_t row = 0, c1 = 0, sums = 0, q15 = 0;
+    for (int n : lengths) {
+      cv::Mat a(1, 3 * n, CV_8UC1), b(1, 3 * n, CV_8UC1);
+      cv::Mat w(1, 3 * n, CV_8UC1);
+      rng.fill(a, cv::RNG::UNIFORM, 0, 256);
+      rng.fill(b, cv::RNG::UNIFORM, 0, 256);
+      rng.fill(w, cv::RNG::UNIFORM, 0, 256);
+      // 权重的两端
+      w.ptr()[0] = 0;
+      w.ptr()[3 * n - 1] = 255;
+      cv::Mat ref(1, 3 * n, CV_8UC1), out(1, 3 * n, CV_8UC1);
+      blend_row_ref(a.ptr(), b.ptr(), w.ptr(), ref.ptr(), 3 * n);
+      blend_row(a.ptr(), b.ptr(), w.ptr(), out.ptr(), 3 * n, isa);
+      row += countMismatch(ref, out);
+      blend_row_c1(a.ptr(), b.ptr(), w.ptr(), ref.ptr(), n, BLEND_ISA_SCALAR);
+      blend_row_c1(a.ptr(), b.ptr(), w.ptr(), out.ptr(), n, isa);
+      c1 += countMismatch(ref, out);
+
+      uint64_t sum_ref[3] = {0, 0, 0}, sum_isa[3] = {0, 0, 0};
+      bgr_row_sum(a.ptr(), n, sum_ref, BLEND_ISA_SCALAR);
+      bgr_row_sum(a.ptr(), n, sum_isa, isa);
+      for (int ch = 0; ch < 3; ++ch) {
+        sums += sum_ref[ch] != sum_isa[ch];
+      }
+
+      // q15: 样本取满 int16, 权重 [0, 32767] (prepare 的取值范围)
+      cv::Mat qa(1, 3 * n, CV_16SC1), qw(1, 3 * n, CV_16SC1);
+      rng.fill(qa, cv::RNG::UNIFORM, -32768, 32768);
+      rng.fill(qw, cv::RNG::UNIFORM, 0, 32768);
+      qa.ptr<int16_t>()[0] = -32768;
+      qw.ptr<int16_t>()[0] = 32767;
+      qa.ptr<int16_t>()[3 * n - 1] = 32767;
+      qw.ptr<int16_t>()[3 * n - 1] = 32767;
+      cv::Mat qref(1, 3 * n, CV_16SC1), qout(1, 3 * n, CV_16SC1);
+      blend_row_q15(qa.ptr<int16_t>(), qw.ptr<int16_t>(),
+                    qref.ptr<int16_t>(), 3 * n, BLEND_ISA_SCALAR);
+      blend_row_q15(qa.ptr<int16_t>(), qw.ptr<int16_t>(),
+                    qout.ptr<int16_t>(), 3 * n, isa);
+      q15 += countMismatch(qref, qout);
+    }
+    ok &= reportCheck("blend_row", isa, row);
+    ok &= reportCheck("blend_row_c1", isa, c1);
+    ok &= reportCheck("bgr_row_sum", isa, sums);
+    ok &= reportCheck("blend_row_q15", isa, q15);
+
+    // 整个多频段角融合, 权重平面和两路样本都随机
+    int64_t multiband = 0;
+    for (const CheckCase &c : cases) {
+      if (c.out.width < 16 || c.out.height < 16) {
+        continue;
+      }
+      cv::Mat weight(c.out, CV_8UC1), a, b;
+      rng.fill(weight, cv::RNG::UNIFORM, 0, 256);
+      a = randomFrame(rng, c.out);
+      b = randomFrame(rng, c.out);
+      MultiBandBlender blender(c.out, 4);
+      blender.prepare(weight);
+      cv::Mat ref(c.out, CV_8UC3), out(c.out, CV_8UC3);
+      blender.blend(a, b, ref, BLEND_ISA_SCALAR);
+      blender.blend(a, b, out, isa);
+      multiband += countMismatch(ref, out);
+    }
+    ok &= reportCheck("multiband_blend_4", isa, multiband);
+  }
+  std::cout << (ok ? "check passed" : "check FAILED") << std::endl;
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions opt;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--iters=", 0) == 0) {
+      opt.iters = std::max(std::atoi(arg.c_str() + 8), 1);
+    } else if (arg.rfind("--warmup=", 0) == 0) {
+      opt.warmup = std::max(std::atoi(arg.c_str() + 9), 0);
+    } else if (arg.rfind("--threads=", 0) == 0) {
+      opt.threads = std::atoi(arg.c_str() + 10);
+    } else if (arg.rfind("--awb-step=", 0) == 0) {
+      opt.awb_step = std::max(std::atoi(arg.c_str() + 11), 1);
+    } else if (arg.rfind("--sizes=", 0) == 0) {
+      if (!parseSizes(arg.substr(8), opt.sizes)) {
+        std::cerr << "bad sizes " << arg << "\r\n";
+        return -1;
+      }
+    } else if (arg.rfind("--json=", 0) == 0) {
+      opt.json_path = arg.substr(7);
+    } else if (arg.rfind("--bands=", 0) == 0) {
+      opt.bands = std::atoi(arg.c_str() + 8);
+      if (opt.bands < 1) {
+        std::cerr << "bad bands " << arg << "\r\n";
+        return -1;
+      }
+    } else if (arg.rfind("--blend-budget=", 0) == 0) {
+      opt.blend_budget_ms = std::atof(arg.c_str() + 15);
+    } else if (arg == "--check") {
+      opt.check = true;
+    } else if (arg.rfind("--seed=", 0) == 0) {
+      opt.seed = std::strtoull(arg.c_str() + 7, nullptr, 10);
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (opt.check) {
+    return runCheck(opt.seed) ? 0 : 1;
+  }
+  if (args.size() != 1) {
+    std::cout << "usage:\n\t" << argv[0]
+              << " path [--iters=N] [--warmup=N] [--threads=N]"
+                 " [--sizes=WxH,...] [--awb-step=N] [--json=file]"
+                 " [--bands=N] [--blend-budget=MS]\n"
+              << "\t--sizes: synthetic frame sizes, empty for data only "
+                 "(default 960x640,1280x720,1920x1080)\n"
+              << "\t--bands: corner blend levels the frame is timed with "
+                 "(default 4)\n"
+              << "\t--blend-budget: p99 limit of the four multi-band "
+                 "corners per frame, fails the run when --bands misses it or "
+                 "exceeds the levels of a corner\n"
+              << "\t" << argv[0] << " --check [--seed=N]\n"
+              << "\t--check: compare every simd kernel with the scalar one "
+                 "on random luts and frames, fails on any byte mismatch\n";
+    return -1;
+  }
+  std::string data_path = args[0];
+
+  cv::Mat car_img = cv::imread(data_path + "/images/car.png");
+  cv::Mat weights = cv::imread(data_path + "/yaml/weights.png", -1);
+  if (car_img.empty() || weights.channels() != 4) {
+    std::cerr << "read car / weights failed\r\n";
+    return -1;
+  }
+  cv::resize(car_img, car_img, cv::Size(xr - xl, yb - yt));
+
+  // data/ 下的真实帧
+  BenchInput data_input;
+  data_input.name = "data";
+  data_input.frames.format = PIX_BGR;
+  data_input.frames.index = 0;
+  data_input.frames.load_ms = 0;
+  data_input.frames.ready_tick = 0;
+  for (int i = 0; i < 4; ++i) {
+    CameraPrms &prm = data_input.prms[i];
+    prm.name = camera_names[i];
+    if (!read_prms(data_path + "/yaml/" + prm.name + ".yaml", prm)) {
+      return -1;
+    }
+    data_input.frames.img[i] =
+        cv::imread(data_path + "/images/" + prm.name + ".png");
+    if (data_input.frames.img[i].size() != prm.size) {
+      std::cerr << "bad frame " << prm.name << "\r\n";
+      return -1;
+    }
+  }
+
+  ThreadPool pool(opt.threads);
+  std::cout << "blend isa: " << blend_isa_name(blend_best_isa())
+            << ", threads: " << pool.size() << ", iters: " << opt.iters
+            << std::endl;
+  std::cout << std::left << std::setw(10) << "input" << std::setw(11) << "frame"
+            << std::setw(22) << "stage" << std::right << std::setw(10)
+            << "median" << std::setw(10) << "p99" << std::setw(10) << "Mpx/s"
+            << std::setw(8) << "B/px" << std::endl;
+
+  std::vector<BenchResult> results;
+  benchInput(data_input, car_img, weights, pool, opt, results);
+
+  // 合成帧, 标定按分辨率缩放
+  for (const cv::Size &size : opt.sizes) {
+    auto source = create_frame_source(
+        "synthetic:" + std::to_string(size.width) + "x" +
+            std::to_string(size.height),
+        false, 1);
+    FrameSet *frames = nullptr;
+    if (source && source->start()) {
+      frames = source->acquire();
+    }
+    if (!frames) {
+      std::cerr << "synthetic source failed\r\n";
+      return -1;
+    }
+
+    BenchInput input;
+    input.name = "synthetic";
+    input.frames.format = frames->format;
+    input.frames.index = 0;
+    input.frames.load_ms = 0;
+    input.frames.ready_tick = 0;
+    for (int i = 0; i < 4; ++i) {
+      scaleCameraPrms(data_input.prms[i], size, input.prms[i]);
+      input.frames.img[i] = frames->img[i].clone();
+    }
+    source->release(frames);
+    source->stop();
+
+    benchInput(input, car_img, weights, pool, opt, results);
+  }
+
+  if (!opt.json_path.empty()) {
+    if (!writeJson(opt.json_path, opt, pool.size(), results)) {
+      return -1;
+    }
+    std::cout << "json written to " << opt.json_path << std::endl;
+  }
+
+  // 多频段融合的预算检查, 按 p99 而不是中位数, 偶尔超时同样会丢帧.
+  // 某个输入没有 --bands 的计时 (层数超出角尺寸) 同样判失败
+  bool budget_ok = true;
+  if (opt.blend_budget_ms > 0) {
+    const std::string selected = "multiband_blend_" + std::to_string(opt.bands);
+    std::set<std::string> inputs, timed;
+    std::cout << std::setprecision(3) << "\nblend budget "
+              << opt.blend_budget_ms << " ms (p99):\n";
+    for (const BenchResult &r : results) {
+      const std::string size = std::to_string(r.frame_size.width) + "x" +
+                               std::to_string(r.frame_size.height);
+      inputs.insert(r.input + " " + size);
+      if (r.stage.rfind("multiband_blend_", 0) != 0) {
+        continue;
+      }
+      if (r.stage == selected) {
+        timed.insert(r.input + " " + size);
+      }
+      const bool fits = r.p99_ms <= opt.blend_budget_ms;
+      std::cout << std::left << std::setw(10) << r.input << std::setw(11)
+                << size << std::setw(22) << r.stage << std::right << std::setw(10)
+                << r.p99_ms << (fits ? "  ok" : "  over")
+                << (r.stage == selected ? "  <- selected" : "") << "\n";
+      if (r.stage == selected && !fits) {
+        budget_ok = false;
+      }
+    }
+    for (const std::string &in : inputs) {
+      if (timed.count(in) == 0) {
+        std::cout << in << ": " << selected << " not timed\n";
+        budget_ok = false;
+      }
+    }
+    std::cout << std::flush;
+  }
+  return budget_ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "avm_pipeline.h"
+#include "rig_bundle.h"
+#include <iomanip>
+
+// 标定包生成工具: 把四路相机标定、默认视角的查找表、融合权重和车辆图像
+// 写成一个可直接 mmap 使用的二进制文件. avm_app / avm_batch 启动时发现
+// 标定包缺失或过期也会自动生成, 这里用于离线预先生成或部署.
+// --calibration 只写标定和查找表 (avm_farm 每个 rig 用的那种),
+// 车辆图像和权重由所有 rig 共用, 不需要 rig 目录下的 png
+
+int main(int argc, char **argv) {
+  bool calibration = false;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--calibration") {
+      calibration = true;
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.size() != 1 && args.size() != 2) {
+    std::cout << "usage:\n\t" << argv[0] << " path [bundle] [--calibration]\n"
+              << "\tbundle: output file (default path/cache/rig.bundle, or "
+                 "path/cache/rig_calibration.bundle)\n"
+              << "\t--calibration: calibration and lut only, no car image or "
+                 "weights\n";
+    return -1;
+  }
+  const std::string data_path = args[0];
+  const std::string bundle_path =
+      args.size() == 2 ? args[1]
+      : calibration    ? rig_calibration_bundle_path(data_path)
+                       : rig_bundle_path(data_path);
+
+  int64 t0 = cv::getTickCount();
+  if (calibration ? !write_rig_calibration_bundle(bundle_path, data_path)
+                  : !write_rig_bundle(bundle_path, data_path)) {
+    std::cerr << "write rig bundle failed " << bundle_path << "\r\n";
+    return -1;
+  }
+  int64 t1 = cv::getTickCount();
+
+  // 回读校验并对比两种加载方式的耗时
+  RigBundle bundle;
+  CameraPrms prms[4];
+  StitchLut lut;
+  std::vector<cv::Mat> weights;
+  cv::Mat car_img;
+  const uint64_t checksum = calibration ? rig_calibration_checksum(data_path)
+                                        : rig_source_checksum(data_path);
+  if (!bundle.open(bundle_path, checksum) || !bundle.cameraPrms(prms) ||
+      !bundle.stitchLut(lut) ||
+      (!calibration &&
+       (!bundle.blendWeights(weights) || !bundle.carImage(car_img)))) {
+    std::cerr << "read back rig bundle failed " << bundle_path << "\r\n";
+    return -1;
+  }
+  int64 t2 = cv::getTickCount();
+
+  const double ms = 1000.0 / cv::getTickFrequency();
+  std::cout << std::fixed << std::setprecision(2) << "written " << bundle_path
+            << "\n"
+            << "  build from sources: " << (t1 - t0) * ms << " ms\n"
+            << "  open bundle:        " << (t2 - t1) * ms << " ms"
+            << std::endl;
+  return 0;
+}
@@ -9,6 +9,7 @@
 #include <map>
 #include <vector>
 #include "common.h"
+#include "map_cache.h"
 
 struct mouse_prms {
     cv::Mat* mat;
@@ -46,6 +47,8 @@ void on_mouse(int event, int x, int y, int flags, void* param)
 int main(int argc, char** argv)
 {
     std::cout  << argv[0] << " app start running..." << std::endl;
+    // keep undistort maps on disk, later runs skip the map computation
+    set_undist_map_cache_dir("../../cache");
     
     for (int i = 0; i < 4; ++i) {
         CameraPrms prms;
@@ -0,0 +1,304 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "common.h"
+#include "frame_source.h"
+#include "image_writer.h"
+#include "stitcher.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+// 多机位拼接服务: 一个进程内同时拼接多辆车的相机组, 每个机位一个独立的
+// Stitcher (标定、布局、查找表各自持有), 全部调度到同一个工作窃取线程池,
+// 车辆图和融合权重等只读资源只加载一次, 所有机位共享.
+//
+// 机位清单每行一个, '#' 开头为注释:
+//   <标定数据目录> <帧源> [输出目录]
+//   帧源与 avm_app 相同, 给出输出目录时写 000000.png ...
+
+struct FarmOptions {
+  int threads = 0;         // 共享线程池大小, 0 = 核数 (或 --pin 的核数)
+  std::vector<int> cores;  // 工作线程和机位驱动线程绑定的核
+  int writers = 0;         // png 编码线程, 0 = 每个机位一个, 不超过核数
+  std::string assets;      // 共享资源目录, 默认第一个机位的目录
+  int awb_step = 4;
+  double scale = 1.0;
+  int64_t frames = 0;      // 每个机位最多拼接的帧数, 0 = 全部
+  double report_s = 2.0;   // 统计打印间隔
+  bool loop = false;       // 帧源循环播放, 配合 --frames 做压力测试
+};
+
+struct RigJob {
+  std::string data_path;
+  std::string source;
+  std::string output;
+};
+
+struct Rig {
+  RigJob job;
+  int core = -1; // 驱动线程绑定的核, -1 不绑
+  std::unique_ptr<Stitcher> stitcher;
+  std::unique_ptr<FrameSource> source;
+  std::thread thread;
+  std::atomic<bool> done{false};
+  std::atomic<bool> failed{false};
+};
+
+static bool readRigList(const std::string &path, std::vector<RigJob> &jobs) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    std::cerr << "open rig list failed " << path << "\r\n";
+    return false;
+  }
+
+  std::string line;
+  for (int n = 1; std::getline(ifs, line); ++n) {
+    std::stringstream ss(line);
+    RigJob job;
+    if (!(ss >> job.data_path) || job.data_path[0] == '#') {
+      continue;
+    }
+    if (!(ss >> job.source)) {
+      std::cerr << path << ":" << n << " missing source\r\n";
+      return false;
+    }
+    ss >> job.output;
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+// 一个机位的驱动线程: 取帧、拼接, 输出交给编码线程. 拼接的并行部分在
+// 共享线程池上, 驱动线程在 parallelFor 里也领任务. 绑核时各机位的驱动
+// 线程轮流分到 --pin 的各个核上, 不挤在同一个核
+static void runRig(Rig &rig, const FarmOptions &opt, ImageWriter &writer) {
+  trace_thread_name(("rig " + rig.stitcher->name()).c_str());
+  if (rig.core >= 0 && !pin_current_thread(rig.core)) {
+    std::cerr << "pin rig thread failed, core " << rig.core << "\r\n";
+  }
+  cv::Mat out;
+  int64_t count = 0;
+
+  while (FrameSet *frames = rig.source->acquire()) {
+    rig.stitcher->process(*frames, out);
+    const int64_t index = frames->index;
+    rig.source->release(frames);
+
+    if (!rig.job.output.empty()) {
+      char name[32];
+      snprintf(name, sizeof(name), "/%06lld.png", (long long)index);
+      // out 交给编码线程, 下一帧重新分配
+      writer.push(rig.job.output + name, out);
+    }
+    if (opt.frames > 0 && ++count >= opt.frames) {
+      break;
+    }
+  }
+  rig.source->stop();
+  rig.done = true;
+}
+
+static void printStats(const std::vector<std::unique_ptr<Rig>> &rigs,
+                       double wall_s) {
+  uint64_t frames = 0;
+  std::cout << std::fixed << std::setprecision(2) << std::left
+            << std::setw(20) << "rig" << std::right << std::setw(10)
+            << "frames" << std::setw(10) << "fps" << std::setw(12)
+            << "stitch ms" << std::setw(10) << "balance" << std::setw(10)
+            << "body" << std::setw(10) << "corner" << "\n";
+  for (const auto &rig : rigs) {
+    StitcherStats s = rig->stitcher->stats();
+    frames += s.frames;
+    std::cout << std::left << std::setw(20) << rig->stitcher->name()
+              << std::right << std::setw(10) << s.frames << std::setw(10)
+              << s.fps << std::setw(12) << s.process_ms << std::setw(10)
+              << s.times.balance << std::setw(10) << s.times.body
+              << std::setw(10) << s.times.corner
+              << (rig->failed ? "  failed" : "") << "\n";
+  }
+  std::cout << "total: " << frames << " frames, " << frames / wall_s
+            << " fps over " << rigs.size() << " rigs" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  FarmOptions opt;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--threads=", 0) == 0) {
+      opt.threads = std::atoi(arg.c_str() + 10);
+    } else if (arg.rfind("--pin=", 0) == 0) {
+      if (!parse_core_list(arg.substr(6), opt.cores)) {
+        std::cerr << "bad core list " << arg << "\r\n";
+        return -1;
+      }
+    } else if (arg.rfind("--writers=", 0) == 0) {
+      opt.writers = std::max(std::atoi(arg.c_str() + 10), 0);
+    } else if (arg.rfind("--assets=", 0) == 0) {
+      opt.assets = arg.substr(9);
+    } else if (arg.rfind("--awb-step=", 0) == 0) {
+      opt.awb_step = std::max(std::atoi(arg.c_str() + 11), 1);
+    } else if (arg.rfind("--scale=", 0) == 0) {
+      opt.scale = std::atof(arg.c_str() + 8);
+    } else if (arg.rfind("--frames=", 0) == 0) {
+      opt.frames = std::atoll(arg.c_str() + 9);
+    } else if (arg.rfind("--report=", 0) == 0) {
+      opt.report_s = std::max(std::atof(arg.c_str() + 9), 0.1);
+    } else if (arg == "--loop") {
+      opt.loop = true;
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.size() != 1) {
+    std::cout << "usage:\n\t" << argv[0]
+              << " rigs.txt [--threads=N] [--pin=CORES] [--writers=N]"
+                 " [--assets=path] [--awb-step=N] [--scale=S] [--frames=N] [--loop]"
+                 " [--report=S]\n"
+              << "\trig lines: <data path> <source> [output dir]\n"
+              << "\t--threads: shared stitching pool, 0 = all cores "
+                 "(default 0)\n"
+              << "\t--pin: cores of the farm, e.g. 0-15 or 0-7,16-23. pool "
+                 "workers and rig threads are spread over them; --threads "
+                 "defaults to the core count\n"
+              << "\t--writers: png encoder threads, 0 = one per rig up to "
+                 "the core count (default 0)\n"
+              << "\t--assets: car image and weights shared by every rig "
+                 "(default the first rig's path)\n"
+              << "\t--frames: stop every rig after N frames, with --loop "
+                 "for a sustained load\n";
+    return -1;
+  }
+
+  std::vector<RigJob> jobs;
+  if (!readRigList(args[0], jobs)) {
+    return -1;
+  }
+  if (jobs.empty()) {
+    std::cerr << "empty rig list\r\n";
+    return -1;
+  }
+
+  // 1. 只读资源加载一次, 所有机位共享同一份映射
+  auto assets =
+      load_stitch_assets(opt.assets.empty() ? jobs[0].data_path : opt.assets);
+  if (!assets) {
+    return -1;
+  }
+
+  // 2. 共享线程池, 所有机位的拼接任务在其中窃取执行. 绑核时线程数
+  //    默认等于核数, 每个核一个线程
+  if (!opt.cores.empty() && opt.threads <= 0) {
+    opt.threads = (int)opt.cores.size();
+  }
+  ThreadPool pool(opt.threads, opt.cores);
+  std::cout << "stitch threads: " << pool.size()
+            << (opt.cores.empty() ? "" : " (pinned)") << std::endl;
+
+  // 3. 每个机位独立的 Stitcher 和帧源. 依次加载, 标定包的重建不会并发
+  std::vector<std::unique_ptr<Rig>> rigs;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    auto rig = std::make_unique<Rig>();
+    rig->job = jobs[i];
+    if (!opt.cores.empty()) {
+      rig->core = opt.cores[i % opt.cores.size()];
+    }
+    StitcherConfig config;
+    config.name = std::to_string(i) + ":" + jobs[i].data_path;
+    config.data_path = jobs[i].data_path;
+    config.scale = opt.scale;
+    config.awb_step = opt.awb_step;
+    rig->stitcher = std::make_unique<Stitcher>(pool, assets);
+    if (!rig->stitcher->load(config)) {
+      std::cerr << "load rig failed " << jobs[i].data_path << "\r\n";
+      return -1;
+    }
+    rig->source = create_frame_source(jobs[i].source, opt.loop);
+    if (!rig->source) {
+      return -1;
+    }
+    if (!rig->job.output.empty()) {
+      std::error_code ec;
+      std::filesystem::create_directories(rig->job.output, ec);
+      if (ec) {
+        std::cerr << "create output dir failed " << rig->job.output << "\r\n";
+        return -1;
+      }
+    }
+    rigs.push_back(std::move(rig));
+  }
+
+  // 4. png 编码线程, 驱动线程只管取帧和拼接. 队列满时驱动线程等待
+  const int cores = opt.cores.empty()
+                        ? (int)std::thread::hardware_concurrency()
+                        : (int)opt.cores.size();
+  const int writers = opt.writers > 0
+                          ? opt.writers
+                          : std::max(1, std::min((int)rigs.size(), cores));
+  ImageWriter writer(writers, writers * 2, {cv::IMWRITE_PNG_COMPRESSION, 1});
+
+  // 5. 启动所有机位, 主线程定时打印每个机位的吞吐
+  int64 t0 = cv::getTickCount();
+  for (auto &rig : rigs) {
+    if (!rig->source->start()) {
+      rig->failed = true;
+      rig->done = true;
+      continue;
+    }
+    rig->thread = std::thread(runRig, std::ref(*rig), std::cref(opt),
+                              std::ref(writer));
+  }
+
+  auto all_done = [&] {
+    for (const auto &rig : rigs) {
+      if (!rig->done) {
+        return false;
+      }
+    }
+    return true;
+  };
+  const auto report_every =
+      std::chrono::milliseconds((int)(opt.report_s * 1000));
+  auto next_report = std::chrono::steady_clock::now() + report_every;
+  while (!all_done()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if (std::chrono::steady_clock::now() < next_report) {
+      continue;
+    }
+    next_report += report_every;
+    printStats(rigs, (cv::getTickCount() - t0) / cv::getTickFrequency());
+  }
+  for (auto &rig : rigs) {
+    if (rig->thread.joinable()) {
+      rig->thread.join();
+    }
+  }
+  writer.finish();
+
+  const double wall_s = (cv::getTickCount() - t0) / cv::getTickFrequency();
+  std::cout << "\nfinished in " << wall_s << " s, pool steals "
+            << pool.steals() << "\n";
+  printStats(rigs, wall_s);
+
+  if (writer.failed() > 0) {
+    std::cerr << writer.failed() << " of " << writer.written() + writer.failed()
+              << " images failed to write\r\n";
+  }
+
+  bool ok = writer.failed() == 0;
+  for (const auto &rig : rigs) {
+    ok = ok && !rig->failed;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#version 330 core
+out vec4 FragColor;
+
+// 碗面直接采样原始帧: 每个顶点的相机坐标和权重在构建时烘焙好,
+// 这里只做插值后的采样、白平衡和加权求和
+in vec4 Uv01;
+in vec4 Uv23;
+in vec4 Weight;
+
+uniform sampler2DArray cameras; // 4 路原始帧, 层号即相机号
+uniform int meanLod;            // 相机帧 1x1 的 mipmap 层
+uniform bool awb;
+
+// 与 stitch.frag 相同的灰度世界白平衡增益
+vec3 cameraGain(int cam)
+{
+    vec3 mean[4];
+    float gray[4];
+    float grayAve = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        mean[i] = max(texelFetch(cameras, ivec3(0, 0, i), meanLod).rgb * 255.0,
+                      vec3(1.0));
+        gray[i] = mean[i].r * 20.0 + mean[i].g * 60.0 + mean[i].b;
+        grayAve += gray[i] * 0.25;
+    }
+    float lumGain = grayAve / gray[cam];
+    vec3 m = mean[cam];
+    return vec3(m.g / m.r, 1.0, m.g / m.b) * lumGain;
+}
+
+vec3 sampleCamera(int cam, vec2 uv)
+{
+    vec3 c = textureLod(cameras, vec3(uv, float(cam)), 0.0).rgb;
+    return awb ? min(c * cameraGain(cam), vec3(1.0)) : c;
+}
+
+void main()
+{
+    vec2 uv[4] = vec2[4](Uv01.xy, Uv01.zw, Uv23.xy, Uv23.zw);
+    float w[4] = float[4](Weight.x, Weight.y, Weight.z, Weight.w);
+    vec3 color = vec3(0.0);
+    float sum = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        // 三角形内插值后很小的权重也跳过, 省掉无效的采样
+        if (w[i] > 0.001) {
+            color += sampleCamera(i, uv[i]) * w[i];
+            sum += w[i];
+        }
+    }
+    FragColor = vec4(sum > 0.0 ? color / sum : vec3(0.0), 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aUv01;   // 相机 0 / 1 原始帧的纹理坐标
+layout (location = 2) in vec4 aUv23;   // 相机 2 / 3
+layout (location = 3) in vec4 aWeight; // 各相机的融合权重 (构建时烘焙)
+
+out vec4 Uv01;
+out vec4 Uv23;
+out vec4 Weight;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    Uv01 = aUv01;
+    Uv23 = aUv23;
+    Weight = aWeight;
+}
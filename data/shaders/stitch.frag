@@ -0,0 +1,65 @@
+#version 330 core
+out vec4 FragColor;
+
+// 与 CPU 的 stitch_by_lut 相同的拼接, 每个片段是拼接图的一个像素:
+// 查找表给出一到两个相机上的采样坐标 (去畸变 + 投影 + 旋转已合并),
+// 灰度世界白平衡增益由相机帧 1x1 的 mipmap 均值算出, 重叠角按权重融合
+uniform sampler2DArray cameras; // 4 路原始帧, 层号即相机号
+uniform sampler2D lutCoords;    // RGBA16: 样本 a 的 uv, 样本 b 的 uv
+uniform sampler2D lutMeta;      // RGBA8: 相机 a, 相机 b, a 的权重, 255 = 无
+uniform sampler2D carImage;
+uniform ivec4 carRect;          // 车辆图在拼接图中的 x, y, w, h
+uniform int meanLod;            // 相机帧 1x1 的 mipmap 层
+uniform bool awb;
+
+// 与 awb_gains 相同: gray = 20 r + 60 g + b, 各相机亮度拉到平均值,
+// r / b 再对齐到 g
+vec3 cameraGain(int cam)
+{
+    vec3 mean[4];
+    float gray[4];
+    float grayAve = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        mean[i] = max(texelFetch(cameras, ivec3(0, 0, i), meanLod).rgb * 255.0,
+                      vec3(1.0));
+        gray[i] = mean[i].r * 20.0 + mean[i].g * 60.0 + mean[i].b;
+        grayAve += gray[i] * 0.25;
+    }
+    float lumGain = grayAve / gray[cam];
+    vec3 m = mean[cam];
+    return vec3(m.g / m.r, 1.0, m.g / m.b) * lumGain;
+}
+
+// lut 坐标还原为纹理坐标, 像素 x 的中心在 (x + 0.5) / w
+vec3 sampleCamera(int cam, vec2 coord)
+{
+    if (cam > 3) {
+        return vec3(0.0);
+    }
+    vec2 size = vec2(textureSize(cameras, 0).xy);
+    vec2 uv = (coord * (size + 1.0) - 0.5) / size;
+    vec3 c = textureLod(cameras, vec3(uv, float(cam)), 0.0).rgb;
+    return awb ? min(c * cameraGain(cam), vec3(1.0)) : c;
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    if (p.x >= carRect.x && p.y >= carRect.y && p.x < carRect.x + carRect.z &&
+        p.y < carRect.y + carRect.w) {
+        FragColor = texelFetch(carImage, p - carRect.xy, 0);
+        return;
+    }
+
+    vec4 uv = texelFetch(lutCoords, p, 0);
+    vec4 meta = texelFetch(lutMeta, p, 0);
+    int camA = int(meta.r * 255.0 + 0.5);
+    int camB = int(meta.g * 255.0 + 0.5);
+    vec3 a = sampleCamera(camA, uv.xy);
+    if (camB == camA) {
+        FragColor = vec4(a, 1.0);
+        return;
+    }
+    vec3 b = sampleCamera(camB, uv.zw);
+    FragColor = vec4(mix(b, a, meta.b), 1.0);
+}
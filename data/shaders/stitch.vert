@@ -0,0 +1,7 @@
+#version 330 core
+// 覆盖整个拼接图的单个三角形, 不需要顶点缓冲
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,347 @@
+#include "headless.h"
+#include "camera.h"
+#include "frame_source.h"
+#include "image_writer.h"
+#include "offscreen.h"
+#include "renderer.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#ifdef AVM_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+namespace {
+
+struct Pose {
+  std::string name;
+  Camera camera;
+};
+
+// 没有窗口的 GL 3.3 core 上下文. 有 EGL 时优先 surfaceless (不需要
+// X/Wayland), 否则用 GLFW 的隐藏窗口
+class HeadlessContext {
+public:
+  ~HeadlessContext() { destroy(); }
+
+  bool create() {
+#ifdef AVM_HAS_EGL
+    if (createEgl()) {
+      return gladLoad((GLADloadproc)eglGetProcAddress);
+    }
+    std::cerr << "Headless: no EGL context, trying a hidden GLFW window"
+              << std::endl;
+#endif
+    if (!glfwInit()) {
+      std::cerr << "Headless Error: failed to initialize GLFW" << std::endl;
+      return false;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    m_window = glfwCreateWindow(64, 64, "avm headless", NULL, NULL);
+    if (!m_window) {
+      std::cerr << "Headless Error: failed to create hidden GLFW window"
+                << std::endl;
+      glfwTerminate();
+      return false;
+    }
+    glfwMakeContextCurrent(m_window);
+    return gladLoad((GLADloadproc)glfwGetProcAddress);
+  }
+
+  void destroy() {
+#ifdef AVM_HAS_EGL
+    if (m_display != EGL_NO_DISPLAY) {
+      eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                     EGL_NO_CONTEXT);
+      if (m_context != EGL_NO_CONTEXT) {
+        eglDestroyContext(m_display, m_context);
+        m_context = EGL_NO_CONTEXT;
+      }
+      eglTerminate(m_display);
+      m_display = EGL_NO_DISPLAY;
+    }
+#endif
+    if (m_window) {
+      glfwDestroyWindow(m_window);
+      glfwTerminate();
+      m_window = nullptr;
+    }
+  }
+
+private:
+  bool gladLoad(GLADloadproc loader) {
+    if (!gladLoadGLLoader(loader)) {
+      std::cerr << "Headless Error: failed to initialize GLAD" << std::endl;
+      return false;
+    }
+    std::cout << "Headless: " << glGetString(GL_RENDERER) << ", "
+              << glGetString(GL_VERSION) << std::endl;
+    return true;
+  }
+
+#ifdef AVM_HAS_EGL
+  bool createEgl() {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+      m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                     EGL_DEFAULT_DISPLAY, nullptr);
+    }
+#endif
+    if (m_display == EGL_NO_DISPLAY) {
+      m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major = 0, minor = 0;
+    if (m_display == EGL_NO_DISPLAY ||
+        !eglInitialize(m_display, &major, &minor)) {
+      m_display = EGL_NO_DISPLAY;
+      return false;
+    }
+    const EGLint configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                    EGL_NONE};
+    EGLConfig config;
+    EGLint count = 0;
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR,
+        3,
+        EGL_CONTEXT_MINOR_VERSION_KHR,
+        3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE};
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        !eglChooseConfig(m_display, configAttribs, &config, 1, &count) ||
+        count < 1 ||
+        (m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT,
+                                      contextAttribs)) == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        m_context)) {
+      destroy();
+      return false;
+    }
+    return true;
+  }
+
+  EGLDisplay m_display = EGL_NO_DISPLAY;
+  EGLContext m_context = EGL_NO_CONTEXT;
+#endif
+  GLFWwindow *m_window = nullptr;
+};
+
+bool loadPoses(const std::string &spec, std::vector<Pose> &poses) {
+  static const char *presetNames[] = {"top", "front", "rear", "left_rear",
+                                      "right_rear"};
+  if (spec.rfind("orbit:", 0) == 0) {
+    // 与预设 2~5 一样的 45 度俯视, 距离中心 8
+    const int count = std::atoi(spec.c_str() + 6);
+    const float distance = 8.0f * glm::cos(glm::radians(45.0f));
+    const float height = 8.0f * glm::sin(glm::radians(45.0f));
+    for (int i = 0; i < count; ++i) {
+      Pose pose;
+      char name[32];
+      snprintf(name, sizeof(name), "orbit_%03d", i);
+      pose.name = name;
+      setCameraOrbit(pose.camera, i, count, distance, height);
+      poses.push_back(pose);
+    }
+  } else if (spec.find_first_not_of("0123456789,") == std::string::npos) {
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      Pose pose;
+      const int index = std::atoi(item.c_str());
+      if (!setCameraPreset(pose.camera, index)) {
+        std::cerr << "Headless Error: no camera preset " << item << std::endl;
+        return false;
+      }
+      pose.name = presetNames[index - 1];
+      poses.push_back(pose);
+    }
+  } else {
+    std::ifstream ifs(spec);
+    if (!ifs.is_open()) {
+      std::cerr << "Headless Error: cannot open pose file " << spec
+                << std::endl;
+      return false;
+    }
+    std::string line;
+    for (int n = 1; std::getline(ifs, line); ++n) {
+      std::stringstream ss(line);
+      Pose pose;
+      if (!(ss >> pose.name) || pose.name[0] == '#') {
+        continue;
+      }
+      glm::vec3 position;
+      float yaw, pitch;
+      if (!(ss >> position.x >> position.y >> position.z >> yaw >> pitch)) {
+        std::cerr << spec << ":" << n << " expected name x y z yaw pitch [fov]"
+                  << std::endl;
+        return false;
+      }
+      float fov;
+      if (ss >> fov) {
+        pose.camera.Zoom = fov;
+      }
+      pose.camera.Position = position;
+      pose.camera.Yaw = yaw;
+      pose.camera.Pitch = pitch;
+      pose.camera.updateCameraVectors();
+      poses.push_back(pose);
+    }
+  }
+  if (poses.empty()) {
+    std::cerr << "Headless Error: no camera poses in " << spec << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// 上下文建好之后的全部工作, GL 对象在返回前释放
+int renderAll(const HeadlessOptions &opt, std::vector<Pose> &poses) {
+  Renderer renderer(opt.data_path, opt.gpu_stitch, opt.bowl);
+  renderer.setBowlParams(opt.bowl_params);
+  renderer.setBowlLod(opt.bowl_lod);
+  if (!renderer.init()) {
+    std::cerr << "Failed to initialize renderer!" << std::endl;
+    return -1;
+  }
+
+  std::unique_ptr<FrameSource> source;
+  if (opt.gpu_stitch) {
+    const std::string spec =
+        opt.source_spec.empty() ? "png:" + opt.data_path + "/images/{cam}.png"
+                                : opt.source_spec;
+    source = create_frame_source(spec, opt.frames > 0);
+    if (!source || !source->start()) {
+      renderer.cleanup();
+      return -1;
+    }
+  }
+
+  const bool jpg = opt.ext == ".jpg" || opt.ext == ".jpeg";
+  const std::vector<int> params =
+      jpg ? std::vector<int>{cv::IMWRITE_JPEG_QUALITY, 95}
+          : std::vector<int>{cv::IMWRITE_PNG_COMPRESSION, 1};
+  // llvmpipe 光栅化也要用核, 编码默认只占一半
+  const int writers =
+      opt.writers > 0
+          ? opt.writers
+          : std::max(1, (int)std::thread::hardware_concurrency() / 2);
+  ImageWriter writer(writers, writers * 2, params);
+
+  // 回读的 tag 是全局的视角序号, 文件名 <帧号>_<视角名>
+  std::vector<int64_t> frameOfView;
+  auto onImage = [&](int64_t tag, cv::Mat &image) {
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "/%06lld_",
+             (long long)frameOfView[tag / poses.size()]);
+    writer.push(opt.output + prefix + poses[tag % poses.size()].name +
+                    opt.ext,
+                image);
+  };
+
+  OffscreenTarget target;
+  AsyncReadback readback;
+  int ret = 0;
+  if (!target.init(opt.width, opt.height) ||
+      !readback.init(opt.width, opt.height, opt.readback_depth, onImage)) {
+    ret = -1;
+  }
+
+  const float aspect = (float)opt.width / (float)opt.height;
+  double drawMs = 0.0;
+  int64_t views = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int64_t frame = 0; ret == 0 && (opt.frames <= 0 || frame < opt.frames);
+       ++frame) {
+    AVM_TRACE_SCOPE("headless_frame");
+    int64_t index = frame;
+    if (source) {
+      FrameSet *frames = source->acquire();
+      if (!frames) {
+        break;
+      }
+      index = frames->index;
+      renderer.uploadFrames(*frames);
+      source->release(frames);
+    }
+    frameOfView.push_back(index);
+
+    // 所有视角共用这一帧的拼接结果, 只有第一次 draw 拼接
+    target.bind();
+    for (Pose &pose : poses) {
+      const auto t0 = std::chrono::steady_clock::now();
+      renderer.draw(pose.camera.getViewMatrix(),
+                    pose.camera.getProjectionMatrix(aspect));
+      readback.read(views++);
+      drawMs += std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count();
+      readback.poll(false);
+    }
+    target.unbind();
+  }
+  readback.poll(true);
+  writer.finish();
+  const double wallS = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+  if (source) {
+    source->stop();
+  }
+  readback.cleanup();
+  target.cleanup();
+  renderer.cleanup();
+
+  if (views > 0) {
+    std::cout << "headless: " << views << " views (" << frameOfView.size()
+              << " frames x " << poses.size() << " poses) at " << opt.width
+              << "x" << opt.height << " in " << wallS << " s, "
+              << views * 60.0 / wallS << " views/min, draw "
+              << drawMs / views << " ms/view, readback stalls "
+              << readback.stalls() << " (" << readback.stallMs()
+              << " ms), writer wait " << writer.waitMs() << " ms, "
+              << writer.written() << " written" << std::endl;
+  }
+  return (ret == 0 && writer.failed() == 0) ? 0 : -1;
+}
+
+} // namespace
+
+int runHeadless(const HeadlessOptions &opt) {
+  std::vector<Pose> poses;
+  if (!loadPoses(opt.poses, poses)) {
+    return -1;
+  }
+  HeadlessContext context;
+  if (!context.create()) {
+    return -1;
+  }
+  glEnable(GL_DEPTH_TEST);
+  const int ret = renderAll(opt, poses);
+  context.destroy();
+  return ret;
+}
@@ -0,0 +1,30 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "bowl_mesh.h"
+#include <string>
+
+// 无窗口批量渲染: surfaceless (EGL) 或隐藏窗口的上下文, Renderer::draw
+// 画进 FBO, PBO 异步回读, 编码线程写图. 不需要显示器, llvmpipe 也能跑
+struct HeadlessOptions {
+  std::string data_path;
+  std::string output;      // 输出目录, 已存在
+  std::string source_spec; // 空时用 data_path/images
+  bool gpu_stitch = false;
+  bool bowl = false;
+  BowlParams bowl_params;
+  int bowl_lod = 0;
+  // "1,2,5" 预设视角, "orbit:N" 绕车 N 个视角, 或者位姿文件,
+  // 每行 "name x y z yaw pitch [fov]"
+  std::string poses = "1,2,3,4,5";
+  int width = 1280;
+  int height = 720;
+  int frames = 1;        // 源的帧数, 每帧渲染全部视角. <= 0 直到源结束
+  int readback_depth = 3; // 在途的回读个数
+  int writers = 0;        // 编码线程, <= 0 按核数
+  std::string ext = ".png";
+};
+
+int runHeadless(const HeadlessOptions &opt);
+
+#endif // HEADLESS_H
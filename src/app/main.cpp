@@ -1,7 +1,19 @@
 #include "common.h"
+#include "frame_source.h"
+#include "frame_timer.h"
+#include "headless.h"
+#include "stitcher.h"
+#include "streaming_texture.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
 #include <iostream>
 #include <memory>
 #include <string> // For std::string
+#include <thread>
 
 #include <glad/glad.h>
 // --- OpenGL / Windowing ---
@@ -49,14 +61,126 @@ void setCameraView(int viewIndex);
 // --- Renderer 实例 ---
 std::unique_ptr<Renderer> g_renderer;
 
+// --- 帧时间, F12 或 SIGUSR1 导出到 g_timingPath ---
+std::unique_ptr<FrameTimer> g_frameTimer;
+std::string g_timingPath = "frame_timing.json";
+volatile std::sig_atomic_t g_timingDumpRequested = 0;
+
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    std::cout << "usage:\n\t" << argv[0] << " data_path\n";
+  std::string trace_path;
+  std::string timing_path;
+  std::string source_spec;
+  bool gpu_stitch = false;
+  bool stream = false;
+  bool bowl = false;
+  BowlParams bowl_params;
+  int bowl_lod = 0;
+  HeadlessOptions headless;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--trace=", 0) == 0) {
+      trace_path = arg.substr(8);
+    } else if (arg.rfind("--timing=", 0) == 0) {
+      timing_path = arg.substr(9);
+    } else if (arg == "--gpu-stitch") {
+      gpu_stitch = true;
+    } else if (arg == "--stream") {
+      stream = true;
+    } else if (arg == "--bowl") {
+      bowl = true;
+    } else if (arg.rfind("--bowl-lod=", 0) == 0) {
+      bowl_lod = std::max(std::atoi(arg.c_str() + 11), 0);
+    } else if (arg.rfind("--bowl-res=", 0) == 0) {
+      // 角向x径向, 径向的环数平分给地面和碗壁
+      int angular = 0, rings = 0;
+      if (sscanf(arg.c_str() + 11, "%dx%d", &angular, &rings) == 2 &&
+          angular >= 8 && rings >= 2) {
+        bowl_params.angular = angular;
+        bowl_params.ground_rings = rings / 2;
+        bowl_params.wall_rings = rings - rings / 2;
+      }
+    } else if (arg.rfind("--source=", 0) == 0) {
+      source_spec = arg.substr(9);
+    } else if (arg.rfind("--headless=", 0) == 0) {
+      headless.output = arg.substr(11);
+    } else if (arg.rfind("--poses=", 0) == 0) {
+      headless.poses = arg.substr(8);
+    } else if (arg.rfind("--size=", 0) == 0) {
+      int w = 0, h = 0;
+      if (sscanf(arg.c_str() + 7, "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+        headless.width = w;
+        headless.height = h;
+      }
+    } else if (arg.rfind("--frames=", 0) == 0) {
+      headless.frames = std::atoi(arg.c_str() + 9);
+    } else if (arg.rfind("--format=", 0) == 0) {
+      headless.ext = "." + arg.substr(9);
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (bowl || (!source_spec.empty() && !stream)) {
+    gpu_stitch = true;
+  }
+  if (args.size() != 1 || (stream && gpu_stitch) ||
+      (stream && !headless.output.empty())) {
+    std::cout << "usage:\n\t" << argv[0]
+              << " data_path [--gpu-stitch | --stream] [--bowl] [--bowl-lod=N]"
+                 " [--bowl-res=AxR] [--source=spec] [--trace=file.json]"
+                 " [--timing=file.json|csv]\n"
+              << "\t\t[--headless=dir [--poses=spec] [--size=WxH] "
+                 "[--frames=N] [--format=png|jpg]]\n"
+              << "\t--gpu-stitch: texture the scene with the mosaic stitched "
+                 "on the gpu from the raw frames\n"
+              << "\t--stream: texture the scene with the mosaic stitched on "
+                 "the cpu, streamed through a ring of pixel buffers\n"
+              << "\t--bowl: draw a 3d bowl around the car sampling the raw "
+                 "frames, implies --gpu-stitch\n"
+              << "\t--bowl-lod: bowl level of detail, 0 is the finest\n"
+              << "\t--bowl-res: bowl vertices around x rings from the "
+                 "center out (default 128x32)\n"
+              << "\t--source: frames for --gpu-stitch / --stream, same as "
+                 "avm_app (default the images under data_path)\n"
+              << "\t--timing: frame timing dump on F12 / SIGUSR1 and at exit, "
+                 ".json summary or .csv per frame\n"
+              << "\t--headless: no window, render every pose of every frame "
+                 "offscreen into dir (not with --stream)\n"
+              << "\t--poses: camera presets \"1,2,3,4,5\" (default), "
+                 "\"orbit:N\" or a file of \"name x y z yaw pitch [fov]\"\n"
+              << "\t--size: headless image size (default 1280x720)\n"
+              << "\t--frames: source frames to render headless, <= 0 "
+                 "until the source ends (default 1)\n";
     return -1;
   }
-  std::string data_path = std::string(argv[1]);
+  std::string data_path = args[0];
   std::cout << argv[0] << " app start running..." << std::endl;
 
+  if (!trace_path.empty()) {
+    trace_thread_name("render");
+    trace_start();
+  }
+
+  // 无窗口批量渲染, 不进入交互循环
+  if (!headless.output.empty()) {
+    headless.data_path = data_path;
+    headless.source_spec = source_spec;
+    headless.gpu_stitch = gpu_stitch;
+    headless.bowl = bowl;
+    headless.bowl_params = bowl_params;
+    headless.bowl_lod = bowl_lod;
+    const int ret = runHeadless(headless);
+    if (!trace_path.empty()) {
+      trace_stop();
+      if (!trace_write_chrome(trace_path)) {
+        std::cerr << "trace not written, build with -DAVM_ENABLE_TRACE=ON"
+                  << std::endl;
+      }
+    }
+    std::cout << argv[0] << " app finished" << std::endl;
+    return ret;
+  }
+
   // 1. 初始化 GLFW 和 OpenGL
   if (!initializeOpenGL()) {
     return -1;
@@ -66,7 +190,9 @@ int main(int argc, char **argv) {
   // ... (your existing parameter loading code) ...
 
   // 2. 创建和初始化 Renderer
-  g_renderer = std::make_unique<Renderer>(data_path);
+  g_renderer = std::make_unique<Renderer>(data_path, gpu_stitch, bowl);
+  g_renderer->setBowlParams(bowl_params);
+  g_renderer->setBowlLod(bowl_lod);
   if (!g_renderer->init()) { // Renderer::init should load shaders, setup basic
                              // geometry (triangle VAO/VBO)
     std::cerr << "Failed to initialize renderer!" << std::endl;
@@ -74,6 +200,72 @@ int main(int argc, char **argv) {
     return -1;
   }
 
+  // CPU 拼接的流式贴图: 拼接线程直接写进 PBO 映射的内存,
+  // 渲染循环只提交上传
+  std::unique_ptr<ThreadPool> pool;
+  std::unique_ptr<Stitcher> stitcher;
+  StreamingTexture *stream_tex = nullptr;
+  if (stream) {
+    pool = std::make_unique<ThreadPool>();
+    std::shared_ptr<const StitchAssets> assets = load_stitch_assets(data_path);
+    StitcherConfig config;
+    config.name = "stream";
+    config.data_path = data_path;
+    if (assets) {
+      stitcher = std::make_unique<Stitcher>(*pool, assets);
+    }
+    if (!stitcher || !stitcher->load(config) ||
+        !(stream_tex = g_renderer->enableMosaicStream(
+              stitcher->mosaicSize().width, stitcher->mosaicSize().height))) {
+      std::cerr << "Failed to set up mosaic streaming!" << std::endl;
+      g_renderer->cleanup();
+      cleanupGLFW();
+      return -1;
+    }
+  }
+
+  // 帧源, 后台线程解码. GPU 拼接时渲染循环只上传
+  std::unique_ptr<FrameSource> source;
+  if (gpu_stitch || stream) {
+    if (source_spec.empty()) {
+      source_spec = "png:" + data_path + "/images/{cam}.png";
+    }
+    source = create_frame_source(source_spec);
+    if (!source || !source->start()) {
+      g_renderer->cleanup();
+      cleanupGLFW();
+      return -1;
+    }
+  }
+
+  std::atomic<bool> streaming(stream);
+  std::thread producer;
+  if (stream) {
+    producer = std::thread([&] {
+      trace_thread_name("stitch");
+      const cv::Size size = stitcher->mosaicSize();
+      while (streaming) {
+        FrameSet *frames = source->acquire();
+        if (!frames) {
+          break;
+        }
+        // 渲染线程落后时 beginWrite 接管还没上传的旧帧, 只有缓冲都在
+        // 上传中才会等待
+        int slot = -1;
+        uint8_t *data = nullptr;
+        while (streaming && !data) {
+          data = stream_tex->beginWrite(slot);
+        }
+        if (data) {
+          cv::Mat mosaic(size, CV_8UC3, data);
+          stitcher->process(*frames, mosaic);
+          stream_tex->endWrite(slot);
+        }
+        source->release(frames);
+      }
+    });
+  }
+
   // 3. 创建相机和控制器 // <--- NEW
   g_camera = std::make_unique<Camera>(
       glm::vec3(0.0f, 2.0f, 9.0f)); // Initial camera position
@@ -81,13 +273,45 @@ int main(int argc, char **argv) {
   g_cameraController->disableMouseControl(window);
   g_mouseControlActive = false;
 
+  // 每个阶段的 CPU 时间, 有 GL 命令的阶段另计 GPU 时间
+  g_frameTimer = std::make_unique<FrameTimer>();
+  const int phase_input = g_frameTimer->addPhase("input", false);
+  const int phase_upload = g_frameTimer->addPhase("upload", true);
+  const int phase_draw = g_frameTimer->addPhase("draw", true);
+  const int phase_swap = g_frameTimer->addPhase("swap", false);
+  const int phase_events = g_frameTimer->addPhase("events", false);
+  if (!g_frameTimer->init()) {
+    std::cerr << "frame timer: gpu queries unavailable" << std::endl;
+  }
+  if (!timing_path.empty()) {
+    g_timingPath = timing_path;
+  }
+#ifndef _WIN32
+  signal(SIGUSR1, [](int) { g_timingDumpRequested = 1; });
+#endif
+
   // 4. 渲染循环
   while (!glfwWindowShouldClose(window)) {
+    AVM_TRACE_SCOPE("frame");
+    g_frameTimer->beginFrame();
     // a. 处理输入 (Keyboard handled here, mouse handled by callbacks)
-    processInput(window);
+    {
+      FrameTimer::Scope phase(*g_frameTimer, phase_input);
+      processInput(window);
+    }
 
-    // b. 渲染指令
+    // b. 新的一组相机帧交给 GPU 拼接
+    if (source && gpu_stitch) {
+      FrameTimer::Scope phase(*g_frameTimer, phase_upload);
+      if (FrameSet *frames = source->acquire()) {
+        g_renderer->uploadFrames(*frames);
+        source->release(frames);
+      }
+    }
+
+    // c. 渲染指令
     if (g_renderer && g_camera) {
+      FrameTimer::Scope phase(*g_frameTimer, phase_draw);
       // Calculate aspect ratio
       int currentWidth, currentHeight;
       glfwGetFramebufferSize(window, &currentWidth, &currentHeight);
@@ -103,12 +327,53 @@ int main(int argc, char **argv) {
       g_renderer->draw(view, projection); // <--- Pass matrices
     }
 
-    // c. 交换缓冲区和检查事件
-    glfwSwapBuffers(window);
-    glfwPollEvents(); // Processes events, including mouse callbacks
+    // d. 交换缓冲区和检查事件
+    {
+      AVM_TRACE_SCOPE("swap_buffers");
+      FrameTimer::Scope phase(*g_frameTimer, phase_swap);
+      glfwSwapBuffers(window);
+    }
+    {
+      FrameTimer::Scope phase(*g_frameTimer, phase_events);
+      glfwPollEvents(); // Processes events, including mouse callbacks
+    }
+    g_frameTimer->endFrame();
+
+    if (g_timingDumpRequested) {
+      g_timingDumpRequested = 0;
+      g_frameTimer->dump(g_timingPath);
+    }
+  }
+
+  g_frameTimer->printSummary(std::cout);
+  if (!timing_path.empty()) {
+    g_frameTimer->dump(timing_path);
   }
+  g_frameTimer->cleanup();
 
-  // 5. 清理资源
+  if (!trace_path.empty()) {
+    trace_stop();
+    if (!trace_write_chrome(trace_path)) {
+      std::cerr << "trace not written, build with -DAVM_ENABLE_TRACE=ON"
+                << std::endl;
+    }
+  }
+
+  // 5. 清理资源, 拼接线程先退出, 再释放它写入的缓冲
+  streaming = false;
+  if (stream_tex) {
+    stream_tex->stop();
+  }
+  if (source) {
+    source->stop();
+  }
+  if (producer.joinable()) {
+    producer.join();
+    std::cout << "mosaic stream: " << stream_tex->uploaded()
+              << " frames uploaded, " << stream_tex->dropped()
+              << " dropped, stitch "
+              << stitcher->stats().process_ms << " ms/frame" << std::endl;
+  }
   if (g_renderer) {
     g_renderer->cleanup();
   }
@@ -173,6 +438,14 @@ void processInput(GLFWwindow *window) {
   if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     glfwSetWindowShouldClose(window, true);
 
+  // F12: 导出帧时间, 按下的那一帧触发一次
+  static bool dumpKeyPressed = false;
+  const bool dumpKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+  if (dumpKey && !dumpKeyPressed) {
+    g_timingDumpRequested = 1;
+  }
+  dumpKeyPressed = dumpKey;
+
   // Add key (e.g., TAB) to toggle mouse control
   // (This requires tracking key state to avoid rapid toggling)
   // Example: Press M to toggle mouse control
@@ -237,52 +510,8 @@ void setCameraView(int viewIndex) {
   if (!g_camera)
     return;
 
-  const float distance =
-      8.0f; // Distance from the car center (adjust as needed)
-  const float angle45 = glm::radians(45.0f);
-  const float height = distance * glm::sin(angle45);         // Approx 5.65
-  const float horizontalDist = distance * glm::cos(angle45); // Approx 5.65
-  const float sideOffset =
-      distance * glm::cos(angle45) * glm::cos(angle45); // Approx 4.0
-
-  switch (viewIndex) {
-  case 1: // 车正上方俯视
-    g_camera->Position = glm::vec3(0.0f, distance, 0.0f);
-    g_camera->Yaw = -90.0f;
-    g_camera->Pitch = -89.9f; // Almost straight down
-    break;
-  case 2: // 从车头前上方 俯视45度看着自车中心
-    g_camera->Position = glm::vec3(0.0f, height, horizontalDist);
-    g_camera->Yaw = -90.0f;
-    g_camera->Pitch = -45.0f;
-    break;
-  case 3: // 从车尾后上方 俯视45度看着自车中心
-    g_camera->Position = glm::vec3(0.0f, height, -horizontalDist);
-    // Looking from -Z towards origin (+Z direction relative to camera's
-    // forward)
-    g_camera->Yaw = 90.0f; // Adjusted Yaw
-    g_camera->Pitch = -45.0f;
-    break;
-  case 4: // 从左侧后上方 俯视45度看着自车中心
-    g_camera->Position = glm::vec3(-sideOffset, height, -sideOffset);
-    // Looking from -X, -Z towards origin (+X, +Z direction relative to camera's
-    // forward)
-    g_camera->Yaw = 45.0f; // Adjusted Yaw
-    g_camera->Pitch = -45.0f;
-    break;
-  case 5: // 从右侧后上方 俯视45度看着自车中心
-    g_camera->Position = glm::vec3(sideOffset, height, -sideOffset);
-    // Looking from +X, -Z towards origin (-X, +Z direction relative to camera's
-    // forward)
-    g_camera->Yaw = 135.0f; // Adjusted Yaw
-    g_camera->Pitch = -45.0f;
-    break;
-  default:
+  if (!setCameraPreset(*g_camera, viewIndex))
     return; // Ignore other keys
-  }
-
-  // After setting position and angles, update the camera's internal vectors
-  g_camera->updateCameraVectors();
 
   // Optional: Disable mouse control when switching to a fixed view
   // if (g_cameraController && g_mouseControlActive) {
@@ -0,0 +1,311 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "avm_pipeline.h"
+#include "blend_simd.h"
+#include "trace.h"
+#include "yuv_stitch.h"
+
+#define AWB_LUN_BANLANCE_ENALE 1
+
+bool loadAvmData(const std::string &data_path, cv::Mat &car_img,
+                 std::vector<cv::Mat> &merge_weights_img, CameraPrms prms[4]) {
+  // 1. 读取车辆图像
+  car_img = cv::imread(data_path + "/images/car.png");
+  if (car_img.empty()) {
+    std::cerr << "imread car failed\r\n";
+    return false;
+  }
+  cv::resize(car_img, car_img, cv::Size(xr - xl, yb - yt));
+
+  // 2. 读取权重图
+  cv::Mat weights = cv::imread(data_path + "/yaml/weights.png", -1);
+
+  if (weights.channels() != 4) {
+    std::cerr << "imread weights failed " << weights.channels() << "\r\n";
+    return false;
+  }
+
+  // 3. 处理权重图: 保持 8 位定点权重, 供 simd 融合直接使用
+  if (!load_blend_weights(weights, merge_weights_img)) {
+    return false;
+  }
+
+  // 4. 读取相机参数
+  return loadAvmCalibration(data_path, prms);
+}
+
+bool loadAvmCalibration(const std::string &data_path, CameraPrms prms[4]) {
+  for (int i = 0; i < 4; ++i) {
+    auto &prm = prms[i];
+    prm.name = camera_names[i];
+    auto ok = read_prms(data_path + "/yaml/" + prm.name + ".yaml", prm);
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool loadAvmBundle(const std::string &data_path, RigBundle &bundle,
+                   cv::Mat &car_img, std::vector<cv::Mat> &merge_weights_img,
+                   CameraPrms prms[4], StitchLut &lut) {
+  AVM_TRACE_SCOPE("loadAvmBundle");
+  const std::string path = rig_bundle_path(data_path);
+  const uint64_t checksum = rig_source_checksum(data_path);
+
+  // 校验和不一致 (标定或资源已修改) 时重新生成,
+  // 源文件不在时 (只部署了标定包) 直接使用标定包
+  if (!bundle.open(path, checksum) && checksum != 0) {
+    std::cout << "rig bundle missing or stale, rebuilding " << path
+              << std::endl;
+    if (write_rig_bundle(path, data_path)) {
+      bundle.open(path, checksum);
+    }
+  }
+  if (bundle.isOpen() && bundle.cameraPrms(prms) && bundle.stitchLut(lut) &&
+      bundle.blendWeights(merge_weights_img) && bundle.carImage(car_img)) {
+    return true;
+  }
+
+  // 回退: 逐个解析 yaml 和 png
+  std::cerr << "rig bundle unusable, loading " << data_path << "\r\n";
+  bundle.close();
+  return loadAvmData(data_path, car_img, merge_weights_img, prms) &&
+         updateStitchLut(prms, default_view, lut);
+}
+
+bool loadAvmCalibrationBundle(const std::string &data_path,
+                              RigBundle &bundle, CameraPrms prms[4],
+                              StitchLut &lut) {
+  AVM_TRACE_SCOPE("loadAvmCalibrationBundle");
+  const std::string path = rig_calibration_bundle_path(data_path);
+  const uint64_t checksum = rig_calibration_checksum(data_path);
+
+  // 与 loadAvmBundle 相同, 只是不读也不校验 car.png 和 weights.png
+  if (!bundle.open(path, checksum) && checksum != 0) {
+    std::cout << "rig calibration bundle missing or stale, rebuilding "
+              << path << std::endl;
+    if (write_rig_calibration_bundle(path, data_path)) {
+      bundle.open(path, checksum);
+    }
+  }
+  if (bundle.isOpen() && bundle.cameraPrms(prms) && bundle.stitchLut(lut)) {
+    return true;
+  }
+
+  std::cerr << "rig calibration bundle unusable, loading " << data_path
+            << "\r\n";
+  bundle.close();
+  return loadAvmCalibration(data_path, prms) &&
+         updateStitchLut(prms, default_view, lut);
+}
+
+cv::Mat calculateViewMatrix(const cv::Mat &baseMatrix,
+                            const ViewpointParams &viewParams) {
+  // 确保使用float类型
+  cv::Mat viewMatrix;
+  baseMatrix.convertTo(viewMatrix, CV_32F);
+
+  // 根据角度调整
+  float angleRad = viewParams.angle * CV_PI / 180.0;
+  cv::Mat rotMat = cv::Mat::eye(3, 3, CV_32F);
+  rotMat.at<float>(0, 0) = cos(angleRad);
+  rotMat.at<float>(0, 1) = -sin(angleRad);
+  rotMat.at<float>(1, 0) = sin(angleRad);
+  rotMat.at<float>(1, 1) = cos(angleRad);
+
+  // 应用变换
+  viewMatrix = rotMat * viewMatrix;
+
+  // 应用缩放
+  viewMatrix *= viewParams.zoom;
+
+  return viewMatrix;
+}
+
+bool updateStitchLut(CameraPrms prms[4], const ViewpointParams &viewParams,
+                     StitchLut &lut, double scale, const RigLayout &layout) {
+  AVM_TRACE_SCOPE("updateStitchLut");
+  cv::Mat view_matrix[4];
+  for (int i = 0; i < 4; ++i) {
+    view_matrix[i] = calculateViewMatrix(prms[i].project_matrix, viewParams);
+  }
+  return build_stitch_lut(prms, view_matrix, lut, scale, layout);
+}
+
+bool makeStitchLevel(CameraPrms prms[4], const ViewpointParams &viewParams,
+                     double scale, const cv::Mat &car_img,
+                     const std::vector<cv::Mat> &merge_weights_img,
+                     StitchLevel &level) {
+  level.scale = scale;
+  if (!updateStitchLut(prms, viewParams, level.lut, scale)) {
+    return false;
+  }
+  scale_stitch_assets(level.lut, car_img, merge_weights_img, level.car_img,
+                      level.merge_weights_img);
+  level.scratch.car_nv12.release();
+  return true;
+}
+
+// 查表拼接和角融合, 增益已经算好
+static void stitchBgr(std::vector<cv::Mat *> &srcs, const GainLut *gains,
+                      cv::Mat &car_img,
+                      std::vector<cv::Mat> &merge_weights_img,
+                      const StitchLut &lut, StitchScratch &scratch,
+                      ThreadPool &pool, cv::Mat &out_put_img,
+                      StageTimes &times) {
+  const double ms = 1000.0 / cv::getTickFrequency();
+
+  // 2.查表拼接: 去畸变、投影、旋转和放置一次完成, 直接从原始鱼眼图采样
+  int64 t1 = cv::getTickCount();
+  stitch_prepare(lut, car_img, out_put_img);
+  pool.parallelFor(4, [&](int i) {
+    stitch_body(srcs, lut, i, out_put_img, scratch.options.remap, gains);
+  });
+  int64 t2 = cv::getTickCount();
+
+  // 3.四个重叠角并行融合
+  pool.parallelFor(4, [&](int i) {
+    stitch_corner(srcs, lut, i, merge_weights_img, out_put_img, scratch,
+                  gains);
+  });
+  int64 t3 = cv::getTickCount();
+
+  times.body = (t2 - t1) * ms;
+  times.corner = (t3 - t2) * ms;
+}
+
+// 处理一帧图像的函数
+cv::Mat processFrame(FrameSet &frames, cv::Mat &car_img,
+                     std::vector<cv::Mat> &merge_weights_img,
+                     const StitchLut &lut, StitchScratch &scratch,
+                     ThreadPool &pool, int awb_step, StageTimes &times) {
+  cv::Mat out_put_img;
+  processFrame(frames, car_img, merge_weights_img, lut, scratch, pool,
+               awb_step, out_put_img, times);
+  return out_put_img;
+}
+
+void processFrame(FrameSet &frames, cv::Mat &car_img,
+                  std::vector<cv::Mat> &merge_weights_img,
+                  const StitchLut &lut, StitchScratch &scratch,
+                  ThreadPool &pool, int awb_step, cv::Mat &out_put_img,
+                  StageTimes &times) {
+  if (frames.format != PIX_BGR) {
+    processFrameNv12(frames, car_img, merge_weights_img, lut, scratch, pool,
+                     awb_step, scratch.mosaic_nv12, times);
+    nv12_to_bgr(scratch.mosaic_nv12, out_put_img);
+    return;
+  }
+
+  AVM_TRACE_SCOPE("processFrame");
+  const double ms = 1000.0 / cv::getTickFrequency();
+
+  // 1.亮度均衡和自动白平衡: 稀疏网格统计, 增益做成查找表,
+  //   在查表采样写出时顺带完成, 不再整帧改写源图
+  std::vector<cv::Mat *> srcs;
+  for (int i = 0; i < 4; ++i) {
+    srcs.push_back(&frames.img[i]);
+  }
+
+  int64 t0 = cv::getTickCount();
+  GainLut gain_luts[4];
+  const GainLut *gains = nullptr;
+#if AWB_LUN_BANLANCE_ENALE
+  awb_gain_luts(srcs, gain_luts, awb_step, &pool);
+  gains = gain_luts;
+#endif
+  int64 t1 = cv::getTickCount();
+  times.balance = (t1 - t0) * ms;
+
+  stitchBgr(srcs, gains, car_img, merge_weights_img, lut, scratch, pool,
+            out_put_img, times);
+}
+
+void processFrameLevels(FrameSet &frames, std::vector<StitchLevel> &levels,
+                        ThreadPool &pool, int awb_step) {
+  AVM_TRACE_SCOPE("processFrameLevels");
+  if (frames.format != PIX_BGR) {
+    // yuv 增益很便宜, 每层各自计算
+    for (auto &level : levels) {
+      processFrame(frames, level.car_img, level.merge_weights_img,
+                   level.lut, level.scratch, pool, awb_step, level.mosaic,
+                   level.times);
+    }
+    return;
+  }
+
+  const double ms = 1000.0 / cv::getTickFrequency();
+  std::vector<cv::Mat *> srcs;
+  for (int i = 0; i < 4; ++i) {
+    srcs.push_back(&frames.img[i]);
+  }
+
+  // 增益只与源图有关, 所有输出层共用一次统计
+  int64 t0 = cv::getTickCount();
+  GainLut gain_luts[4];
+  const GainLut *gains = nullptr;
+#if AWB_LUN_BANLANCE_ENALE
+  awb_gain_luts(srcs, gain_luts, awb_step, &pool);
+  gains = gain_luts;
+#endif
+  const double balance = (cv::getTickCount() - t0) * ms;
+
+  for (auto &level : levels) {
+    level.times.balance = balance;
+    stitchBgr(srcs, gains, level.car_img, level.merge_weights_img,
+              level.lut, level.scratch, pool, level.mosaic, level.times);
+  }
+}
+
+void processFrameNv12(FrameSet &frames, cv::Mat &car_img,
+                      std::vector<cv::Mat> &merge_weights_img,
+                      const StitchLut &lut, StitchScratch &scratch,
+                      ThreadPool &pool, int awb_step, cv::Mat &out_nv12,
+                      StageTimes &times) {
+  AVM_TRACE_SCOPE("processFrameNv12");
+  const double ms = 1000.0 / cv::getTickFrequency();
+  const PixelFormat format = frames.format;
+
+  std::vector<cv::Mat *> srcs;
+  for (int i = 0; i < 4; ++i) {
+    srcs.push_back(&frames.img[i]);
+  }
+  // 车辆图像只转换一次
+  if (scratch.car_nv12.empty()) {
+    bgr_to_nv12(car_img, scratch.car_nv12);
+  }
+
+  // 1.亮度均衡和白平衡在 yuv 域完成: 亮度缩放, 色度平移
+  int64 t0 = cv::getTickCount();
+  YuvGainLut gain_luts[4];
+  const YuvGainLut *gains = nullptr;
+#if AWB_LUN_BANLANCE_ENALE
+  yuv_gain_luts(srcs, format, gain_luts, awb_step, &pool);
+  gains = gain_luts;
+#endif
+  int64 t1 = cv::getTickCount();
+
+  // 2.查表拼接, 亮度逐像素, 色度每 2x2 采样一次
+  stitch_prepare_nv12(lut, scratch.car_nv12, out_nv12);
+  pool.parallelFor(4, [&](int i) {
+    stitch_body_yuv(srcs, format, lut, i, out_nv12, gains);
+  });
+  int64 t2 = cv::getTickCount();
+
+  // 3.四个重叠角并行融合
+  pool.parallelFor(4, [&](int i) {
+    stitch_corner_yuv(srcs, format, lut, i, merge_weights_img, out_nv12,
+                      scratch, gains);
+  });
+  int64 t3 = cv::getTickCount();
+
+  times.balance = (t1 - t0) * ms;
+  times.body = (t2 - t1) * ms;
+  times.corner = (t3 - t2) * ms;
+}
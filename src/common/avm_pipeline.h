@@ -0,0 +1,112 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef AVM_PIPELINE_H
+#define AVM_PIPELINE_H
+
+#include "common.h"
+#include "frame_source.h"
+#include "rig_bundle.h"
+#include "stitch_lut.h"
+#include "thread_pool.h"
+
+// per frame 2d stitching shared by the demo, the bench and the batch tools
+
+// view control
+struct ViewpointParams {
+  float height; // view height (0.0-1.0)
+  float angle;  // rotation around the car (0-360 deg)
+  float tilt;   // tilt (-30 to 30 deg)
+  float zoom;   // zoom (0.5-2.0)
+};
+
+// top view the apps start with, the rig bundle carries its lut
+const ViewpointParams default_view = {1.0f, 0.0f, 0.0f, 1.0f};
+
+// stage times of one frame in ms
+struct StageTimes {
+  double balance; // sparse statics + gain tables
+  double body;    // four single camera regions, in parallel
+  double corner;  // four overlap corners, in parallel
+};
+
+// car image (resized to the car rect), 8-bit blend weight planes and the
+// four calibrations under data_path
+bool loadAvmData(const std::string &data_path, cv::Mat &car_img,
+                 std::vector<cv::Mat> &merge_weights_img, CameraPrms prms[4]);
+// the four calibrations only
+bool loadAvmCalibration(const std::string &data_path, CameraPrms prms[4]);
+
+// same through the rig bundle under data_path/cache: the mats point into
+// the mapping of bundle and lut gets the default view lut. a missing or
+// stale bundle is rebuilt from the source files, if that fails too the
+// data is loaded by loadAvmData and the lut built here. without the
+// source files the bundle is used as is
+bool loadAvmBundle(const std::string &data_path, RigBundle &bundle,
+                   cv::Mat &car_img, std::vector<cv::Mat> &merge_weights_img,
+                   CameraPrms prms[4], StitchLut &lut);
+
+// calibration and default view lut through the calibration bundle, for a
+// rig whose car image and weights come from shared assets. the pngs under
+// data_path are neither required nor read
+bool loadAvmCalibrationBundle(const std::string &data_path,
+                              RigBundle &bundle, CameraPrms prms[4],
+                              StitchLut &lut);
+
+// project matrix of one camera for the given view
+cv::Mat calculateViewMatrix(const cv::Mat &baseMatrix,
+                            const ViewpointParams &viewParams);
+
+// rebuild the stitch lut when the view changes, scale < 1 for a smaller
+// mosaic sampled straight from the frames
+bool updateStitchLut(CameraPrms prms[4], const ViewpointParams &viewParams,
+                     StitchLut &lut, double scale = 1.0,
+                     const RigLayout &layout = default_rig_layout());
+
+// white balance + lut stitching of one frame set into a new mosaic
+cv::Mat processFrame(FrameSet &frames, cv::Mat &car_img,
+                     std::vector<cv::Mat> &merge_weights_img,
+                     const StitchLut &lut, StitchScratch &scratch,
+                     ThreadPool &pool, int awb_step, StageTimes &times);
+// same, reusing the buffer of out_put_img when it already has the size.
+// nv12 / yuyv frames are stitched in yuv and the mosaic converted once
+void processFrame(FrameSet &frames, cv::Mat &car_img,
+                  std::vector<cv::Mat> &merge_weights_img,
+                  const StitchLut &lut, StitchScratch &scratch,
+                  ThreadPool &pool, int awb_step, cv::Mat &out_put_img,
+                  StageTimes &times);
+// nv12 / yuyv frames into an nv12 mosaic, ready for an encoder
+void processFrameNv12(FrameSet &frames, cv::Mat &car_img,
+                      std::vector<cv::Mat> &merge_weights_img,
+                      const StitchLut &lut, StitchScratch &scratch,
+                      ThreadPool &pool, int awb_step, cv::Mat &out_nv12,
+                      StageTimes &times);
+
+// one output resolution of a frame set: its own lut, assets and buffers
+struct StitchLevel {
+  double scale;
+  StitchLut lut;
+  cv::Mat car_img;
+  std::vector<cv::Mat> merge_weights_img;
+  StitchScratch scratch;
+  cv::Mat mosaic;
+  StageTimes times;
+};
+
+// lut of view at scale plus the car and weights resized to it
+bool makeStitchLevel(CameraPrms prms[4], const ViewpointParams &viewParams,
+                     double scale, const cv::Mat &car_img,
+                     const std::vector<cv::Mat> &merge_weights_img,
+                     StitchLevel &level);
+
+// every level stitched from the same frames into its own mosaic. bgr
+// frames are balanced once for all levels, instead of stitching full size
+// and downscaling the smaller levels are sampled directly
+void processFrameLevels(FrameSet &frames, std::vector<StitchLevel> &levels,
+                        ThreadPool &pool, int awb_step);
+
+#endif
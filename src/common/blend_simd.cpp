@@ -0,0 +1,474 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "blend_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLEND_HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BLEND_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// t = a * w + b * (255 - w) + 128 <= 65153, so every step fits in u16
+// and (t + (t >> 8)) >> 8 is the exact rounded division by 255
+static inline uint8_t blend_px(uint8_t a, uint8_t b, uint8_t w) {
+  uint32_t t = a * w + b * (255 - w) + 128;
+  return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+void blend_row_ref(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+                   uint8_t *o, int n) {
+  for (int i = 0; i < n; ++i) {
+    o[i] = blend_px(a[i], b[i], w[i]);
+  }
+}
+
+#if BLEND_HAVE_X86
+__attribute__((target("sse4.1"))) static inline __m128i
+blend_u16_sse(__m128i a, __m128i b, __m128i w) {
+  const __m128i k255 = _mm_set1_epi16(255);
+  const __m128i k128 = _mm_set1_epi16(128);
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, w),
+                            _mm_mullo_epi16(b, _mm_sub_epi16(k255, w)));
+  t = _mm_add_epi16(t, k128);
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse4.1"))) static inline __m128i
+blend_u8_sse(__m128i a, __m128i b, __m128i w) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = blend_u16_sse(_mm_cvtepu8_epi16(a), _mm_cvtepu8_epi16(b),
+                             _mm_cvtepu8_epi16(w));
+  __m128i hi =
+      blend_u16_sse(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero),
+                    _mm_unpackhi_epi8(w, zero));
+  return _mm_packus_epi16(lo, hi);
+}
+
+// 32 bytes per iteration
+__attribute__((target("sse4.1"))) static void
+blend_row_sse41(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+                uint8_t *o, int n) {
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m128i a0 = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(a + i + 16));
+    __m128i b0 = _mm_loadu_si128((const __m128i *)(b + i));
+    __m128i b1 = _mm_loadu_si128((const __m128i *)(b + i + 16));
+    __m128i w0 = _mm_loadu_si128((const __m128i *)(w + i));
+    __m128i w1 = _mm_loadu_si128((const __m128i *)(w + i + 16));
+    _mm_storeu_si128((__m128i *)(o + i), blend_u8_sse(a0, b0, w0));
+    _mm_storeu_si128((__m128i *)(o + i + 16), blend_u8_sse(a1, b1, w1));
+  }
+  blend_row_ref(a + i, b + i, w + i, o + i, n - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+blend_u16_avx2(__m256i a, __m256i b, __m256i w) {
+  const __m256i k255 = _mm256_set1_epi16(255);
+  const __m256i k128 = _mm256_set1_epi16(128);
+  __m256i t = _mm256_add_epi16(
+      _mm256_mullo_epi16(a, w),
+      _mm256_mullo_epi16(b, _mm256_sub_epi16(k255, w)));
+  t = _mm256_add_epi16(t, k128);
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// 32 bytes per iteration, unpack/pack work per 128 bit lane so the byte
+// order is preserved
+__attribute__((target("avx2"))) static void
+blend_row_avx2(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+               uint8_t *o, int n) {
+  const __m256i zero = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    __m256i vw = _mm256_loadu_si256((const __m256i *)(w + i));
+    __m256i lo = blend_u16_avx2(_mm256_unpacklo_epi8(va, zero),
+                                _mm256_unpacklo_epi8(vb, zero),
+                                _mm256_unpacklo_epi8(vw, zero));
+    __m256i hi = blend_u16_avx2(_mm256_unpackhi_epi8(va, zero),
+                                _mm256_unpackhi_epi8(vb, zero),
+                                _mm256_unpackhi_epi8(vw, zero));
+    _mm256_storeu_si256((__m256i *)(o + i), _mm256_packus_epi16(lo, hi));
+  }
+  blend_row_ref(a + i, b + i, w + i, o + i, n - i);
+}
+#endif
+
+#if BLEND_HAVE_NEON
+static inline uint8x8_t blend_u8x8_neon(uint8x8_t a, uint8x8_t b,
+                                        uint8x8_t w) {
+  uint16x8_t t = vmull_u8(a, w);
+  t = vmlal_u8(t, b, vmvn_u8(w)); // 255 - w == ~w
+  t = vaddq_u16(t, vdupq_n_u16(128));
+  return vshrn_n_u16(vsraq_n_u16(t, t, 8), 8);
+}
+
+// 32 bytes per iteration
+static void blend_row_neon(const uint8_t *a, const uint8_t *b,
+                           const uint8_t *w, uint8_t *o, int n) {
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    for (int k = 0; k < 32; k += 16) {
+      uint8x16_t va = vld1q_u8(a + i + k);
+      uint8x16_t vb = vld1q_u8(b + i + k);
+      uint8x16_t vw = vld1q_u8(w + i + k);
+      uint8x8_t lo = blend_u8x8_neon(vget_low_u8(va), vget_low_u8(vb),
+                                     vget_low_u8(vw));
+      uint8x8_t hi = blend_u8x8_neon(vget_high_u8(va), vget_high_u8(vb),
+                                     vget_high_u8(vw));
+      vst1q_u8(o + i + k, vcombine_u8(lo, hi));
+    }
+  }
+  blend_row_ref(a + i, b + i, w + i, o + i, n - i);
+}
+#endif
+
+// bgr rows blended with one weight per pixel (compact planes)
+static void blend_row_c1_ref(const uint8_t *a, const uint8_t *b,
+                             const uint8_t *w, uint8_t *o, int pixels) {
+  for (int i = 0; i < pixels; ++i, a += 3, b += 3, o += 3) {
+    o[0] = blend_px(a[0], b[0], w[i]);
+    o[1] = blend_px(a[1], b[1], w[i]);
+    o[2] = blend_px(a[2], b[2], w[i]);
+  }
+}
+
+#if BLEND_HAVE_X86
+// byte i of a 48 byte (16 pixel) chunk takes weight i / 3
+alignas(16) static const uint8_t c1_spread[3][16] = {
+    {0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5},
+    {5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10},
+    {10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15}};
+
+__attribute__((target("sse4.1"))) static inline void
+spread_c1_sse(const uint8_t *w, __m128i out[3]) {
+  __m128i vw = _mm_loadu_si128((const __m128i *)w);
+  for (int k = 0; k < 3; ++k) {
+    out[k] = _mm_shuffle_epi8(
+        vw, _mm_load_si128((const __m128i *)c1_spread[k]));
+  }
+}
+
+// 16 pixels per iteration
+__attribute__((target("sse4.1"))) static void
+blend_row_c1_sse41(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+                   uint8_t *o, int pixels) {
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16) {
+    __m128i vw[3];
+    spread_c1_sse(w + i, vw);
+    for (int k = 0; k < 3; ++k) {
+      const int off = 3 * i + 16 * k;
+      __m128i va = _mm_loadu_si128((const __m128i *)(a + off));
+      __m128i vb = _mm_loadu_si128((const __m128i *)(b + off));
+      _mm_storeu_si128((__m128i *)(o + off), blend_u8_sse(va, vb, vw[k]));
+    }
+  }
+  blend_row_c1_ref(a + 3 * i, b + 3 * i, w + i, o + 3 * i, pixels - i);
+}
+
+// 32 pixels (96 bytes) per iteration, the weights are spread per 16 pixels
+// and paired into 256 bit vectors
+__attribute__((target("avx2"))) static void
+blend_row_c1_avx2(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+                  uint8_t *o, int pixels) {
+  const __m256i zero = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 32 <= pixels; i += 32) {
+    __m128i s[6];
+    spread_c1_sse(w + i, s);
+    spread_c1_sse(w + i + 16, s + 3);
+    for (int k = 0; k < 3; ++k) {
+      const int off = 3 * i + 32 * k;
+      __m256i vw = _mm256_inserti128_si256(_mm256_castsi128_si256(s[2 * k]),
+                                           s[2 * k + 1], 1);
+      __m256i va = _mm256_loadu_si256((const __m256i *)(a + off));
+      __m256i vb = _mm256_loadu_si256((const __m256i *)(b + off));
+      __m256i lo = blend_u16_avx2(_mm256_unpacklo_epi8(va, zero),
+                                  _mm256_unpacklo_epi8(vb, zero),
+                                  _mm256_unpacklo_epi8(vw, zero));
+      __m256i hi = blend_u16_avx2(_mm256_unpackhi_epi8(va, zero),
+                                  _mm256_unpackhi_epi8(vb, zero),
+                                  _mm256_unpackhi_epi8(vw, zero));
+      _mm256_storeu_si256((__m256i *)(o + off), _mm256_packus_epi16(lo, hi));
+    }
+  }
+  blend_row_c1_ref(a + 3 * i, b + 3 * i, w + i, o + 3 * i, pixels - i);
+}
+#endif
+
+#if BLEND_HAVE_NEON
+// 16 pixels per iteration, vld3 deinterleaves so every channel takes the
+// weights as they are
+static void blend_row_c1_neon(const uint8_t *a, const uint8_t *b,
+                              const uint8_t *w, uint8_t *o, int pixels) {
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16) {
+    uint8x16x3_t va = vld3q_u8(a + 3 * i);
+    uint8x16x3_t vb = vld3q_u8(b + 3 * i);
+    uint8x16_t vw = vld1q_u8(w + i);
+    uint8x16x3_t vo;
+    for (int c = 0; c < 3; ++c) {
+      uint8x8_t lo = blend_u8x8_neon(vget_low_u8(va.val[c]),
+                                     vget_low_u8(vb.val[c]), vget_low_u8(vw));
+      uint8x8_t hi =
+          blend_u8x8_neon(vget_high_u8(va.val[c]), vget_high_u8(vb.val[c]),
+                          vget_high_u8(vw));
+      vo.val[c] = vcombine_u8(lo, hi);
+    }
+    vst3q_u8(o + 3 * i, vo);
+  }
+  blend_row_c1_ref(a + 3 * i, b + 3 * i, w + i, o + 3 * i, pixels - i);
+}
+#endif
+
+// byte i of a 48 byte (16 pixel) chunk belongs to channel i % 3
+struct ChannelMask {
+  alignas(16) uint8_t m[3][48];
+  ChannelMask() {
+    for (int c = 0; c < 3; ++c) {
+      for (int i = 0; i < 48; ++i) {
+        m[c][i] = (i % 3 == c) ? 0xff : 0;
+      }
+    }
+  }
+};
+static const ChannelMask channel_mask;
+
+static void bgr_row_sum_ref(const uint8_t *p, int pixels, uint64_t sum[3]) {
+  uint32_t b = 0, g = 0, r = 0;
+  for (int i = 0; i < pixels; ++i, p += 3) {
+    b += p[0];
+    g += p[1];
+    r += p[2];
+  }
+  sum[0] += b;
+  sum[1] += g;
+  sum[2] += r;
+}
+
+#if BLEND_HAVE_X86
+// mask each channel out of the 48 byte chunk and let psadbw add the bytes
+__attribute__((target("sse4.1"))) static void
+bgr_row_sum_sse41(const uint8_t *p, int pixels, uint64_t sum[3]) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc[3] = {zero, zero, zero};
+  __m128i mask[3][3];
+  for (int c = 0; c < 3; ++c) {
+    for (int k = 0; k < 3; ++k) {
+      mask[c][k] =
+          _mm_load_si128((const __m128i *)(channel_mask.m[c] + 16 * k));
+    }
+  }
+
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16, p += 48) {
+    __m128i v[3] = {_mm_loadu_si128((const __m128i *)p),
+                    _mm_loadu_si128((const __m128i *)(p + 16)),
+                    _mm_loadu_si128((const __m128i *)(p + 32))};
+    for (int c = 0; c < 3; ++c) {
+      for (int k = 0; k < 3; ++k) {
+        acc[c] = _mm_add_epi64(
+            acc[c], _mm_sad_epu8(_mm_and_si128(v[k], mask[c][k]), zero));
+      }
+    }
+  }
+  for (int c = 0; c < 3; ++c) {
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128((__m128i *)lanes, acc[c]);
+    sum[c] += lanes[0] + lanes[1];
+  }
+  bgr_row_sum_ref(p, pixels - i, sum);
+}
+#endif
+
+#if BLEND_HAVE_NEON
+static void bgr_row_sum_neon(const uint8_t *p, int pixels, uint64_t sum[3]) {
+  // vld3 deinterleaves the channels directly
+  uint32x4_t acc[3] = {vdupq_n_u32(0), vdupq_n_u32(0), vdupq_n_u32(0)};
+  int i = 0;
+  for (; i + 16 <= pixels; i += 16, p += 48) {
+    uint8x16x3_t v = vld3q_u8(p);
+    for (int c = 0; c < 3; ++c) {
+      acc[c] = vpadalq_u16(acc[c], vpaddlq_u8(v.val[c]));
+    }
+  }
+  for (int c = 0; c < 3; ++c) {
+    uint32_t lanes[4];
+    vst1q_u32(lanes, acc[c]);
+    sum[c] += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  bgr_row_sum_ref(p, pixels - i, sum);
+}
+#endif
+
+void bgr_row_sum(const uint8_t *p, int pixels, uint64_t sum[3], BlendIsa isa) {
+  switch (isa) {
+#if BLEND_HAVE_X86
+  case BLEND_ISA_SSE41:
+  case BLEND_ISA_AVX2:
+    bgr_row_sum_sse41(p, pixels, sum);
+    return;
+#endif
+#if BLEND_HAVE_NEON
+  case BLEND_ISA_NEON:
+    bgr_row_sum_neon(p, pixels, sum);
+    return;
+#endif
+  default:
+    bgr_row_sum_ref(p, pixels, sum);
+    return;
+  }
+}
+
+bool blend_isa_supported(BlendIsa isa) {
+  switch (isa) {
+  case BLEND_ISA_SCALAR:
+    return true;
+#if BLEND_HAVE_X86
+  case BLEND_ISA_SSE41:
+    return __builtin_cpu_supports("sse4.1");
+  case BLEND_ISA_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+#if BLEND_HAVE_NEON
+  case BLEND_ISA_NEON:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+BlendIsa blend_best_isa() {
+  static const BlendIsa best = [] {
+    const BlendIsa order[] = {BLEND_ISA_AVX2, BLEND_ISA_NEON, BLEND_ISA_SSE41};
+    for (BlendIsa isa : order) {
+      if (blend_isa_supported(isa)) {
+        return isa;
+      }
+    }
+    return BLEND_ISA_SCALAR;
+  }();
+  return best;
+}
+
+const char *blend_isa_name(BlendIsa isa) {
+  switch (isa) {
+  case BLEND_ISA_SSE41:
+    return "sse4.1";
+  case BLEND_ISA_AVX2:
+    return "avx2";
+  case BLEND_ISA_NEON:
+    return "neon";
+  default:
+    return "scalar";
+  }
+}
+
+void blend_row(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+               uint8_t *o, int n, BlendIsa isa) {
+  switch (isa) {
+#if BLEND_HAVE_X86
+  case BLEND_ISA_SSE41:
+    blend_row_sse41(a, b, w, o, n);
+    return;
+  case BLEND_ISA_AVX2:
+    blend_row_avx2(a, b, w, o, n);
+    return;
+#endif
+#if BLEND_HAVE_NEON
+  case BLEND_ISA_NEON:
+    blend_row_neon(a, b, w, o, n);
+    return;
+#endif
+  default:
+    blend_row_ref(a, b, w, o, n);
+    return;
+  }
+}
+
+void blend_row_c1(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+                  uint8_t *o, int pixels, BlendIsa isa) {
+  switch (isa) {
+#if BLEND_HAVE_X86
+  case BLEND_ISA_SSE41:
+    blend_row_c1_sse41(a, b, w, o, pixels);
+    return;
+  case BLEND_ISA_AVX2:
+    blend_row_c1_avx2(a, b, w, o, pixels);
+    return;
+#endif
+#if BLEND_HAVE_NEON
+  case BLEND_ISA_NEON:
+    blend_row_c1_neon(a, b, w, o, pixels);
+    return;
+#endif
+  default:
+    blend_row_c1_ref(a, b, w, o, pixels);
+    return;
+  }
+}
+
+bool load_blend_weights(const cv::Mat &weights, std::vector<cv::Mat> &out) {
+  if (weights.empty() || weights.depth() != CV_8U || weights.channels() != 4) {
+    return false;
+  }
+
+  // rows padded to 64 bytes so every row starts on a cache line
+  const int stride = (weights.cols + 63) & ~63;
+  out.resize(4);
+  for (int i = 0; i < 4; ++i) {
+    cv::Mat plane(weights.rows, stride, CV_8UC1, cv::Scalar(0));
+    out[i] = plane.colRange(0, weights.cols);
+    cv::extractChannel(weights, out[i], i);
+  }
+  return true;
+}
+
+bool load_blend_weights_c3(const cv::Mat &weights, std::vector<cv::Mat> &out) {
+  if (weights.empty() || weights.depth() != CV_8U || weights.channels() != 4) {
+    return false;
+  }
+
+  std::vector<cv::Mat> planes;
+  cv::split(weights, planes);
+
+  out.resize(4);
+  for (int i = 0; i < 4; ++i) {
+    cv::merge(std::vector<cv::Mat>{planes[i], planes[i], planes[i]}, out[i]);
+  }
+  return true;
+}
+
+void blend_image(const cv::Mat &src1, const cv::Mat &src2, const cv::Mat &w,
+                 cv::Mat out, BlendIsa isa) {
+  if (src1.size() != src2.size() || src1.type() != CV_8UC3 ||
+      src2.type() != CV_8UC3 ||
+      (w.type() != CV_8UC1 && w.type() != CV_8UC3) || w.rows < src1.rows ||
+      w.cols < src1.cols) {
+    return;
+  }
+
+  if (w.type() == CV_8UC1) {
+    for (int h = 0; h < src1.rows; ++h) {
+      blend_row_c1(src1.ptr(h), src2.ptr(h), w.ptr(h), out.ptr(h), src1.cols,
+                   isa);
+    }
+    return;
+  }
+
+  const int n = src1.cols * 3;
+  for (int h = 0; h < src1.rows; ++h) {
+    blend_row(src1.ptr(h), src2.ptr(h), w.ptr(h), out.ptr(h), n, isa);
+  }
+}
@@ -0,0 +1,57 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef BLEND_SIMD_H
+#define BLEND_SIMD_H
+
+#include "common.h"
+#include <cstdint>
+
+// fixed point overlap blending
+//   o = round((a * w + b * (255 - w)) / 255), w in [0, 255]
+// every simd path is bit-exact with blend_row_ref
+
+enum BlendIsa {
+  BLEND_ISA_SCALAR = 0,
+  BLEND_ISA_SSE41,
+  BLEND_ISA_AVX2,
+  BLEND_ISA_NEON,
+};
+
+// best path supported by the running cpu
+BlendIsa blend_best_isa();
+const char *blend_isa_name(BlendIsa isa);
+bool blend_isa_supported(BlendIsa isa);
+
+// blend n bytes, w holds one weight per byte
+void blend_row_ref(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+                   uint8_t *o, int n);
+void blend_row(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+               uint8_t *o, int n, BlendIsa isa = blend_best_isa());
+
+// blend pixels of bgr bytes, w holds one weight per pixel
+void blend_row_c1(const uint8_t *a, const uint8_t *b, const uint8_t *w,
+                  uint8_t *o, int pixels, BlendIsa isa = blend_best_isa());
+
+// per channel sums of a row of bgr pixels, added onto sum[3] (b, g, r).
+// used by the gray world statics, same isa dispatch as the blender
+void bgr_row_sum(const uint8_t *p, int pixels, uint64_t sum[3],
+                 BlendIsa isa = blend_best_isa());
+
+// split the 4 channel weights.png into four corner sized CV_8UC1 planes,
+// one weight per pixel, rows 64 byte aligned. the blend kernels spread the
+// weight over b, g, r in registers
+bool load_blend_weights(const cv::Mat &weights, std::vector<cv::Mat> &out);
+// the previous layout, CV_8UC3 planes with the weight repeated per channel
+bool load_blend_weights_c3(const cv::Mat &weights, std::vector<cv::Mat> &out);
+
+// CV_8UC3 blend of two corner images with CV_8UC1 (compact) or CV_8UC3
+// 8-bit weights
+void blend_image(const cv::Mat &src1, const cv::Mat &src2, const cv::Mat &w,
+                 cv::Mat out, BlendIsa isa = blend_best_isa());
+
+#endif
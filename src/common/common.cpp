@@ -6,6 +6,10 @@
  */
 
 #include "common.h"
+#include "blend_simd.h"
+#include "map_cache.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include <iostream>
 
 void display_mat(cv::Mat &img, std::string name) {
@@ -51,17 +55,17 @@ bool save_prms(const std::string &path, CameraPrms &prms) {
   return true;
 }
 
-// undist image by remap
-void undist_by_remap(const cv::Mat &src, cv::Mat &dst, const CameraPrms &prms) {
-  // get new camera matrix
-  cv::Mat new_camera_matrix = prms.camera_matrix.clone();
+// camera matrix of the undistorted image (scaled and shifted)
+bool get_undist_camera_matrix(const CameraPrms &prms,
+                              cv::Mat &new_camera_matrix) {
+  new_camera_matrix = prms.camera_matrix.clone();
   double *matrix_data = (double *)new_camera_matrix.data;
 
   const auto scale = (const float *)(prms.scale_xy.data);
   const auto shift = (const float *)(prms.shift_xy.data);
 
   if (!matrix_data || !scale || !shift) {
-    return;
+    return false;
   }
 
   matrix_data[0] *= (double)scale[0];
@@ -69,11 +73,16 @@ void undist_by_remap(const cv::Mat &src, cv::Mat &dst, const CameraPrms &prms) {
   matrix_data[2] += (double)shift[0];
   matrix_data[1 * 3 + 2] += (double)shift[1];
   // std::cout << new_camera_matrix;
-  // undistort
+  return true;
+}
+
+// undist image by remap
+void undist_by_remap(const cv::Mat &src, cv::Mat &dst, const CameraPrms &prms) {
+  // maps are cached per camera and only rebuilt when the calibration changes
   cv::Mat map1, map2;
-  cv::fisheye::initUndistortRectifyMap(prms.camera_matrix, prms.dist_coff,
-                                       cv::Mat(), new_camera_matrix, prms.size,
-                                       CV_16SC2, map1, map2);
+  if (!get_undist_maps(prms, map1, map2)) {
+    return;
+  }
 
   cv::remap(src, dst, map1, map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
 }
@@ -142,34 +151,146 @@ void rgb_dgain(cv::Mat &src, float r_gain, float g_gain, float b_gain) {
   }
 }
 
-// gray world awb amd lum banlance for four channeal images
-void awb_and_lum_banlance(std::vector<cv::Mat *> srcs) {
-  BgrSts sts[4];
+// gray world gains from the four channel statics
+void awb_gains(const BgrSts sts[4], BgrGain gains[4]) {
   int gray[4] = {0, 0, 0, 0};
   float gray_ave = 0;
 
-  if (srcs.size() != 4) {
+  for (int i = 0; i < 4; ++i) {
+    gray[i] = sts[i].r * 20 + sts[i].g * 60 + sts[i].b;
+    gray_ave += gray[i];
+  }
+
+  gray_ave /= 4;
+
+  for (int i = 0; i < 4; ++i) {
+    float lum_gain = gray_ave / gray[i];
+    gains[i].r = sts[i].g * lum_gain / sts[i].r;
+    gains[i].g = lum_gain;
+    gains[i].b = sts[i].g * lum_gain / sts[i].b;
+    // std::cout << "gains : " << gains[i].r << " | " << gains[i].g << " | "
+    // << gains[i].b << "\r\n";
+  }
+}
+
+void make_gain_lut(const BgrGain &gain, GainLut &lut) {
+  for (int v = 0; v < 256; ++v) {
+    lut.b[v] = clip<uint8_t>(v * gain.b, 255);
+    lut.g[v] = clip<uint8_t>(v * gain.g, 255);
+    lut.r[v] = clip<uint8_t>(v * gain.r, 255);
+  }
+}
+
+void rgb_info_statics_fast(const cv::Mat &src, BgrSts &sts, int step) {
+  sts.b = sts.r = sts.g = 0;
+  if (src.empty() || src.type() != CV_8UC3) {
     return;
   }
+  step = std::max(step, 1);
 
+  // gray world only needs the means, a sparse grid is plenty.
+  // every step-th row, and on it one run of 16 pixels out of step so the
+  // simd loads stay contiguous
+  uint64_t sum[3] = {0, 0, 0};
+  int64_t nums = 0;
+  for (int h = step / 2; h < src.rows; h += step) {
+    const uchar *row = src.ptr(h);
+    if (step == 1 || src.cols < 64) {
+      bgr_row_sum(row, src.cols, sum);
+      nums += src.cols;
+      continue;
+    }
+    // runs of 16 pixels every 16 * step pixels
+    for (int w = 0; w + 16 <= src.cols; w += 16 * step) {
+      bgr_row_sum(row + 3 * w, 16, sum);
+      nums += 16;
+    }
+  }
+  if (nums == 0) {
+    return;
+  }
+
+  sts.b = (int)(sum[0] / nums);
+  sts.g = (int)(sum[1] / nums);
+  sts.r = (int)(sum[2] / nums);
+}
+
+void awb_gain_luts(const std::vector<cv::Mat *> &srcs, GainLut luts[4],
+                   int step, ThreadPool *pool) {
+  AVM_TRACE_SCOPE("awb_gain_luts");
+  BgrSts sts[4];
+  BgrGain gains[4];
+
+  if (srcs.size() != 4) {
+    return;
+  }
   for (int i = 0; i < 4; ++i) {
     if (srcs[i] == nullptr) {
       return;
     }
-    rgb_info_statics(*srcs[i], sts[i]);
-    gray[i] = sts[i].r * 20 + sts[i].g * 60 + sts[i].b;
-    gray_ave += gray[i];
   }
 
-  gray_ave /= 4;
+  auto statics = [&](int i) {
+    AVM_TRACE_SCOPE("awb_statics");
+    rgb_info_statics_fast(*srcs[i], sts[i], step);
+  };
+  if (pool) {
+    pool->parallelFor(4, statics);
+  } else {
+    for (int i = 0; i < 4; ++i) {
+      statics(i);
+    }
+  }
 
   for (int i = 0; i < 4; ++i) {
-    float lum_gain = gray_ave / gray[i];
-    float r_gain = sts[i].g * lum_gain / sts[i].r;
-    float g_gain = lum_gain;
-    float b_gain = sts[i].g * lum_gain / sts[i].b;
-    // std::cout << "gains : " << r_gain << " | " << g_gain << " | " << b_gain
-    // << "\r\n";
-    rgb_dgain(*srcs[i], r_gain, g_gain, b_gain);
+    // a black frame would divide by zero, keep it as is
+    if (sts[i].b == 0 || sts[i].g == 0 || sts[i].r == 0) {
+      for (int j = 0; j < 4; ++j) {
+        make_gain_lut(BgrGain(), luts[j]);
+      }
+      return;
+    }
+  }
+
+  awb_gains(sts, gains);
+  for (int i = 0; i < 4; ++i) {
+    make_gain_lut(gains[i], luts[i]);
+  }
+}
+
+// gray world awb amd lum banlance for four channeal images
+void awb_and_lum_banlance(std::vector<cv::Mat *> srcs, ThreadPool *pool) {
+  AVM_TRACE_SCOPE("awb_and_lum_banlance");
+  BgrSts sts[4];
+  BgrGain gains[4];
+
+  if (srcs.size() != 4) {
+    return;
+  }
+
+  for (int i = 0; i < 4; ++i) {
+    if (srcs[i] == nullptr) {
+      return;
+    }
+  }
+
+  auto statics = [&](int i) { rgb_info_statics(*srcs[i], sts[i]); };
+  auto dgain = [&](int i) {
+    rgb_dgain(*srcs[i], gains[i].r, gains[i].g, gains[i].b);
+  };
+
+  if (pool) {
+    // the gains need all four statics, parallelFor returning is the barrier
+    pool->parallelFor(4, statics);
+    awb_gains(sts, gains);
+    pool->parallelFor(4, dgain);
+  } else {
+    for (int i = 0; i < 4; ++i) {
+      statics(i);
+    }
+    awb_gains(sts, gains);
+    for (int i = 0; i < 4; ++i) {
+      dgain(i);
+    }
   }
 }
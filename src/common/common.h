@@ -34,6 +34,23 @@ struct BgrSts {
   BgrSts() { b = g = r = 0; }
 };
 
+struct BgrGain {
+  float b;
+  float g;
+  float r;
+
+  BgrGain() { b = g = r = 1.0f; }
+};
+
+// per channel gain as a table, applied while the mosaic is written
+struct GainLut {
+  uchar b[256];
+  uchar g[256];
+  uchar r[256];
+};
+
+class ThreadPool;
+
 template <typename _T> static inline _T clip(float data, int max) {
   if (data > max)
     return max;
@@ -43,9 +60,26 @@ template <typename _T> static inline _T clip(float data, int max) {
 void display_mat(cv::Mat &img, std::string name);
 bool read_prms(const std::string &path, CameraPrms &prms);
 bool save_prms(const std::string &path, CameraPrms &prms);
+bool get_undist_camera_matrix(const CameraPrms &prms,
+                              cv::Mat &new_camera_matrix);
 void undist_by_remap(const cv::Mat &src, cv::Mat &dst, const CameraPrms &prms);
 
 void merge_image(cv::Mat src1, cv::Mat src2, cv::Mat w, cv::Mat out);
-void awb_and_lum_banlance(std::vector<cv::Mat *> srcs);
+
+void rgb_info_statics(cv::Mat &src, BgrSts &sts);
+void rgb_dgain(cv::Mat &src, float r_gain, float g_gain, float b_gain);
+void awb_gains(const BgrSts sts[4], BgrGain gains[4]);
+void make_gain_lut(const BgrGain &gain, GainLut &lut);
+// statics over every step-th row; on each one, runs of 16 contiguous pixels
+// every 16 * step pixels (1 / step of the columns), simd summed.
+// step 1 or narrow images sum whole rows
+void rgb_info_statics_fast(const cv::Mat &src, BgrSts &sts, int step);
+// gray world gains of the four cameras as tables, the frames are untouched.
+// feed the tables to the stitcher instead of running rgb_dgain
+void awb_gain_luts(const std::vector<cv::Mat *> &srcs, GainLut luts[4],
+                   int step = 4, ThreadPool *pool = nullptr);
+// with a pool the statics and the gains of the four cameras run in parallel
+void awb_and_lum_banlance(std::vector<cv::Mat *> srcs,
+                          ThreadPool *pool = nullptr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,366 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "frame_source.h"
+#include "trace.h"
+#include "yuv_stitch.h"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <fstream>
+
+const char *pixel_format_name(PixelFormat format) {
+  switch (format) {
+  case PIX_NV12:
+    return "nv12";
+  case PIX_YUYV:
+    return "yuyv";
+  default:
+    return "bgr";
+  }
+}
+
+bool parse_pixel_format(const std::string &name, PixelFormat &format) {
+  const PixelFormat all[] = {PIX_BGR, PIX_NV12, PIX_YUYV};
+  for (PixelFormat f : all) {
+    if (name == pixel_format_name(f)) {
+      format = f;
+      return true;
+    }
+  }
+  return false;
+}
+
+FrameSource::FrameSource(int ringSize, PixelFormat format)
+    : m_format(format), m_slots(std::max(ringSize, 1)), m_readIndex(0),
+      m_endIndex(INT64_MAX), m_running(false), m_lastWaitMs(0) {}
+
+FrameSource::~FrameSource() { stop(); }
+
+bool FrameSource::start() {
+  if (m_running) {
+    return true;
+  }
+  if (!open()) {
+    return false;
+  }
+
+  // slot i starts out waiting for frame i
+  for (size_t i = 0; i < m_slots.size(); ++i) {
+    m_slots[i].set.index = (int64_t)i;
+    m_slots[i].set.format = m_format;
+    m_slots[i].set.load_ms = 0;
+    m_slots[i].set.ready_tick = 0;
+    m_slots[i].state = SLOT_FILLING;
+    m_slots[i].pending = 4;
+  }
+  m_readIndex = 0;
+  m_endIndex = INT64_MAX;
+  m_running = true;
+
+  for (int i = 0; i < 4; ++i) {
+    m_threads[i] = std::thread(&FrameSource::decodeLoop, this, i);
+  }
+  return true;
+}
+
+void FrameSource::stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  m_cond.notify_all();
+  for (auto &t : m_threads) {
+    if (t.joinable()) {
+      t.join();
+    }
+  }
+}
+
+void FrameSource::decodeLoop(int cam) {
+  trace_thread_name((std::string("decode ") + camera_names[cam]).c_str());
+  const int64_t ring = (int64_t)m_slots.size();
+  for (int64_t index = 0;; ++index) {
+    Slot &slot = m_slots[index % ring];
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [&] {
+        return !m_running || index >= m_endIndex ||
+               (slot.state == SLOT_FILLING && slot.set.index == index);
+      });
+      if (!m_running || index >= m_endIndex) {
+        return;
+      }
+    }
+
+    // the consumer never touches a filling slot, no lock needed here
+    AVM_TRACE_SCOPE("decode");
+    int64 t0 = cv::getTickCount();
+    bool ok = decode(cam, index, slot.set.img[cam]) && !slot.set.img[cam].empty();
+    double ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!ok) {
+      m_endIndex = std::min(m_endIndex, index);
+      m_cond.notify_all();
+      return;
+    }
+    slot.set.load_ms += ms;
+    if (--slot.pending == 0) {
+      slot.set.ready_tick = cv::getTickCount();
+      slot.state = SLOT_READY;
+      m_cond.notify_all();
+    }
+  }
+}
+
+FrameSet *FrameSource::acquire() {
+  AVM_TRACE_SCOPE("acquire");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  Slot &slot = m_slots[m_readIndex % (int64_t)m_slots.size()];
+
+  int64 t0 = cv::getTickCount();
+  m_cond.wait(lock, [&] {
+    return !m_running || m_readIndex >= m_endIndex ||
+           (slot.state == SLOT_READY && slot.set.index == m_readIndex);
+  });
+  m_lastWaitMs = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+
+  if (slot.state != SLOT_READY || slot.set.index != m_readIndex) {
+    return nullptr;
+  }
+  slot.state = SLOT_IN_USE;
+  ++m_readIndex;
+  return &slot.set;
+}
+
+void FrameSource::release(FrameSet *set) {
+  if (!set) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Slot &slot = m_slots[set->index % (int64_t)m_slots.size()];
+    // re-arm the slot for the frame one ring further
+    slot.set.index += (int64_t)m_slots.size();
+    slot.set.load_ms = 0;
+    slot.pending = 4;
+    slot.state = SLOT_FILLING;
+  }
+  m_cond.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+
+static std::string replace_all(std::string s, const std::string &key,
+                               const std::string &value) {
+  for (size_t pos = s.find(key); pos != std::string::npos;
+       pos = s.find(key, pos + value.size())) {
+    s.replace(pos, key.size(), value);
+  }
+  return s;
+}
+
+ImageSequenceSource::ImageSequenceSource(const std::string &pattern, bool loop,
+                                         int ringSize, PixelFormat format,
+                                         const cv::Size &size)
+    : FrameSource(ringSize, format), m_pattern(pattern), m_loop(loop),
+      m_size(size) {}
+
+ImageSequenceSource::~ImageSequenceSource() { stop(); }
+
+static std::string sequence_path(const std::string &pattern, int cam,
+                                 int64_t frame) {
+  char idx[32];
+  snprintf(idx, sizeof(idx), "%06lld", (long long)frame);
+  return replace_all(replace_all(pattern, "{cam}", camera_names[cam]),
+                     "{idx}", idx);
+}
+
+bool ImageSequenceSource::open() {
+  m_length = 0;
+  if (m_pattern.find("{idx}") == std::string::npos) {
+    return true;
+  }
+  int64_t length[4];
+  for (int cam = 0; cam < 4; ++cam) {
+    length[cam] = 0;
+    while (std::ifstream(sequence_path(m_pattern, cam, length[cam]))) {
+      ++length[cam];
+    }
+  }
+  m_length = std::min(std::min(length[0], length[1]),
+                      std::min(length[2], length[3]));
+  if (m_length == 0) {
+    std::cerr << "open frame failed " << sequence_path(m_pattern, 0, 0)
+              << " (or another camera)\r\n";
+    return false;
+  }
+  if (m_length != std::max(std::max(length[0], length[1]),
+                           std::max(length[2], length[3]))) {
+    std::cerr << "sequence lengths differ (" << length[0] << " " << length[1]
+              << " " << length[2] << " " << length[3]
+              << "), using the first " << m_length << " frames\r\n";
+  }
+  return true;
+}
+
+bool ImageSequenceSource::decode(int cam, int64_t index, cv::Mat &dst) {
+  bool sequence = m_length > 0;
+  if (!m_loop && index > 0 && (!sequence || index >= m_length)) {
+    return false;
+  }
+
+  // all cameras wrap at the same length, so a set never mixes times
+  std::string path =
+      sequence ? sequence_path(m_pattern, cam, index % m_length)
+               : replace_all(m_pattern, "{cam}", camera_names[cam]);
+
+  std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+  if (!ifs) {
+    if (index == 0) {
+      std::cerr << "open frame failed " << path << "\r\n";
+    }
+    return false;
+  }
+
+  // raw yuv goes straight into the slot's own Mat
+  if (format() != PIX_BGR) {
+    if (format() == PIX_NV12) {
+      dst.create(m_size.height * 3 / 2, m_size.width, CV_8UC1);
+    } else {
+      dst.create(m_size, CV_8UC2);
+    }
+    const size_t bytes = dst.total() * dst.elemSize();
+    if ((size_t)ifs.tellg() != bytes) {
+      std::cerr << "raw frame size mismatch " << path << "\r\n";
+      return false;
+    }
+    ifs.seekg(0);
+    return (bool)ifs.read((char *)dst.data, bytes);
+  }
+
+  // read into a reused buffer and decode into the slot's own Mat
+  std::vector<uchar> &buf = m_fileBuf[cam];
+  buf.resize((size_t)ifs.tellg());
+  ifs.seekg(0);
+  ifs.read((char *)buf.data(), buf.size());
+  cv::imdecode(buf, cv::IMREAD_COLOR, &dst);
+  return !dst.empty();
+}
+
+VideoSource::VideoSource(const std::string &pattern, bool loop, int ringSize)
+    : FrameSource(ringSize), m_pattern(pattern), m_loop(loop) {}
+
+VideoSource::~VideoSource() { stop(); }
+
+bool VideoSource::open() {
+  for (int i = 0; i < 4; ++i) {
+    std::string path = replace_all(m_pattern, "{cam}", camera_names[i]);
+    if (!m_caps[i].open(path)) {
+      std::cerr << "open video failed " << path << "\r\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool VideoSource::decode(int cam, int64_t index, cv::Mat &dst) {
+  if (m_caps[cam].read(dst)) {
+    return true;
+  }
+  if (!m_loop || index == 0) {
+    return false;
+  }
+  m_caps[cam].set(cv::CAP_PROP_POS_FRAMES, 0);
+  return m_caps[cam].read(dst);
+}
+
+SyntheticSource::SyntheticSource(const cv::Size &size, int64_t frames,
+                                 int ringSize, PixelFormat format)
+    : FrameSource(ringSize, format), m_size(size), m_frames(frames) {}
+
+SyntheticSource::~SyntheticSource() { stop(); }
+
+bool SyntheticSource::decode(int cam, int64_t index, cv::Mat &dst) {
+  if (m_frames > 0 && index >= m_frames) {
+    return false;
+  }
+
+  // moving checker pattern, tinted per camera
+  cv::Mat &bgr = format() == PIX_BGR ? dst : m_bgr[cam];
+  bgr.create(m_size, CV_8UC3);
+  const int shift = (int)(index * 4);
+  for (int h = 0; h < bgr.rows; ++h) {
+    uchar *p = bgr.ptr(h);
+    for (int w = 0; w < bgr.cols; ++w) {
+      uchar v = (((w + shift) >> 5) ^ (h >> 5)) & 1 ? 200 : 56;
+      p[0] = v;
+      p[1] = (uchar)(v ^ (cam * 40));
+      p[2] = (uchar)((w + h + shift) & 0xff);
+      p += 3;
+    }
+  }
+
+  if (format() == PIX_NV12) {
+    bgr_to_nv12(bgr, dst);
+  } else if (format() == PIX_YUYV) {
+    bgr_to_yuyv(bgr, dst);
+  }
+  return true;
+}
+
+std::unique_ptr<FrameSource> create_frame_source(const std::string &spec,
+                                                 bool loop, int ringSize) {
+  std::string kind = spec.substr(0, spec.find(':'));
+  std::string arg =
+      spec.find(':') == std::string::npos ? "" : spec.substr(spec.find(':') + 1);
+
+  if (kind == "png" || kind == "image") {
+    return std::make_unique<ImageSequenceSource>(arg, loop, ringSize);
+  }
+  if (kind == "video") {
+    return std::make_unique<VideoSource>(arg, loop, ringSize);
+  }
+  PixelFormat format = PIX_BGR;
+  if (kind != "bgr" && parse_pixel_format(kind, format)) {
+    // raw frames, the size follows the last '@'
+    int w = 0, h = 0;
+    size_t at = arg.rfind('@');
+    if (at == std::string::npos ||
+        sscanf(arg.c_str() + at + 1, "%dx%d", &w, &h) != 2 || w <= 0 ||
+        h <= 0 || (w | h) & 1) {
+      std::cerr << "raw " << kind << " needs an even size, <pattern>@WxH\r\n";
+      return nullptr;
+    }
+    return std::make_unique<ImageSequenceSource>(
+        arg.substr(0, at), loop, ringSize, format, cv::Size(w, h));
+  }
+  if (kind == "synthetic") {
+    int w = 960, h = 640;
+    std::stringstream ss(arg);
+    for (std::string opt; std::getline(ss, opt, ':');) {
+      if (parse_pixel_format(opt, format)) {
+        continue;
+      }
+      if (sscanf(opt.c_str(), "%dx%d", &w, &h) != 2) {
+        std::cerr << "bad synthetic option " << opt << "\r\n";
+        return nullptr;
+      }
+    }
+    if (format != PIX_BGR && (w | h) & 1) {
+      std::cerr << "synthetic " << pixel_format_name(format)
+                << " needs an even size\r\n";
+      return nullptr;
+    }
+    return std::make_unique<SyntheticSource>(cv::Size(w, h), loop ? 0 : 300,
+                                             ringSize, format);
+  }
+
+  std::cerr << "unknown frame source " << spec << "\r\n";
+  return nullptr;
+}
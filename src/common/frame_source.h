@@ -0,0 +1,154 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// pixel layout of the camera frames
+enum PixelFormat {
+  PIX_BGR = 0, // CV_8UC3
+  PIX_NV12,    // CV_8UC1, h * 3 / 2 rows: luma then interleaved uv
+  PIX_YUYV,    // CV_8UC2, y0 u y1 v
+};
+
+const char *pixel_format_name(PixelFormat format);
+// "bgr", "nv12" or "yuyv"
+bool parse_pixel_format(const std::string &name, PixelFormat &format);
+
+// four camera frames of the same instant, in camera_names order
+struct FrameSet {
+  cv::Mat img[4];
+  PixelFormat format = PIX_BGR;
+  int64_t index = 0;  // frame number in the source
+  double load_ms = 0; // decode time summed over the four cameras
+  int64 ready_tick = 0; // cv::getTickCount() when the last camera finished
+};
+
+// prefetching frame producer.
+// one background thread per camera decodes into a bounded ring of
+// preallocated FrameSets, the consumer borrows ready sets without copying.
+class FrameSource {
+public:
+  explicit FrameSource(int ringSize = 3, PixelFormat format = PIX_BGR);
+  // derived classes call stop() in their own destructor so no decoder
+  // thread can still be inside decode()
+  virtual ~FrameSource();
+
+  bool start();
+  void stop();
+
+  // blocks until the next set is decoded, nullptr at end of stream.
+  // the set stays valid (and writable) until release()
+  FrameSet *acquire();
+  void release(FrameSet *set);
+
+  // time the last acquire() spent waiting for the decoders
+  double lastWaitMs() const { return m_lastWaitMs; }
+  int ringSize() const { return (int)m_slots.size(); }
+  PixelFormat format() const { return m_format; }
+
+protected:
+  // decode frame `index` of camera `cam` into dst, reusing its buffer.
+  // called from the camera's own thread, frames arrive in order.
+  // return false at end of stream
+  virtual bool decode(int cam, int64_t index, cv::Mat &dst) = 0;
+  virtual bool open() { return true; }
+
+private:
+  enum SlotState { SLOT_FILLING, SLOT_READY, SLOT_IN_USE };
+  struct Slot {
+    FrameSet set;
+    SlotState state;
+    int pending; // cameras still decoding
+  };
+
+  void decodeLoop(int cam);
+
+  PixelFormat m_format;
+  std::vector<Slot> m_slots;
+  std::thread m_threads[4];
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  int64_t m_readIndex;
+  int64_t m_endIndex;
+  bool m_running;
+  double m_lastWaitMs;
+};
+
+// png (or any imread format) files, "{cam}" and "{idx}" (6 digits) in the
+// pattern are replaced. without "{idx}" the same files are decoded forever.
+// sequences of different length are cut to the shortest one.
+// for nv12 / yuyv the files are raw frames of the given size, read
+// straight into the ring
+class ImageSequenceSource : public FrameSource {
+public:
+  ImageSequenceSource(const std::string &pattern, bool loop, int ringSize = 3,
+                      PixelFormat format = PIX_BGR,
+                      const cv::Size &size = cv::Size());
+  ~ImageSequenceSource() override;
+
+protected:
+  // with "{idx}" counts the files of every camera up front, the shortest
+  // sequence sets the length so all four wrap on the same frame
+  bool open() override;
+  bool decode(int cam, int64_t index, cv::Mat &dst) override;
+
+private:
+  std::string m_pattern;
+  bool m_loop;
+  cv::Size m_size; // raw frames only
+  int64_t m_length = 0; // common sequence length, 0 without "{idx}"
+  std::vector<uchar> m_fileBuf[4];
+};
+
+// one video file per camera, "{cam}" in the pattern is replaced
+class VideoSource : public FrameSource {
+public:
+  VideoSource(const std::string &pattern, bool loop, int ringSize = 3);
+  ~VideoSource() override;
+
+protected:
+  bool open() override;
+  bool decode(int cam, int64_t index, cv::Mat &dst) override;
+
+private:
+  std::string m_pattern;
+  bool m_loop;
+  cv::VideoCapture m_caps[4];
+};
+
+// generated frames, no i/o at all. frames <= 0 means endless
+class SyntheticSource : public FrameSource {
+public:
+  SyntheticSource(const cv::Size &size, int64_t frames, int ringSize = 3,
+                  PixelFormat format = PIX_BGR);
+  ~SyntheticSource() override;
+
+protected:
+  bool decode(int cam, int64_t index, cv::Mat &dst) override;
+
+private:
+  cv::Size m_size;
+  int64_t m_frames;
+  cv::Mat m_bgr[4]; // yuv formats are converted from here
+};
+
+// "png:<pattern>", "video:<pattern>", "nv12:<pattern>@WxH",
+// "yuyv:<pattern>@WxH" or "synthetic[:WxH][:nv12|:yuyv]"
+std::unique_ptr<FrameSource> create_frame_source(const std::string &spec,
+                                                 bool loop = true,
+                                                 int ringSize = 3);
+
+#endif
@@ -0,0 +1,77 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "image_writer.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+
+ImageWriter::ImageWriter(int threads, int capacity,
+                         const std::vector<int> &params)
+    : m_capacity(std::max(capacity, 1)), m_params(params), m_done(false),
+      m_written(0), m_failed(0), m_waitMs(0.0) {
+  for (int i = 0; i < std::max(threads, 1); ++i) {
+    m_threads.emplace_back([this] { loop(); });
+  }
+}
+
+ImageWriter::~ImageWriter() { finish(); }
+
+void ImageWriter::push(const std::string &path, cv::Mat &image) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if ((int)m_jobs.size() >= m_capacity) {
+    const auto start = std::chrono::steady_clock::now();
+    m_space.wait(lock, [&] { return (int)m_jobs.size() < m_capacity; });
+    m_waitMs += std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  }
+  m_jobs.push_back(Job{path, std::move(image)});
+  lock.unlock();
+  m_ready.notify_one();
+}
+
+void ImageWriter::finish() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_done = true;
+  }
+  m_ready.notify_all();
+  for (std::thread &t : m_threads) {
+    t.join();
+  }
+  m_threads.clear();
+}
+
+double ImageWriter::waitMs() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_waitMs;
+}
+
+void ImageWriter::loop() {
+  trace_thread_name("writer");
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_ready.wait(lock, [&] { return m_done || !m_jobs.empty(); });
+      if (m_jobs.empty()) {
+        return;
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    m_space.notify_one();
+    AVM_TRACE_SCOPE("ImageWriter::write");
+    if (cv::imwrite(job.path, job.image, m_params)) {
+      ++m_written;
+    } else {
+      std::cerr << "write image failed " << job.path << "\r\n";
+      ++m_failed;
+    }
+  }
+}
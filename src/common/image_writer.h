@@ -0,0 +1,61 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// encoder threads that take cv::imwrite off the producing thread.
+// push() hands the image over without copying and waits while capacity
+// images are queued, so a slow disk throttles the producers instead of
+// piling up frames
+class ImageWriter {
+public:
+  ImageWriter(int threads, int capacity, const std::vector<int> &params);
+  ~ImageWriter();
+
+  ImageWriter(const ImageWriter &) = delete;
+  ImageWriter &operator=(const ImageWriter &) = delete;
+
+  // image is moved from, callable from any number of threads
+  void push(const std::string &path, cv::Mat &image);
+  // write what is still queued, then stop the threads
+  void finish();
+
+  uint64_t written() const { return m_written; }
+  uint64_t failed() const { return m_failed; }
+  // total time push() waited for a free slot
+  double waitMs() const;
+
+private:
+  struct Job {
+    std::string path;
+    cv::Mat image;
+  };
+
+  void loop();
+
+  const int m_capacity;
+  const std::vector<int> m_params;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_ready; // encoders, new image
+  std::condition_variable m_space; // producers, free slot
+  std::deque<Job> m_jobs;
+  bool m_done;
+  std::vector<std::thread> m_threads;
+  std::atomic<uint64_t> m_written;
+  std::atomic<uint64_t> m_failed;
+  double m_waitMs; // under m_mutex
+};
+
+#endif
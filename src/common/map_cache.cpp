@@ -0,0 +1,167 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "map_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+
+namespace {
+
+struct MapEntry {
+  uint64_t hash;
+  cv::Mat map1;
+  cv::Mat map2;
+};
+
+// on disk layout: header followed by the raw rows of map1 and map2
+struct MapFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t hash;
+  int32_t rows;
+  int32_t cols;
+  int32_t type1;
+  int32_t type2;
+};
+
+const char map_file_magic[4] = {'A', 'V', 'M', 'U'};
+const uint32_t map_file_version = 1;
+
+std::mutex cache_mutex;
+std::string cache_dir;
+std::map<std::string, MapEntry> cache; // keyed by camera name
+
+// fnv-1a 64
+inline void hash_bytes(uint64_t &h, const void *data, size_t len) {
+  const uchar *p = (const uchar *)data;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+}
+
+void hash_mat(uint64_t &h, const cv::Mat &m) {
+  int header[3] = {m.rows, m.cols, m.type()};
+  hash_bytes(h, header, sizeof(header));
+  for (int r = 0; r < m.rows; ++r) {
+    hash_bytes(h, m.ptr(r), m.cols * m.elemSize());
+  }
+}
+
+std::string map_file_path(const std::string &name, uint64_t hash) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+  return cache_dir + "/undist_" + name + "_" + buf + ".bin";
+}
+
+bool load_maps(const std::string &path, uint64_t hash, const cv::Size &size,
+               cv::Mat &map1, cv::Mat &map2) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    return false;
+  }
+
+  MapFileHeader hdr;
+  if (!ifs.read((char *)&hdr, sizeof(hdr)) ||
+      memcmp(hdr.magic, map_file_magic, 4) || hdr.version != map_file_version ||
+      hdr.hash != hash || hdr.rows != size.height || hdr.cols != size.width ||
+      hdr.type1 != CV_16SC2 || hdr.type2 != CV_16UC1) {
+    return false;
+  }
+
+  map1.create(hdr.rows, hdr.cols, hdr.type1);
+  map2.create(hdr.rows, hdr.cols, hdr.type2);
+  ifs.read((char *)map1.data, map1.total() * map1.elemSize());
+  ifs.read((char *)map2.data, map2.total() * map2.elemSize());
+  return (bool)ifs;
+}
+
+void save_maps(const std::string &path, uint64_t hash, const cv::Mat &map1,
+               const cv::Mat &map2) {
+  std::error_code ec;
+  std::filesystem::create_directories(cache_dir, ec);
+
+  // write to a temp file first so a crash never leaves a truncated cache
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+      return;
+    }
+    MapFileHeader hdr;
+    memcpy(hdr.magic, map_file_magic, 4);
+    hdr.version = map_file_version;
+    hdr.hash = hash;
+    hdr.rows = map1.rows;
+    hdr.cols = map1.cols;
+    hdr.type1 = map1.type();
+    hdr.type2 = map2.type();
+    ofs.write((const char *)&hdr, sizeof(hdr));
+    ofs.write((const char *)map1.data, map1.total() * map1.elemSize());
+    ofs.write((const char *)map2.data, map2.total() * map2.elemSize());
+    if (!ofs) {
+      return;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+}
+
+} // namespace
+
+uint64_t camera_prms_hash(const CameraPrms &prms) {
+  uint64_t h = 14695981039346656037ULL;
+  hash_mat(h, prms.camera_matrix);
+  hash_mat(h, prms.dist_coff);
+  hash_mat(h, prms.scale_xy);
+  hash_mat(h, prms.shift_xy);
+  int size[2] = {prms.size.width, prms.size.height};
+  hash_bytes(h, size, sizeof(size));
+  return h;
+}
+
+void set_undist_map_cache_dir(const std::string &dir) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  cache_dir = dir;
+}
+
+bool get_undist_maps(const CameraPrms &prms, cv::Mat &map1, cv::Mat &map2) {
+  uint64_t hash = camera_prms_hash(prms);
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = cache.find(prms.name);
+  if (it != cache.end() && it->second.hash == hash) {
+    map1 = it->second.map1;
+    map2 = it->second.map2;
+    return true;
+  }
+
+  // calibration changed or first use: try disk, otherwise build
+  MapEntry entry;
+  entry.hash = hash;
+  std::string path = cache_dir.empty() ? "" : map_file_path(prms.name, hash);
+  if (path.empty() ||
+      !load_maps(path, hash, prms.size, entry.map1, entry.map2)) {
+    cv::Mat new_camera_matrix;
+    if (!get_undist_camera_matrix(prms, new_camera_matrix)) {
+      return false;
+    }
+    cv::fisheye::initUndistortRectifyMap(
+        prms.camera_matrix, prms.dist_coff, cv::Mat(), new_camera_matrix,
+        prms.size, CV_16SC2, entry.map1, entry.map2);
+    if (!path.empty()) {
+      save_maps(path, hash, entry.map1, entry.map2);
+    }
+  }
+
+  map1 = entry.map1;
+  map2 = entry.map2;
+  cache[prms.name] = entry;
+  return true;
+}
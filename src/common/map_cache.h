@@ -0,0 +1,26 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef MAP_CACHE_H
+#define MAP_CACHE_H
+
+#include "common.h"
+#include <cstdint>
+
+// hash over the calibration that the undistort maps depend on
+// (camera_matrix, dist_coff, scale_xy, shift_xy, size)
+uint64_t camera_prms_hash(const CameraPrms &prms);
+
+// directory used to persist the maps, empty disables persistence
+void set_undist_map_cache_dir(const std::string &dir);
+
+// fisheye undistort maps (CV_16SC2 + CV_16UC1) for the given calibration.
+// maps are built once per camera and rebuilt when the calibration changes,
+// with persistence enabled they are loaded from disk on cold start.
+bool get_undist_maps(const CameraPrms &prms, cv::Mat &map1, cv::Mat &map2);
+
+#endif
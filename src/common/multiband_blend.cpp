@@ -0,0 +1,189 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "multiband_blend.h"
+#include "trace.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MULTIBAND_HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MULTIBAND_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+int multiband_max_bands(cv::Size size) {
+  int bands = 1;
+  while (std::min(size.width, size.height) >= 16) {
+    size = cv::Size((size.width + 1) / 2, (size.height + 1) / 2);
+    ++bands;
+  }
+  return bands;
+}
+
+// same as _mm_mulhrs_epi16: (a * w + 2^14) >> 15
+static void blend_row_q15_ref(const int16_t *a, const int16_t *w, int16_t *o,
+                              int n) {
+  for (int i = 0; i < n; ++i) {
+    o[i] = (int16_t)((a[i] * w[i] + (1 << 14)) >> 15);
+  }
+}
+
+#if MULTIBAND_HAVE_X86
+__attribute__((target("sse4.1"))) static void
+blend_row_q15_sse41(const int16_t *a, const int16_t *w, int16_t *o, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vw = _mm_loadu_si128((const __m128i *)(w + i));
+    _mm_storeu_si128((__m128i *)(o + i), _mm_mulhrs_epi16(va, vw));
+  }
+  blend_row_q15_ref(a + i, w + i, o + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+blend_row_q15_avx2(const int16_t *a, const int16_t *w, int16_t *o, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vw = _mm256_loadu_si256((const __m256i *)(w + i));
+    _mm256_storeu_si256((__m256i *)(o + i), _mm256_mulhrs_epi16(va, vw));
+  }
+  blend_row_q15_ref(a + i, w + i, o + i, n - i);
+}
+#endif
+
+#if MULTIBAND_HAVE_NEON
+// vqrdmulh doubles, (2 * a * w + 2^15) >> 16 is the same rounding
+static void blend_row_q15_neon(const int16_t *a, const int16_t *w, int16_t *o,
+                               int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    vst1q_s16(o + i, vqrdmulhq_s16(vld1q_s16(a + i), vld1q_s16(w + i)));
+  }
+  blend_row_q15_ref(a + i, w + i, o + i, n - i);
+}
+#endif
+
+void blend_row_q15(const int16_t *a, const int16_t *w, int16_t *o, int n,
+                   BlendIsa isa) {
+  switch (isa) {
+#if MULTIBAND_HAVE_X86
+  case BLEND_ISA_SSE41:
+    blend_row_q15_sse41(a, w, o, n);
+    return;
+  case BLEND_ISA_AVX2:
+    blend_row_q15_avx2(a, w, o, n);
+    return;
+#endif
+#if MULTIBAND_HAVE_NEON
+  case BLEND_ISA_NEON:
+    blend_row_q15_neon(a, w, o, n);
+    return;
+#endif
+  default:
+    blend_row_q15_ref(a, w, o, n);
+    return;
+  }
+}
+
+// fnv-1a style over 8 byte words of every row (padding skipped), the tail
+// bytes one by one
+static uint64_t weight_hash(const cv::Mat &weight) {
+  uint64_t h = 1469598103934665603ull;
+  const size_t bytes = weight.cols * weight.elemSize();
+  for (int y = 0; y < weight.rows; ++y) {
+    const uchar *row = weight.ptr(y);
+    size_t x = 0;
+    for (; x + 8 <= bytes; x += 8) {
+      uint64_t word;
+      memcpy(&word, row + x, 8);
+      h = (h ^ word) * 1099511628211ull;
+    }
+    for (; x < bytes; ++x) {
+      h = (h ^ row[x]) * 1099511628211ull;
+    }
+  }
+  return h;
+}
+
+MultiBandBlender::MultiBandBlender(cv::Size size, int bands)
+    : m_size(size),
+      m_bands(std::max(1, std::min(bands, multiband_max_bands(size)))),
+      m_prepared(false), m_weightType(-1), m_weightHash(0) {
+  m_sizes.push_back(size);
+  for (int k = 1; k < m_bands; ++k) {
+    const cv::Size &s = m_sizes.back();
+    m_sizes.push_back(cv::Size((s.width + 1) / 2, (s.height + 1) / 2));
+  }
+  m_weights.resize(m_bands);
+  m_levels.resize(m_bands);
+  m_up.resize(m_bands);
+}
+
+void MultiBandBlender::prepare(const cv::Mat &weight) {
+  AVM_TRACE_SCOPE("multiband_prepare");
+  cv::Mat plane = weight;
+  if (weight.channels() != 1) {
+    cv::extractChannel(weight, plane, 0);
+  }
+
+  // w / 255 in q15, 255 -> 32767
+  cv::Mat level;
+  plane.convertTo(level, CV_16S, 32767.0 / 255.0);
+  for (int k = 0; k < m_bands; ++k) {
+    if (k > 0) {
+      cv::pyrDown(level, level, m_sizes[k]);
+    }
+    cv::Mat planes[3] = {level, level, level};
+    cv::merge(planes, 3, m_weights[k]);
+  }
+  m_prepared = true;
+  m_weightSize = weight.size();
+  m_weightType = weight.type();
+  m_weightHash = weight_hash(weight);
+}
+
+bool MultiBandBlender::prepared(const cv::Mat &weight) const {
+  return m_prepared && m_weightSize == weight.size() &&
+         m_weightType == weight.type() && m_weightHash == weight_hash(weight);
+}
+
+void MultiBandBlender::blend(const cv::Mat &a, const cv::Mat &b, cv::Mat out,
+                             BlendIsa isa) {
+  AVM_TRACE_SCOPE("multiband_blend");
+  // 1. difference and its gaussian pyramid
+  cv::subtract(a, b, m_levels[0], cv::noArray(), CV_16S);
+  for (int k = 1; k < m_bands; ++k) {
+    cv::pyrDown(m_levels[k - 1], m_levels[k], m_sizes[k]);
+  }
+
+  // 2. laplacian levels in place, finest first so the next gaussian level
+  //    is still intact when it is expanded
+  for (int k = 0; k + 1 < m_bands; ++k) {
+    cv::pyrUp(m_levels[k + 1], m_up[k], m_sizes[k]);
+    cv::subtract(m_levels[k], m_up[k], m_levels[k]);
+  }
+
+  // 3. every band weighted by the weight plane blurred to its scale
+  for (int k = 0; k < m_bands; ++k) {
+    cv::Mat &l = m_levels[k];
+    const int n = l.cols * l.channels();
+    for (int y = 0; y < l.rows; ++y) {
+      int16_t *p = l.ptr<int16_t>(y);
+      blend_row_q15(p, m_weights[k].ptr<int16_t>(y), p, n, isa);
+    }
+  }
+
+  // 4. collapse, coarsest first, and add back the second camera
+  for (int k = m_bands - 2; k >= 0; --k) {
+    cv::pyrUp(m_levels[k + 1], m_up[k], m_sizes[k]);
+    cv::add(m_levels[k], m_up[k], m_levels[k]);
+  }
+  cv::add(b, m_levels[0], out, cv::noArray(), CV_8U);
+}
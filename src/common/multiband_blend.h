@@ -0,0 +1,66 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef MULTIBAND_BLEND_H
+#define MULTIBAND_BLEND_H
+
+#include "blend_simd.h"
+#include "common.h"
+
+// laplacian pyramid blending of one overlap corner, against the ghosting
+// and banding of the per pixel blend under exposure differences.
+// the blend is linear, so only the difference of the two samples needs a
+// pyramid:  out = b + collapse(G_k(w) * L_k(a - b))
+// with G_k(w) the gaussian pyramid of the weight plane, built once by
+// prepare(), and L_k the laplacian pyramid. levels are CV_16S, weights q15
+// applied with a rounding high multiply (simd, bit-exact with the scalar
+// path). pyrDown / pyrUp are opencv's vectorized kernels. the buffers are
+// allocated by the first blend, every later frame runs allocation free.
+// bands counts the levels incl. the coarsest one, 1 is a plain alpha blend
+
+// levels that fit into size, the coarsest one no smaller than 8 px
+int multiband_max_bands(cv::Size size);
+
+// o[i] = round(a[i] * w[i] / 32768), n int16 values
+void blend_row_q15(const int16_t *a, const int16_t *w, int16_t *o, int n,
+                   BlendIsa isa = blend_best_isa());
+
+class MultiBandBlender {
+public:
+  // bands is clamped to multiband_max_bands(size)
+  MultiBandBlender(cv::Size size, int bands);
+
+  // 8-bit weight plane of the corner (CV_8UC1, or CV_8UC3 with the weight
+  // repeated), a is weighted with w / 255 like blend_image
+  void prepare(const cv::Mat &weight);
+  // prepare() was called for a plane of this size and content. keyed on a
+  // hash of the pixels, not the address: a reloaded or rescaled plane may
+  // land in a freed buffer (or a remapped bundle) at the same address.
+  // hashing a corner is word-wise, a few percent of one blend
+  bool prepared(const cv::Mat &weight) const;
+
+  // CV_8UC3 samples of the two cameras into out (corner sized, CV_8UC3)
+  void blend(const cv::Mat &a, const cv::Mat &b, cv::Mat out,
+             BlendIsa isa = blend_best_isa());
+
+  cv::Size size() const { return m_size; }
+  int bands() const { return m_bands; }
+
+private:
+  cv::Size m_size;
+  int m_bands;
+  bool m_prepared;
+  cv::Size m_weightSize;
+  int m_weightType;
+  uint64_t m_weightHash;
+  std::vector<cv::Size> m_sizes;  // per level
+  std::vector<cv::Mat> m_weights; // q15 CV_16SC3 per level
+  std::vector<cv::Mat> m_levels;  // pyramid of a - b, CV_16SC3
+  std::vector<cv::Mat> m_up;      // pyrUp of the next level
+};
+
+#endif
@@ -0,0 +1,318 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "remap_simd.h"
+#include "trace.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REMAP_HAVE_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define REMAP_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+const char *remap_mode_name(RemapMode mode) {
+  switch (mode) {
+  case REMAP_NEAREST:
+    return "nearest";
+  case REMAP_OPENCV:
+    return "opencv";
+  default:
+    return "bilinear";
+  }
+}
+
+bool parse_remap_mode(const std::string &name, RemapMode &mode) {
+  const RemapMode all[] = {REMAP_BILINEAR, REMAP_NEAREST, REMAP_OPENCV};
+  for (RemapMode m : all) {
+    if (name == remap_mode_name(m)) {
+      mode = m;
+      return true;
+    }
+  }
+  return false;
+}
+
+void build_remap_lut(const cv::Mat &map1, const cv::Mat &map2,
+                     RemapLut &lut) {
+  const int bits = cv::INTER_BITS;
+  const int mask = (1 << bits) - 1;
+  // fresh buffers, never written into a shared lut
+  cv::Mat xy(map1.size(), CV_16SC2);
+  cv::Mat frac(map1.size(), CV_8UC1);
+  for (int y = 0; y < map1.rows; ++y) {
+    const short *m1 = map1.ptr<short>(y);
+    const ushort *m2 = map2.ptr<ushort>(y);
+    short *d = xy.ptr<short>(y);
+    uchar *f = frac.ptr(y);
+    for (int x = 0; x < map1.cols; ++x) {
+      // 1/32 pixel coords rounded to 1/16
+      const int cx = ((m1[2 * x + 0] * (1 << bits) + (m2[x] & mask)) + 1) >> 1;
+      const int cy = ((m1[2 * x + 1] * (1 << bits) + (m2[x] >> bits)) + 1) >> 1;
+      d[2 * x + 0] = cv::saturate_cast<short>(cx >> 4);
+      d[2 * x + 1] = cv::saturate_cast<short>(cy >> 4);
+      f[x] = (uchar)((cx & 15) | (cy & 15) << 4);
+    }
+  }
+  lut.xy = xy;
+  lut.frac = frac;
+}
+
+void remap_lut_maps(const RemapLut &lut, cv::Mat &map1, cv::Mat &map2) {
+  // 1/16 fractions widened to the 1/32 table index of cv::remap
+  const int up = cv::INTER_BITS - 4;
+  map1 = lut.xy;
+  map2.create(lut.frac.size(), CV_16UC1);
+  for (int y = 0; y < lut.frac.rows; ++y) {
+    const uchar *f = lut.frac.ptr(y);
+    ushort *m = map2.ptr<ushort>(y);
+    for (int x = 0; x < lut.frac.cols; ++x) {
+      m[x] = (ushort)(((f[x] & 15) << up) |
+                      ((f[x] >> 4) << (up + cv::INTER_BITS)));
+    }
+  }
+}
+
+// source frame as the kernels see it
+struct RemapSrc {
+  const uchar *data;
+  size_t step;
+  int cols;
+  int rows;
+
+  // both bilinear rows plus an 8 byte load from the top left tap in bounds.
+  // frames below 3x2 never take it, cols - 2 would wrap as unsigned
+  bool fast(int sx, int sy) const {
+    return cols >= 3 && rows >= 2 && (unsigned)sx < (unsigned)(cols - 2) &&
+           (unsigned)sy < (unsigned)(rows - 1);
+  }
+  const uchar *at(int sx, int sy) const { return data + sy * step + 3 * sx; }
+};
+
+// weights sum to 16 * 16, the vertical pass stays below 16 bits and so does
+// the horizontal one: 255 * 16 * 16 + 128 < 65536
+static inline void bilinear_px(const RemapSrc &s, int sx, int sy, int f,
+                               uchar *o) {
+  const int fx = f & 15;
+  const int fy = f >> 4;
+  if (s.fast(sx, sy)) {
+    const uchar *p0 = s.at(sx, sy);
+    const uchar *p1 = p0 + s.step;
+    for (int c = 0; c < 3; ++c) {
+      const int t0 = p0[c] * (16 - fy) + p1[c] * fy;
+      const int t1 = p0[c + 3] * (16 - fy) + p1[c + 3] * fy;
+      o[c] = (uchar)((t0 * (16 - fx) + t1 * fx + 128) >> 8);
+    }
+    return;
+  }
+
+  // frame edge, taps outside read as black
+  const int wx[2] = {16 - fx, fx};
+  const int wy[2] = {16 - fy, fy};
+  int acc[3] = {0, 0, 0};
+  for (int dy = 0; dy < 2; ++dy) {
+    for (int dx = 0; dx < 2; ++dx) {
+      const int x = sx + dx;
+      const int y = sy + dy;
+      if (x < 0 || y < 0 || x >= s.cols || y >= s.rows) {
+        continue;
+      }
+      const uchar *p = s.at(x, y);
+      for (int c = 0; c < 3; ++c) {
+        acc[c] += p[c] * wx[dx] * wy[dy];
+      }
+    }
+  }
+  for (int c = 0; c < 3; ++c) {
+    o[c] = (uchar)((acc[c] + 128) >> 8);
+  }
+}
+
+static void bilinear_row_ref(const RemapSrc &s, const short *xy,
+                             const uchar *f, uchar *o, int n) {
+  for (int x = 0; x < n; ++x, o += 3) {
+    bilinear_px(s, xy[2 * x], xy[2 * x + 1], f[x], o);
+  }
+}
+
+static void nearest_row(const RemapSrc &s, const short *xy, const uchar *f,
+                        uchar *o, int n) {
+  for (int x = 0; x < n; ++x, o += 3) {
+    // fractions of 8/16 and up round to the next tap
+    const int sx = xy[2 * x] + ((f[x] >> 3) & 1);
+    const int sy = xy[2 * x + 1] + (f[x] >> 7);
+    if ((unsigned)sx < (unsigned)s.cols && (unsigned)sy < (unsigned)s.rows) {
+      const uchar *p = s.at(sx, sy);
+      o[0] = p[0];
+      o[1] = p[1];
+      o[2] = p[2];
+    } else {
+      o[0] = o[1] = o[2] = 0;
+    }
+  }
+}
+
+#if REMAP_HAVE_X86
+// one pixel per register: lanes 0-2 the left taps, 3-5 the right ones
+__attribute__((target("sse4.1"))) static void
+bilinear_row_sse41(const RemapSrc &s, const short *xy, const uchar *f,
+                   uchar *o, int n) {
+  const __m128i k16 = _mm_set1_epi16(16);
+  const __m128i k128 = _mm_set1_epi16(128);
+  for (int x = 0; x < n; ++x, o += 3) {
+    const int sx = xy[2 * x];
+    const int sy = xy[2 * x + 1];
+    if (!s.fast(sx, sy)) {
+      bilinear_px(s, sx, sy, f[x], o);
+      continue;
+    }
+    const uchar *p0 = s.at(sx, sy);
+    const __m128i wx = _mm_set1_epi16(f[x] & 15);
+    const __m128i wy = _mm_set1_epi16(f[x] >> 4);
+    __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)p0));
+    __m128i b =
+        _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(p0 + s.step)));
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(k16, wy)),
+                              _mm_mullo_epi16(b, wy));
+    __m128i r = _mm_srli_si128(t, 6);
+    __m128i v = _mm_add_epi16(_mm_mullo_epi16(t, _mm_sub_epi16(k16, wx)),
+                              _mm_mullo_epi16(r, wx));
+    v = _mm_srli_epi16(_mm_add_epi16(v, k128), 8);
+    const uint32_t px = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+    memcpy(o, &px, 3);
+  }
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+remap_pair_u8(const uchar *a, const uchar *b) {
+  return _mm256_cvtepu8_epi16(
+      _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)a),
+                         _mm_loadl_epi64((const __m128i *)b)));
+}
+
+// two pixels per register, one per 128 bit lane
+__attribute__((target("avx2"))) static void
+bilinear_row_avx2(const RemapSrc &s, const short *xy, const uchar *f,
+                  uchar *o, int n) {
+  const __m256i k16 = _mm256_set1_epi16(16);
+  const __m256i k128 = _mm256_set1_epi16(128);
+  int x = 0;
+  for (; x + 2 <= n; x += 2, o += 6) {
+    const int sx0 = xy[2 * x], sy0 = xy[2 * x + 1];
+    const int sx1 = xy[2 * x + 2], sy1 = xy[2 * x + 3];
+    if (!s.fast(sx0, sy0) || !s.fast(sx1, sy1)) {
+      bilinear_px(s, sx0, sy0, f[x], o);
+      bilinear_px(s, sx1, sy1, f[x + 1], o + 3);
+      continue;
+    }
+    const uchar *p0 = s.at(sx0, sy0);
+    const uchar *p1 = s.at(sx1, sy1);
+    const __m256i wx = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(
+        _mm_set1_epi8(f[x] & 15), _mm_set1_epi8(f[x + 1] & 15)));
+    const __m256i wy = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(
+        _mm_set1_epi8(f[x] >> 4), _mm_set1_epi8(f[x + 1] >> 4)));
+    __m256i a = remap_pair_u8(p0, p1);
+    __m256i b = remap_pair_u8(p0 + s.step, p1 + s.step);
+    __m256i t =
+        _mm256_add_epi16(_mm256_mullo_epi16(a, _mm256_sub_epi16(k16, wy)),
+                         _mm256_mullo_epi16(b, wy));
+    __m256i r = _mm256_srli_si256(t, 6);
+    __m256i v =
+        _mm256_add_epi16(_mm256_mullo_epi16(t, _mm256_sub_epi16(k16, wx)),
+                         _mm256_mullo_epi16(r, wx));
+    v = _mm256_srli_epi16(_mm256_add_epi16(v, k128), 8);
+    v = _mm256_packus_epi16(v, v);
+    const uint32_t px0 = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(v));
+    const uint32_t px1 =
+        (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(v, 1));
+    memcpy(o, &px0, 3);
+    memcpy(o + 3, &px1, 3);
+  }
+  bilinear_row_ref(s, xy + 2 * x, f + x, o, n - x);
+}
+#endif
+
+#if REMAP_HAVE_NEON
+static void bilinear_row_neon(const RemapSrc &s, const short *xy,
+                              const uchar *f, uchar *o, int n) {
+  for (int x = 0; x < n; ++x, o += 3) {
+    const int sx = xy[2 * x];
+    const int sy = xy[2 * x + 1];
+    if (!s.fast(sx, sy)) {
+      bilinear_px(s, sx, sy, f[x], o);
+      continue;
+    }
+    const uchar *p0 = s.at(sx, sy);
+    const uint16_t fx = f[x] & 15;
+    const uint16_t fy = f[x] >> 4;
+    uint16x8_t a = vmovl_u8(vld1_u8(p0));
+    uint16x8_t b = vmovl_u8(vld1_u8(p0 + s.step));
+    uint16x8_t t = vmlaq_n_u16(vmulq_n_u16(a, 16 - fy), b, fy);
+    uint16x8_t r = vextq_u16(t, t, 3);
+    uint16x8_t v = vmlaq_n_u16(vmulq_n_u16(t, 16 - fx), r, fx);
+    uint8_t px[8];
+    vst1_u8(px, vrshrn_n_u16(v, 8));
+    memcpy(o, px, 3);
+  }
+}
+#endif
+
+static void bilinear_row(const RemapSrc &s, const short *xy, const uchar *f,
+                         uchar *o, int n, BlendIsa isa) {
+  switch (isa) {
+#if REMAP_HAVE_X86
+  case BLEND_ISA_SSE41:
+    bilinear_row_sse41(s, xy, f, o, n);
+    return;
+  case BLEND_ISA_AVX2:
+    bilinear_row_avx2(s, xy, f, o, n);
+    return;
+#endif
+#if REMAP_HAVE_NEON
+  case BLEND_ISA_NEON:
+    bilinear_row_neon(s, xy, f, o, n);
+    return;
+#endif
+  default:
+    bilinear_row_ref(s, xy, f, o, n);
+    return;
+  }
+}
+
+void remap_tiled(const cv::Mat &src, const RemapLut &lut, cv::Mat &dst,
+                 RemapMode mode, const GainLut *gain, BlendIsa isa) {
+  AVM_TRACE_SCOPE("remap_tiled");
+  dst.create(lut.xy.size(), CV_8UC3);
+  const RemapSrc s = {src.data, src.step, src.cols, src.rows};
+
+  for (int ty = 0; ty < dst.rows; ty += remap_tile_h) {
+    const int y_end = std::min(ty + remap_tile_h, dst.rows);
+    for (int tx = 0; tx < dst.cols; tx += remap_tile_w) {
+      const int n = std::min(remap_tile_w, dst.cols - tx);
+      for (int y = ty; y < y_end; ++y) {
+        const short *xy = lut.xy.ptr<short>(y) + 2 * tx;
+        const uchar *f = lut.frac.ptr(y) + tx;
+        uchar *o = dst.ptr(y) + 3 * tx;
+        if (mode == REMAP_NEAREST) {
+          nearest_row(s, xy, f, o, n);
+        } else {
+          bilinear_row(s, xy, f, o, n, isa);
+        }
+        if (gain) {
+          // the tile row is still in l1
+          for (int x = 0; x < n; ++x, o += 3) {
+            o[0] = gain->b[o[0]];
+            o[1] = gain->g[o[1]];
+            o[2] = gain->r[o[2]];
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,63 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef REMAP_SIMD_H
+#define REMAP_SIMD_H
+
+#include "blend_simd.h"
+#include "common.h"
+
+// fixed geometry remap of bgr frames with a compact lut.
+// per output pixel the lut holds the int16 source x, y of the top left tap
+// and one byte of 4 bit fractions (x in the low nibble, y in the high one):
+// 5 bytes per output pixel, against 6 for the CV_16SC2 + CV_16UC1 maps of
+// cv::remap, and it is the only table a stitch lut keeps. bilinear weights
+// are products of the two fractions, so
+//   o = round(sum(tap * wx * wy) / 256), taps outside the frame read black.
+// the output is walked in tiles so the source rows of a tile stay in
+// cache, a steep fisheye warp walked row by row sweeps a long arc of the
+// frame per output row instead. every simd path is bit-exact with the
+// scalar one, taps are loaded per pixel (no gathers)
+
+enum RemapMode {
+  REMAP_BILINEAR = 0, // tiled kernel, 4 bit bilinear
+  REMAP_NEAREST,      // tiled kernel, nearest tap
+  REMAP_OPENCV,       // cv::remap on tables expanded from the lut per call
+};
+
+const char *remap_mode_name(RemapMode mode);
+// "bilinear", "nearest" or "opencv"
+bool parse_remap_mode(const std::string &name, RemapMode &mode);
+
+// output tile walked at a time, 64 x 16 pixels
+const int remap_tile_w = 64;
+const int remap_tile_h = 16;
+
+struct RemapLut {
+  cv::Mat xy;   // CV_16SC2 source tap, floor of the 4 bit rounded coords
+  cv::Mat frac; // CV_8UC1 fx | fy << 4
+};
+
+// lut bytes per output pixel
+const int remap_lut_bytes = 5;
+
+// from the fixed point maps of cv::convertMaps (CV_16SC2 + CV_16UC1 with
+// cv::INTER_BITS fractions), the coords are rounded to 1/16 pixel
+void build_remap_lut(const cv::Mat &map1, const cv::Mat &map2,
+                     RemapLut &lut);
+
+// the cv::remap tables of a lut, map1 shares lut.xy and map2 is a fresh
+// CV_16UC1. for the opencv reference path, not kept between frames
+void remap_lut_maps(const RemapLut &lut, cv::Mat &map1, cv::Mat &map2);
+
+// src CV_8UC3 into dst (lut sized, CV_8UC3). gain, if set, is applied to
+// every written pixel. REMAP_OPENCV is not handled here
+void remap_tiled(const cv::Mat &src, const RemapLut &lut, cv::Mat &dst,
+                 RemapMode mode, const GainLut *gain = nullptr,
+                 BlendIsa isa = blend_best_isa());
+
+#endif
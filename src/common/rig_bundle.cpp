@@ -0,0 +1,420 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "rig_bundle.h"
+#include "avm_pipeline.h"
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// on disk layout: header, section table, then the 64 byte aligned sections
+struct RigBundleHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t checksum;
+  uint64_t file_size;
+  uint32_t section_count;
+  uint32_t section_offset;
+  int32_t mosaic_w; // layout constants of prms.hpp the lut was built for
+  int32_t mosaic_h;
+  int32_t car_rect[4];
+};
+
+struct RigSectionEntry {
+  uint32_t type;
+  uint32_t index;
+  uint64_t offset;
+  uint64_t size;
+  int32_t rows;
+  int32_t cols;
+  int32_t mat_type;
+  int32_t step; // bytes per row, rows keep the padding of the source mat
+};
+
+enum RigSectionType {
+  RIG_CAMERA_MATRIX = 1,
+  RIG_DIST_COEFF,
+  RIG_PROJECT_MATRIX,
+  RIG_SCALE_XY,
+  RIG_SHIFT_XY,
+  RIG_RESOLUTION,
+  RIG_LUT_LAYOUT, // CV_32S, see lut_layout_*
+  RIG_LUT_XY,     // RemapLut::xy, index: body 0-3, corner 4 + 2 * i + j
+  RIG_LUT_FRAC,   // RemapLut::frac
+  RIG_WEIGHTS,
+  RIG_CAR_IMAGE,
+};
+
+const char rig_magic[4] = {'A', 'V', 'M', 'R'};
+const uint32_t rig_version = 3;
+const size_t rig_align = 64;
+
+// lut layout: corner weights, then x, y, w, h, cam of the 12 regions
+const int lut_layout_regions = 12;
+const int lut_layout_size = 4 + 5 * lut_layout_regions;
+
+// fnv-1a 64
+inline void hash_bytes(uint64_t &h, const void *data, size_t len) {
+  const uchar *p = (const uchar *)data;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+}
+
+bool hash_file(uint64_t &h, const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    return false;
+  }
+  char buf[1 << 16];
+  while (ifs.read(buf, sizeof(buf)) || ifs.gcount() > 0) {
+    hash_bytes(h, buf, (size_t)ifs.gcount());
+  }
+  return true;
+}
+
+size_t align_up(size_t v) { return (v + rig_align - 1) & ~(rig_align - 1); }
+
+LutRegion &lut_region(StitchLut &lut, int r) {
+  return r < 4 ? lut.body[r] : lut.corner[(r - 4) / 2][(r - 4) % 2];
+}
+
+struct PendingSection {
+  RigSectionEntry entry;
+  cv::Mat mat;
+};
+
+void add_section(std::vector<PendingSection> &sections, uint32_t type,
+                 uint32_t index, const cv::Mat &mat) {
+  PendingSection s;
+  memset(&s.entry, 0, sizeof(s.entry));
+  s.entry.type = type;
+  s.entry.index = index;
+  s.entry.rows = mat.rows;
+  s.entry.cols = mat.cols;
+  s.entry.mat_type = mat.type();
+  s.entry.step = (int32_t)mat.step[0];
+  s.entry.size = (uint64_t)mat.rows * mat.step[0];
+  s.mat = mat;
+  sections.push_back(s);
+}
+
+// the kind is hashed too, a full bundle never passes as a calibration one
+uint64_t source_checksum(const std::string &data_path, bool assets) {
+  uint64_t h = 14695981039346656037ULL;
+  const int layout[8] = {(int)rig_version, assets, total_w, total_h,
+                         xl, xr, yt, yb};
+  hash_bytes(h, layout, sizeof(layout));
+
+  for (int i = 0; i < 4; ++i) {
+    if (!hash_file(h, data_path + "/yaml/" + camera_names[i] + ".yaml")) {
+      return 0;
+    }
+  }
+  if (assets && (!hash_file(h, data_path + "/yaml/weights.png") ||
+                 !hash_file(h, data_path + "/images/car.png"))) {
+    return 0;
+  }
+  return h;
+}
+
+bool write_bundle(const std::string &path, const std::string &data_path,
+                  bool assets) {
+  uint64_t checksum = source_checksum(data_path, assets);
+  if (checksum == 0) {
+    std::cerr << "rig bundle: source files missing under " << data_path
+              << "\r\n";
+    return false;
+  }
+
+  cv::Mat car_img;
+  std::vector<cv::Mat> weights;
+  CameraPrms prms[4];
+  StitchLut lut;
+  if (assets ? !loadAvmData(data_path, car_img, weights, prms)
+             : !loadAvmCalibration(data_path, prms)) {
+    return false;
+  }
+  if (!updateStitchLut(prms, default_view, lut)) {
+    return false;
+  }
+
+  std::vector<PendingSection> sections;
+  for (uint32_t i = 0; i < 4; ++i) {
+    const CameraPrms &prm = prms[i];
+    add_section(sections, RIG_CAMERA_MATRIX, i, prm.camera_matrix);
+    add_section(sections, RIG_DIST_COEFF, i, prm.dist_coff);
+    add_section(sections, RIG_PROJECT_MATRIX, i, prm.project_matrix);
+    add_section(sections, RIG_SCALE_XY, i, prm.scale_xy);
+    add_section(sections, RIG_SHIFT_XY, i, prm.shift_xy);
+    cv::Mat res(1, 2, CV_32S);
+    res.ptr<int>()[0] = prm.size.width;
+    res.ptr<int>()[1] = prm.size.height;
+    add_section(sections, RIG_RESOLUTION, i, res);
+  }
+
+  cv::Mat layout(1, lut_layout_size, CV_32S);
+  int *l = layout.ptr<int>();
+  for (int i = 0; i < 4; ++i) {
+    l[i] = lut.corner_weight[i];
+  }
+  for (int r = 0; r < lut_layout_regions; ++r) {
+    const LutRegion &region = lut_region(lut, r);
+    int *p = l + 4 + 5 * r;
+    p[0] = region.roi.x;
+    p[1] = region.roi.y;
+    p[2] = region.roi.width;
+    p[3] = region.roi.height;
+    p[4] = region.cam;
+    add_section(sections, RIG_LUT_XY, r, region.remap.xy);
+    add_section(sections, RIG_LUT_FRAC, r, region.remap.frac);
+  }
+  add_section(sections, RIG_LUT_LAYOUT, 0, layout);
+
+  if (assets) {
+    for (uint32_t i = 0; i < weights.size(); ++i) {
+      add_section(sections, RIG_WEIGHTS, i, weights[i]);
+    }
+    add_section(sections, RIG_CAR_IMAGE, 0, car_img);
+  }
+
+  RigBundleHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, rig_magic, 4);
+  hdr.version = rig_version;
+  hdr.checksum = checksum;
+  hdr.section_count = (uint32_t)sections.size();
+  hdr.section_offset = (uint32_t)align_up(sizeof(hdr));
+  hdr.mosaic_w = lut.size.width;
+  hdr.mosaic_h = lut.size.height;
+  hdr.car_rect[0] = lut.car.x;
+  hdr.car_rect[1] = lut.car.y;
+  hdr.car_rect[2] = lut.car.width;
+  hdr.car_rect[3] = lut.car.height;
+
+  size_t offset =
+      align_up(hdr.section_offset + sections.size() * sizeof(RigSectionEntry));
+  for (auto &s : sections) {
+    s.entry.offset = offset;
+    offset = align_up(offset + s.entry.size);
+  }
+  hdr.file_size = offset;
+
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+
+  // write to a temp file first so a crash never leaves a truncated bundle
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+      std::cerr << "rig bundle: open " << tmp << " failed\r\n";
+      return false;
+    }
+    const char zeros[rig_align] = {0};
+    auto pad_to = [&](size_t pos) {
+      size_t cur = (size_t)ofs.tellp();
+      if (pos > cur) {
+        ofs.write(zeros, pos - cur);
+      }
+    };
+
+    ofs.write((const char *)&hdr, sizeof(hdr));
+    pad_to(hdr.section_offset);
+    for (const auto &s : sections) {
+      ofs.write((const char *)&s.entry, sizeof(s.entry));
+    }
+    for (const auto &s : sections) {
+      pad_to(s.entry.offset);
+      for (int y = 0; y < s.mat.rows; ++y) {
+        ofs.write((const char *)s.mat.ptr(y), s.mat.cols * s.mat.elemSize());
+        pad_to(s.entry.offset + (y + 1) * (size_t)s.entry.step);
+      }
+    }
+    pad_to(hdr.file_size);
+    if (!ofs) {
+      std::cerr << "rig bundle: write " << tmp << " failed\r\n";
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+  return !ec;
+}
+
+} // namespace
+
+uint64_t rig_source_checksum(const std::string &data_path) {
+  return source_checksum(data_path, true);
+}
+
+uint64_t rig_calibration_checksum(const std::string &data_path) {
+  return source_checksum(data_path, false);
+}
+
+std::string rig_bundle_path(const std::string &data_path) {
+  return data_path + "/cache/rig.bundle";
+}
+
+std::string rig_calibration_bundle_path(const std::string &data_path) {
+  return data_path + "/cache/rig_calibration.bundle";
+}
+
+bool write_rig_bundle(const std::string &path, const std::string &data_path) {
+  return write_bundle(path, data_path, true);
+}
+
+bool write_rig_calibration_bundle(const std::string &path,
+                                  const std::string &data_path) {
+  return write_bundle(path, data_path, false);
+}
+
+RigBundle::RigBundle() : m_data(nullptr), m_size(0) {}
+
+RigBundle::~RigBundle() { close(); }
+
+bool RigBundle::open(const std::string &path, uint64_t checksum) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RigBundleHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  // everything is touched before the first frame anyway
+  madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+  m_data = (const uchar *)data;
+  m_size = (size_t)st.st_size;
+
+  const RigBundleHeader *hdr = (const RigBundleHeader *)m_data;
+  bool ok = !memcmp(hdr->magic, rig_magic, 4) && hdr->version == rig_version &&
+            hdr->file_size == m_size && hdr->mosaic_w == total_w &&
+            hdr->mosaic_h == total_h &&
+            hdr->section_offset + (uint64_t)hdr->section_count *
+                                      sizeof(RigSectionEntry) <=
+                m_size &&
+            (checksum == 0 || hdr->checksum == checksum);
+  if (!ok) {
+    close();
+  }
+  return ok;
+}
+
+void RigBundle::close() {
+  if (m_data) {
+    munmap((void *)m_data, m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+bool RigBundle::section(uint32_t type, uint32_t index, cv::Mat &mat) const {
+  if (!m_data) {
+    return false;
+  }
+  const RigBundleHeader *hdr = (const RigBundleHeader *)m_data;
+  const RigSectionEntry *entries =
+      (const RigSectionEntry *)(m_data + hdr->section_offset);
+
+  for (uint32_t i = 0; i < hdr->section_count; ++i) {
+    const RigSectionEntry &e = entries[i];
+    if (e.type != type || e.index != index) {
+      continue;
+    }
+    if (e.offset + e.size > m_size || e.rows < 0 || e.cols < 0 ||
+        (uint64_t)e.cols * CV_ELEM_SIZE(e.mat_type) > (uint64_t)e.step ||
+        (uint64_t)e.rows * e.step != e.size) {
+      return false;
+    }
+    // header only, the data stays in the mapping
+    mat = cv::Mat(e.rows, e.cols, e.mat_type, (void *)(m_data + e.offset),
+                  (size_t)e.step);
+    return true;
+  }
+  return false;
+}
+
+bool RigBundle::cameraPrms(CameraPrms prms[4]) const {
+  for (uint32_t i = 0; i < 4; ++i) {
+    CameraPrms &prm = prms[i];
+    cv::Mat res;
+    prm.name = camera_names[i];
+    if (!section(RIG_CAMERA_MATRIX, i, prm.camera_matrix) ||
+        !section(RIG_DIST_COEFF, i, prm.dist_coff) ||
+        !section(RIG_PROJECT_MATRIX, i, prm.project_matrix) ||
+        !section(RIG_SCALE_XY, i, prm.scale_xy) ||
+        !section(RIG_SHIFT_XY, i, prm.shift_xy) ||
+        !section(RIG_RESOLUTION, i, res) || res.total() != 2) {
+      return false;
+    }
+    prm.size = cv::Size(res.ptr<int>()[0], res.ptr<int>()[1]);
+  }
+  return true;
+}
+
+bool RigBundle::stitchLut(StitchLut &lut) const {
+  cv::Mat layout;
+  if (!section(RIG_LUT_LAYOUT, 0, layout) ||
+      layout.type() != CV_32S || (int)layout.total() != lut_layout_size) {
+    return false;
+  }
+
+  const RigBundleHeader *hdr = (const RigBundleHeader *)m_data;
+  const int *l = layout.ptr<int>();
+  lut.size = cv::Size(hdr->mosaic_w, hdr->mosaic_h);
+  lut.car = cv::Rect(hdr->car_rect[0], hdr->car_rect[1], hdr->car_rect[2],
+                     hdr->car_rect[3]);
+  for (int i = 0; i < 4; ++i) {
+    lut.corner_weight[i] = l[i];
+  }
+  for (int r = 0; r < lut_layout_regions; ++r) {
+    LutRegion &region = lut_region(lut, r);
+    const int *p = l + 4 + 5 * r;
+    region.roi = cv::Rect(p[0], p[1], p[2], p[3]);
+    region.cam = p[4];
+    if (!section(RIG_LUT_XY, r, region.remap.xy) ||
+        !section(RIG_LUT_FRAC, r, region.remap.frac) ||
+        region.remap.xy.type() != CV_16SC2 ||
+        region.remap.frac.type() != CV_8UC1 ||
+        region.remap.xy.size() != region.roi.size() ||
+        region.remap.frac.size() != region.roi.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RigBundle::blendWeights(std::vector<cv::Mat> &weights) const {
+  weights.resize(4);
+  for (uint32_t i = 0; i < 4; ++i) {
+    if (!section(RIG_WEIGHTS, i, weights[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RigBundle::carImage(cv::Mat &car_img) const {
+  return section(RIG_CAR_IMAGE, 0, car_img);
+}
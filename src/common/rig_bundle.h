@@ -0,0 +1,70 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef RIG_BUNDLE_H
+#define RIG_BUNDLE_H
+
+#include "common.h"
+#include "stitch_lut.h"
+#include <cstdint>
+
+// everything the 2d apps load at startup in one binary file:
+// calibration of the four cameras, the stitch lut of the default view,
+// the 8-bit blend weight planes and the resized car image.
+// sections are 64 byte aligned raw mat rows so the file is mmap'ed and
+// used in place, nothing is parsed or copied.
+// the bundle carries a checksum of its source files (yaml, weights.png,
+// car.png) and is rejected once any of them changes.
+// a calibration bundle holds the calibration and the lut only, for the
+// rigs of a farm that share one car image and weight set: it neither needs
+// nor hashes the pngs of the rig
+
+// fnv-1a 64 over the source files under data_path and the mosaic layout
+uint64_t rig_source_checksum(const std::string &data_path);
+// same over the yaml files only
+uint64_t rig_calibration_checksum(const std::string &data_path);
+
+// default bundle locations, <data_path>/cache/rig.bundle and
+// <data_path>/cache/rig_calibration.bundle
+std::string rig_bundle_path(const std::string &data_path);
+std::string rig_calibration_bundle_path(const std::string &data_path);
+
+// build every section from the source files and write the bundle
+bool write_rig_bundle(const std::string &path, const std::string &data_path);
+// calibration and lut sections only, from the yaml files
+bool write_rig_calibration_bundle(const std::string &path,
+                                  const std::string &data_path);
+
+class RigBundle {
+public:
+  RigBundle();
+  ~RigBundle();
+
+  RigBundle(const RigBundle &) = delete;
+  RigBundle &operator=(const RigBundle &) = delete;
+
+  // map the file and check magic, version, layout and checksum.
+  // checksum 0 skips the source check
+  bool open(const std::string &path, uint64_t checksum);
+  void close();
+  bool isOpen() const { return m_data != nullptr; }
+
+  // the mats below point into the mapping (read only), they stay valid
+  // until close(). a calibration bundle has no weights or car image
+  bool cameraPrms(CameraPrms prms[4]) const;
+  bool stitchLut(StitchLut &lut) const;
+  bool blendWeights(std::vector<cv::Mat> &weights) const;
+  bool carImage(cv::Mat &car_img) const;
+
+private:
+  bool section(uint32_t type, uint32_t index, cv::Mat &mat) const;
+
+  const uchar *m_data;
+  size_t m_size;
+};
+
+#endif
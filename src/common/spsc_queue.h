@@ -0,0 +1,120 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// bounded lock-free single producer / single consumer queue of pointers.
+// head and tail only grow, slot i % capacity holds element i.
+// when full, push can drop the oldest element: producer and consumer both
+// take an element by moving head forward with a cas, so exactly one of
+// them owns it and the dropped pointer goes back to the producer
+template <typename T> class SpscQueue {
+public:
+  explicit SpscQueue(int capacity)
+      : m_slots(capacity > 0 ? capacity : 1), m_head(0), m_tail(0),
+        m_pushed(0), m_dropped(0) {
+    for (auto &s : m_slots) {
+      s.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  int capacity() const { return (int)m_slots.size(); }
+
+  // elements waiting, exact only from the producer or consumer thread
+  int size() const {
+    uint64_t t = m_tail.load(std::memory_order_acquire);
+    uint64_t h = m_head.load(std::memory_order_acquire);
+    return t > h ? (int)(t - h) : 0;
+  }
+
+  uint64_t pushed() const { return m_pushed.load(std::memory_order_relaxed); }
+  uint64_t dropped() const {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+  // producer only. false when full
+  bool tryPush(T *item) {
+    const uint64_t t = m_tail.load(std::memory_order_relaxed);
+    if (t - m_head.load(std::memory_order_acquire) >= m_slots.size()) {
+      return false;
+    }
+    publish(t, item);
+    return true;
+  }
+
+  // producer only. never blocks, returns the dropped oldest element (to be
+  // recycled by the caller) or nullptr
+  T *pushDropOldest(T *item) {
+    const uint64_t t = m_tail.load(std::memory_order_relaxed);
+    uint64_t h = m_head.load(std::memory_order_acquire);
+    T *dropped = nullptr;
+    if (t - h >= m_slots.size() &&
+        m_head.compare_exchange_strong(h, h + 1, std::memory_order_acq_rel)) {
+      // slot h is ours now, the consumer's cas on it can only fail
+      dropped = m_slots[h % m_slots.size()].load(std::memory_order_acquire);
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    // a failed cas means the consumer made room meanwhile
+    publish(t, item);
+    return dropped;
+  }
+
+  // consumer only. nullptr when empty
+  T *tryPop() {
+    uint64_t h = m_head.load(std::memory_order_acquire);
+    while (h != m_tail.load(std::memory_order_acquire)) {
+      T *item = m_slots[h % m_slots.size()].load(std::memory_order_acquire);
+      // may race with a drop on the same element, the cas decides
+      if (m_head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel)) {
+        return item;
+      }
+    }
+    return nullptr;
+  }
+
+  // consumer only. spins briefly then sleeps, gives up once stop is set
+  T *popWait(const std::atomic<bool> &stop) {
+    for (int spin = 0;; ++spin) {
+      if (T *item = tryPop()) {
+        return item;
+      }
+      if (stop.load(std::memory_order_acquire)) {
+        return tryPop();
+      }
+      if (spin < 64) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+    }
+  }
+
+private:
+  void publish(uint64_t t, T *item) {
+    m_slots[t % m_slots.size()].store(item, std::memory_order_release);
+    m_tail.store(t + 1, std::memory_order_release);
+    m_pushed.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::vector<std::atomic<T *>> m_slots;
+  alignas(64) std::atomic<uint64_t> m_head; // consumer (and drops)
+  alignas(64) std::atomic<uint64_t> m_tail; // producer
+  std::atomic<uint64_t> m_pushed;
+  std::atomic<uint64_t> m_dropped;
+};
+
+#endif
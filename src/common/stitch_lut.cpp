@@ -0,0 +1,432 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "stitch_lut.h"
+#include "blend_simd.h"
+#include "trace.h"
+#include <cmath>
+#include <cstring>
+
+// coords far outside any frame, remap fills them with the border (black)
+static const float invalid_coord = -1024.0f;
+
+cv::Size RigLayout::projectSize(int cam) const {
+  // front / back are horizontal strips, left / right are rotated into place
+  return cam % 2 == 0 ? cv::Size(total_w, yt) : cv::Size(total_h, xl);
+}
+
+bool RigLayout::operator==(const RigLayout &o) const {
+  return total_w == o.total_w && total_h == o.total_h && xl == o.xl &&
+         xr == o.xr && yt == o.yt && yb == o.yb;
+}
+
+RigLayout default_rig_layout() {
+  return RigLayout{total_w, total_h, xl, xr, yt, yb};
+}
+
+bool load_rig_layout(const std::string &data_path, RigLayout &layout) {
+  layout = default_rig_layout();
+  const std::string path = data_path + "/yaml/layout.yaml";
+  cv::FileStorage fs;
+  if (!fs.open(path, cv::FileStorage::READ)) {
+    return true;
+  }
+  fs["total_w"] >> layout.total_w;
+  fs["total_h"] >> layout.total_h;
+  fs["xl"] >> layout.xl;
+  fs["xr"] >> layout.xr;
+  fs["yt"] >> layout.yt;
+  fs["yb"] >> layout.yb;
+  if (layout.xl <= 0 || layout.xr <= layout.xl ||
+      layout.total_w <= layout.xr || layout.yt <= 0 ||
+      layout.yb <= layout.yt || layout.total_h <= layout.yb) {
+    std::cerr << "bad layout " << path << "\r\n";
+    return false;
+  }
+  // nv12 chroma is 2x2, every edge of the mosaic has to be even.
+  // scale_edge would round odd edges silently and move the regions
+  if ((layout.total_w | layout.total_h | layout.xl | layout.xr | layout.yt |
+       layout.yb) & 1) {
+    std::cerr << "bad layout " << path << ", total_w / total_h / xl / xr / "
+              << "yt / yb must be even\r\n";
+    return false;
+  }
+  return true;
+}
+
+// top-left of the rotated projected image of each camera in the mosaic
+static cv::Point camera_place(int cam, const RigLayout &layout) {
+  switch (cam) {
+  case 2: // back
+    return cv::Point(0, layout.yb);
+  case 3: // right
+    return cv::Point(layout.xr, 0);
+  default: // front, left
+    return cv::Point(0, 0);
+  }
+}
+
+// pixel of the rotated image -> pixel of the projected image (undo rotate)
+static inline void unrotate(const char *flip, double x, double y, int w,
+                            int h, double &px, double &py) {
+  if (!strcmp(flip, "r+")) { // ROTATE_90_CLOCKWISE
+    px = y;
+    py = h - 1 - x;
+  } else if (!strcmp(flip, "r-")) { // ROTATE_90_COUNTERCLOCKWISE
+    px = w - 1 - y;
+    py = x;
+  } else if (!strcmp(flip, "m")) { // ROTATE_180
+    px = w - 1 - x;
+    py = h - 1 - y;
+  } else {
+    px = x;
+    py = y;
+  }
+}
+
+bool project_mosaic_points(const CameraPrms &prm,
+                           const cv::Mat &project_matrix, int cam,
+                           const RigLayout &layout,
+                           const std::vector<cv::Point2d> &pts,
+                           std::vector<cv::Point2f> &raw,
+                           std::vector<uchar> &valid) {
+  cv::Mat new_camera_matrix;
+  if (!get_undist_camera_matrix(prm, new_camera_matrix) ||
+      project_matrix.empty()) {
+    return false;
+  }
+
+  cv::Mat h_inv;
+  project_matrix.convertTo(h_inv, CV_64F);
+  h_inv = h_inv.inv();
+  const double *h = h_inv.ptr<double>();
+  const double *k = new_camera_matrix.ptr<double>();
+
+  const cv::Size proj = layout.projectSize(cam);
+  const cv::Point place = camera_place(cam, layout);
+
+  // undistorted pixel -> normalized coords, the fisheye model does the rest
+  std::vector<cv::Point2f> undist_pts(pts.size());
+  valid.assign(pts.size(), 0);
+  for (size_t i = 0; i < pts.size(); ++i) {
+    double px, py;
+    unrotate(camera_flip_mir[cam], pts[i].x - place.x, pts[i].y - place.y,
+             proj.width, proj.height, px, py);
+
+    double w = h[6] * px + h[7] * py + h[8];
+    if (w <= 0) {
+      continue;
+    }
+    double u = (h[0] * px + h[1] * py + h[2]) / w;
+    double v = (h[3] * px + h[4] * py + h[5]) / w;
+    if (u < 0 || v < 0 || u > prm.size.width - 1 ||
+        v > prm.size.height - 1) {
+      continue;
+    }
+    undist_pts[i] = cv::Point2f((float)((u - k[2]) / k[0]),
+                                (float)((v - k[5]) / k[4]));
+    valid[i] = 1;
+  }
+
+  cv::fisheye::distortPoints(undist_pts, raw, prm.camera_matrix,
+                             prm.dist_coff);
+  return true;
+}
+
+// mosaic rect -> raw fisheye coords of one camera. roi is in the output
+// mosaic, scale (output / full mosaic per axis) maps it back to the full
+// mosaic the projections are defined on
+static bool build_region(const CameraPrms &prm, const cv::Mat &project_matrix,
+                         int cam, const cv::Rect &roi, const cv::Point2d &scale,
+                         const RigLayout &layout, LutRegion &region) {
+  // pixel centers of the output onto the full mosaic, exact at scale 1
+  std::vector<cv::Point2d> pts;
+  pts.reserve(roi.area());
+  for (int y = roi.y; y < roi.y + roi.height; ++y) {
+    const double fy = (y + 0.5) / scale.y - 0.5;
+    for (int x = roi.x; x < roi.x + roi.width; ++x) {
+      pts.push_back(cv::Point2d((x + 0.5) / scale.x - 0.5, fy));
+    }
+  }
+
+  std::vector<cv::Point2f> raw_pts;
+  std::vector<uchar> valid;
+  if (!project_mosaic_points(prm, project_matrix, cam, layout, pts, raw_pts,
+                             valid)) {
+    return false;
+  }
+
+  cv::Mat map(roi.size(), CV_32FC2);
+  int idx = 0;
+  for (int y = 0; y < roi.height; ++y) {
+    float *m = map.ptr<float>(y);
+    for (int x = 0; x < roi.width; ++x, ++idx) {
+      m[2 * x + 0] = valid[idx] ? raw_pts[idx].x : invalid_coord;
+      m[2 * x + 1] = valid[idx] ? raw_pts[idx].y : invalid_coord;
+    }
+  }
+
+  // the convertMaps tables only live until the compact lut is built
+  cv::Mat map1, map2;
+  cv::convertMaps(map, cv::Mat(), map1, map2, CV_16SC2);
+  region.roi = roi;
+  region.cam = cam;
+  build_remap_lut(map1, map2, region.remap);
+  return true;
+}
+
+// layout edges scaled to even pixels so the regions still tile the mosaic
+// and stay valid for nv12
+static int scale_edge(int v, double scale) {
+  return 2 * (int)std::lround(v * scale / 2);
+}
+
+bool build_stitch_lut(const CameraPrms prms[4], const cv::Mat project_matrix[4],
+                      StitchLut &lut, double scale, const RigLayout &layout) {
+  if (scale <= 0 || scale > 1) {
+    std::cerr << "bad lut scale " << scale << "\r\n";
+    return false;
+  }
+  // mosaic layout, same as the copy/merge order of the original pipeline
+  const int X[4] = {0, scale_edge(layout.xl, scale),
+                    scale_edge(layout.xr, scale),
+                    scale_edge(layout.total_w, scale)};
+  const int Y[4] = {0, scale_edge(layout.yt, scale),
+                    scale_edge(layout.yb, scale),
+                    scale_edge(layout.total_h, scale)};
+  auto rect = [&](int x0, int y0, int x1, int y1) {
+    return cv::Rect(X[x0], Y[y0], X[x1] - X[x0], Y[y1] - Y[y0]);
+  };
+  const cv::Rect body_rois[4] = {
+      rect(1, 0, 2, 1), // front
+      rect(0, 1, 1, 2), // left
+      rect(1, 2, 2, 3), // back
+      rect(2, 1, 3, 2), // right
+  };
+  const cv::Rect corner_rois[4] = {
+      rect(0, 0, 1, 1), // left top
+      rect(2, 0, 3, 1), // right top
+      rect(0, 2, 1, 3), // left bottom
+      rect(2, 2, 3, 3)  // right bottom
+  };
+
+  lut.size = cv::Size(X[3], Y[3]);
+  lut.car = rect(1, 1, 2, 2);
+  const cv::Point2d axis_scale((double)X[3] / layout.total_w,
+                               (double)Y[3] / layout.total_h);
+
+  for (int i = 0; i < 4; ++i) {
+    if (!build_region(prms[i], project_matrix[i], i, body_rois[i],
+                      axis_scale, layout, lut.body[i])) {
+      std::cerr << "build lut failed for " << prms[i].name << "\r\n";
+      return false;
+    }
+  }
+
+  for (int i = 0; i < 4; ++i) {
+    lut.corner_weight[i] = stitch_corner_weights[i];
+    for (int j = 0; j < 2; ++j) {
+      int cam = stitch_corner_cams[i][j];
+      if (!build_region(prms[cam], project_matrix[cam], cam, corner_rois[i],
+                        axis_scale, layout, lut.corner[i][j])) {
+        std::cerr << "build lut failed for " << prms[cam].name << "\r\n";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// bilinear remap with the fixed point maps of convertMaps (same weights and
+// rounding as cv::remap INTER_LINEAR), every sample goes through the gain
+// table so the frames never need a separate dgain pass
+static void remap_gain(const cv::Mat &src, cv::Mat &dst, const cv::Mat &map1,
+                       const cv::Mat &map2, const GainLut &gain) {
+  const int bits = cv::INTER_BITS;
+  const int mask = (1 << bits) - 1;
+  const int shift = 2 * bits;
+  const int max_x = src.cols - 1;
+  const int max_y = src.rows - 1;
+
+  dst.create(map1.size(), CV_8UC3);
+  for (int y = 0; y < dst.rows; ++y) {
+    const short *xy = map1.ptr<short>(y);
+    const ushort *fxy = map2.ptr<ushort>(y);
+    uchar *o = dst.ptr(y);
+
+    for (int x = 0; x < dst.cols; ++x, o += 3) {
+      const int sx = xy[2 * x + 0];
+      const int sy = xy[2 * x + 1];
+      const int fx = fxy[x] & mask;
+      const int fy = fxy[x] >> bits;
+      const int w00 = ((1 << bits) - fx) * ((1 << bits) - fy);
+      const int w01 = fx * ((1 << bits) - fy);
+      const int w10 = ((1 << bits) - fx) * fy;
+      const int w11 = fx * fy;
+
+      int acc[3];
+      if (sx >= 0 && sy >= 0 && sx < max_x && sy < max_y) {
+        const uchar *p0 = src.ptr(sy) + 3 * sx;
+        const uchar *p1 = p0 + src.step;
+        for (int c = 0; c < 3; ++c) {
+          acc[c] = p0[c] * w00 + p0[c + 3] * w01 + p1[c] * w10 +
+                   p1[c + 3] * w11;
+        }
+      } else {
+        // border taps read as black
+        const int tx[4] = {sx, sx + 1, sx, sx + 1};
+        const int ty[4] = {sy, sy, sy + 1, sy + 1};
+        const int tw[4] = {w00, w01, w10, w11};
+        acc[0] = acc[1] = acc[2] = 0;
+        for (int t = 0; t < 4; ++t) {
+          if (tx[t] < 0 || ty[t] < 0 || tx[t] > max_x || ty[t] > max_y) {
+            continue;
+          }
+          const uchar *p = src.ptr(ty[t]) + 3 * tx[t];
+          for (int c = 0; c < 3; ++c) {
+            acc[c] += p[c] * tw[t];
+          }
+        }
+      }
+
+      const int round = 1 << (shift - 1);
+      o[0] = gain.b[(acc[0] + round) >> shift];
+      o[1] = gain.g[(acc[1] + round) >> shift];
+      o[2] = gain.r[(acc[2] + round) >> shift];
+    }
+  }
+}
+
+static void sample_region(const cv::Mat &src, const LutRegion &region,
+                          cv::Mat &dst, RemapMode mode,
+                          const GainLut *gains) {
+  if (mode != REMAP_OPENCV) {
+    remap_tiled(src, region.remap, dst, mode,
+                gains ? &gains[region.cam] : nullptr);
+    return;
+  }
+  // reference path, the cv::remap tables are not stored in the lut
+  cv::Mat map1, map2;
+  remap_lut_maps(region.remap, map1, map2);
+  if (gains) {
+    remap_gain(src, dst, map1, map2, gains[region.cam]);
+  } else {
+    cv::remap(src, dst, map1, map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+  }
+}
+
+void stitch_prepare(const StitchLut &lut, const cv::Mat &car_img,
+                    cv::Mat &out) {
+  AVM_TRACE_SCOPE("stitch_prepare");
+  out.create(lut.size, CV_8UC3);
+
+  cv::Mat car_roi = out(lut.car);
+  car_img.copyTo(car_roi);
+}
+
+void stitch_body(const std::vector<cv::Mat *> &srcs, const StitchLut &lut,
+                 int i, cv::Mat &out, RemapMode remap,
+                 const GainLut *gains) {
+  AVM_TRACE_SCOPE("stitch_body");
+  // single camera regions are written into the mosaic in place
+  const LutRegion &region = lut.body[i];
+  cv::Mat dst = out(region.roi);
+  sample_region(*srcs[region.cam], region, dst, remap, gains);
+}
+
+void stitch_corner(const std::vector<cv::Mat *> &srcs, const StitchLut &lut,
+                   int i, const std::vector<cv::Mat> &merge_weights_img,
+                   cv::Mat &out, StitchScratch &scratch,
+                   const GainLut *gains) {
+  AVM_TRACE_SCOPE("stitch_corner");
+  // overlap corners are sampled from both cameras then blended
+  for (int j = 0; j < 2; ++j) {
+    const LutRegion &region = lut.corner[i][j];
+    sample_region(*srcs[region.cam], region, scratch.corner[i][j],
+                  scratch.options.remap, gains);
+  }
+  const cv::Mat &weight = merge_weights_img[lut.corner_weight[i]];
+  const cv::Rect &roi = lut.corner[i][0].roi;
+  const int bands = std::min(std::max(scratch.options.bands, 1),
+                             multiband_max_bands(roi.size()));
+  if (bands <= 1) {
+    blend_image(scratch.corner[i][0], scratch.corner[i][1], weight,
+                out(roi));
+    return;
+  }
+
+  // weight pyramids are built once per plane, not per frame
+  std::unique_ptr<MultiBandBlender> &blender = scratch.multiband[i];
+  if (!blender || blender->size() != roi.size() ||
+      blender->bands() != bands) {
+    blender = std::make_unique<MultiBandBlender>(roi.size(), bands);
+  }
+  if (!blender->prepared(weight)) {
+    blender->prepare(weight);
+  }
+  blender->blend(scratch.corner[i][0], scratch.corner[i][1], out(roi));
+}
+
+void stitch_by_lut(const std::vector<cv::Mat *> &srcs, const StitchLut &lut,
+                   const cv::Mat &car_img,
+                   const std::vector<cv::Mat> &merge_weights_img,
+                   cv::Mat &out, StitchScratch &scratch, ThreadPool *pool,
+                   const GainLut *gains) {
+  if (srcs.size() != 4 || merge_weights_img.size() != 4) {
+    return;
+  }
+
+  stitch_prepare(lut, car_img, out);
+
+  if (!pool) {
+    for (int i = 0; i < 4; ++i) {
+      stitch_body(srcs, lut, i, out, scratch.options.remap, gains);
+    }
+    for (int i = 0; i < 4; ++i) {
+      stitch_corner(srcs, lut, i, merge_weights_img, out, scratch, gains);
+    }
+    return;
+  }
+
+  // regions never overlap, so bodies and corners can all run at once
+  pool->parallelFor(8, [&](int i) {
+    if (i < 4) {
+      stitch_body(srcs, lut, i, out, scratch.options.remap, gains);
+    } else {
+      stitch_corner(srcs, lut, i - 4, merge_weights_img, out, scratch, gains);
+    }
+  });
+}
+
+void scale_stitch_assets(const StitchLut &lut, const cv::Mat &car_img,
+                         const std::vector<cv::Mat> &merge_weights_img,
+                         cv::Mat &car_out,
+                         std::vector<cv::Mat> &weights_out) {
+  if (car_img.size() == lut.car.size()) {
+    car_out = car_img;
+  } else {
+    cv::resize(car_img, car_out, lut.car.size(), 0, 0, cv::INTER_AREA);
+  }
+
+  // each plane blends exactly one corner, resize it to that corner and
+  // keep the 64 byte row alignment of load_blend_weights
+  weights_out = merge_weights_img;
+  for (int i = 0; i < 4; ++i) {
+    const int k = lut.corner_weight[i];
+    const cv::Size size = lut.corner[i][0].roi.size();
+    if (k < 0 || k >= (int)merge_weights_img.size() ||
+        merge_weights_img[k].size() == size) {
+      continue;
+    }
+    cv::Mat plane(size.height, (size.width + 63) & ~63,
+                  merge_weights_img[k].type(), cv::Scalar(0));
+    weights_out[k] = plane.colRange(0, size.width);
+    cv::resize(merge_weights_img[k], weights_out[k], size, 0, 0,
+               cv::INTER_AREA);
+  }
+}
@@ -0,0 +1,127 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef STITCH_LUT_H
+#define STITCH_LUT_H
+
+#include "common.h"
+#include "multiband_blend.h"
+#include "remap_simd.h"
+#include "thread_pool.h"
+#include <memory>
+
+// mosaic layout of one rig. the car rect edges split the mosaic into the
+// body and corner regions, prms.hpp holds the default
+struct RigLayout {
+  int total_w;
+  int total_h;
+  int xl, xr; // car rect left / right edge
+  int yt, yb; // car rect top / bottom edge
+
+  // projected image of a camera before rotation, see project_shapes
+  cv::Size projectSize(int cam) const;
+  bool operator==(const RigLayout &o) const;
+};
+
+RigLayout default_rig_layout();
+// yaml/layout.yaml under data_path (total_w, total_h, xl, xr, yt, yb),
+// the default when there is none. false for a broken file or odd edges
+bool load_rig_layout(const std::string &data_path, RigLayout &layout);
+
+// one mosaic rect sampled straight from one raw fisheye frame
+struct LutRegion {
+  cv::Rect roi;   // rect in the mosaic
+  int cam;        // index into camera_names
+  RemapLut remap; // source taps and 4 bit fractions, the only table kept
+};
+
+// fused undistort + project + rotate + place lookup table for one view
+struct StitchLut {
+  cv::Size size;           // mosaic size
+  cv::Rect car;            // car overlay rect
+  LutRegion body[4];       // regions covered by a single camera
+  LutRegion corner[4][2];  // overlap corners: [0] front/back, [1] left/right
+  int corner_weight[4];    // blend weight plane used by each corner
+};
+
+// cameras of the overlap corners (left top, right top, left bottom, right
+// bottom) and the blend weight plane of the first camera of each
+static const int stitch_corner_cams[4][2] = {{0, 1}, {0, 3}, {2, 1}, {2, 3}};
+static const int stitch_corner_weights[4] = {2, 1, 0, 3};
+
+// how one stitcher samples and blends, set per rig (StitcherConfig) or per
+// pipeline, never process wide
+struct StitchOptions {
+  // kernel the bgr path samples the frames with. the yuv path always
+  // samples bilinear from the same lut
+  RemapMode remap = REMAP_BILINEAR;
+  // pyramid levels of the bgr corner blend, 1 is the per pixel blend_image,
+  // more bands blend low frequencies over a wider seam
+  int bands = 1;
+};
+
+// per frame scratch used for the corner samples before blending, and the
+// options of the stitcher that owns it
+struct StitchScratch {
+  StitchOptions options;
+  cv::Mat corner[4][2];
+  // multi-band corner blending only, pyramids kept across frames
+  std::unique_ptr<MultiBandBlender> multiband[4];
+  // yuv input only: the car image and the mosaic in nv12
+  cv::Mat car_nv12;
+  cv::Mat mosaic_nv12;
+};
+
+// raw fisheye pixels of camera cam for points on the full size mosaic
+// plane, the ground. points past the mosaic edges extend the ground plane.
+// valid is 0 where a point is behind the camera or outside its undistorted
+// view
+bool project_mosaic_points(const CameraPrms &prm,
+                           const cv::Mat &project_matrix, int cam,
+                           const RigLayout &layout,
+                           const std::vector<cv::Point2d> &pts,
+                           std::vector<cv::Point2f> &raw,
+                           std::vector<uchar> &valid);
+
+// build the lut from calibration and the (view dependent) project matrices.
+// scale in (0, 1] shrinks the mosaic, the frames are then sampled directly
+// at the output resolution instead of downscaling a full mosaic
+bool build_stitch_lut(const CameraPrms prms[4], const cv::Mat project_matrix[4],
+                      StitchLut &lut, double scale = 1.0,
+                      const RigLayout &layout = default_rig_layout());
+// car image and blend weight planes resized to the rects of a scaled lut,
+// shared as they are at full scale
+void scale_stitch_assets(const StitchLut &lut, const cv::Mat &car_img,
+                         const std::vector<cv::Mat> &merge_weights_img,
+                         cv::Mat &car_out, std::vector<cv::Mat> &weights_out);
+// sample every mosaic pixel from the raw frames in a single pass,
+// merge_weights_img are the CV_8UC1 planes from load_blend_weights.
+// gains (one table per camera, see awb_gain_luts) are applied to the
+// samples as they are written, nullptr leaves the colors alone.
+// scratch.options picks the remap kernel and the corner blend.
+// with a pool the eight regions are stitched concurrently
+void stitch_by_lut(const std::vector<cv::Mat *> &srcs, const StitchLut &lut,
+                   const cv::Mat &car_img,
+                   const std::vector<cv::Mat> &merge_weights_img,
+                   cv::Mat &out, StitchScratch &scratch,
+                   ThreadPool *pool = nullptr,
+                   const GainLut *gains = nullptr);
+
+// the steps of stitch_by_lut, for callers scheduling (or timing) them.
+// stitch_prepare allocates the mosaic and places the car, then every body
+// i and corner i in [0, 4) may run on its own thread
+void stitch_prepare(const StitchLut &lut, const cv::Mat &car_img,
+                    cv::Mat &out);
+void stitch_body(const std::vector<cv::Mat *> &srcs, const StitchLut &lut,
+                 int i, cv::Mat &out, RemapMode remap = REMAP_BILINEAR,
+                 const GainLut *gains = nullptr);
+void stitch_corner(const std::vector<cv::Mat *> &srcs, const StitchLut &lut,
+                   int i, const std::vector<cv::Mat> &merge_weights_img,
+                   cv::Mat &out, StitchScratch &scratch,
+                   const GainLut *gains = nullptr);
+
+#endif
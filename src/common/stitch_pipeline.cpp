@@ -0,0 +1,164 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "stitch_pipeline.h"
+#include "trace.h"
+
+StitchPipeline::StitchPipeline(FrameSource &source, cv::Mat &car_img,
+                               std::vector<cv::Mat> &merge_weights_img,
+                               CameraPrms prms[4], ThreadPool &pool,
+                               int awb_step, int captureDepth, int outputDepth,
+                               int lutCacheSize, double scale)
+    : m_source(source), m_carImg(car_img), m_weights(merge_weights_img),
+      m_pool(pool), m_awbStep(awb_step),
+      m_luts(prms, lutCacheSize, scale), m_captureQueue(captureDepth),
+      m_outputQueue(outputDepth),
+      // every mosaic is either queued, displayed or being stitched
+      m_freeQueue(std::max(outputDepth, 1) + 2), m_stop(false),
+      m_captureDone(false), m_stitchDone(false), m_lastWaitMs(0) {
+  for (int i = 0; i < m_freeQueue.capacity(); ++i) {
+    m_frames.push_back(std::make_unique<StitchedFrame>());
+    m_freeQueue.tryPush(m_frames.back().get());
+  }
+}
+
+StitchPipeline::~StitchPipeline() { stop(); }
+
+bool StitchPipeline::start(const ViewpointParams &view,
+                           const StitchLut *lut) {
+  if (lut && m_luts.scale() == 1.0) {
+    m_luts.insert(view, std::make_shared<StitchLut>(*lut));
+  }
+  if (!m_luts.load(view)) {
+    return false;
+  }
+  // the rects only depend on the scale, one resize serves every view
+  scale_stitch_assets(*m_luts.current(), m_carImg, m_weights, m_levelCar,
+                      m_levelWeights);
+  m_luts.start();
+
+  m_stop = false;
+  m_captureDone = false;
+  m_stitchDone = false;
+  m_captureThread = std::thread(&StitchPipeline::captureLoop, this);
+  m_stitchThread = std::thread(&StitchPipeline::stitchLoop, this);
+  return true;
+}
+
+void StitchPipeline::stop() {
+  m_stop = true;
+  // wakes the capture stage if it is blocked in acquire()
+  m_source.stop();
+  if (m_captureThread.joinable()) {
+    m_captureThread.join();
+  }
+  if (m_stitchThread.joinable()) {
+    m_stitchThread.join();
+  }
+  m_luts.stop();
+}
+
+void StitchPipeline::setView(const ViewpointParams &view) {
+  m_luts.request(view);
+}
+
+void StitchPipeline::captureLoop() {
+  trace_thread_name("capture");
+  while (!m_stop) {
+    FrameSet *set = m_source.acquire();
+    if (!set) {
+      break;
+    }
+    // stitch stage behind: the stalest set goes straight back to the source
+    if (FrameSet *dropped = m_captureQueue.pushDropOldest(set)) {
+      m_source.release(dropped);
+    }
+  }
+  m_captureDone = true;
+}
+
+void StitchPipeline::stitchLoop() {
+  trace_thread_name("stitch");
+  const double ms = 1000.0 / cv::getTickFrequency();
+  // mosaics handed back by drops, only this thread touches them
+  std::vector<StitchedFrame *> spare;
+
+  while (!m_stop) {
+    int64 t0 = cv::getTickCount();
+    FrameSet *set = m_captureQueue.popWait(m_captureDone);
+    if (!set) {
+      break;
+    }
+    int64 t1 = cv::getTickCount();
+
+    StitchedFrame *out = nullptr;
+    if (!spare.empty()) {
+      out = spare.back();
+      spare.pop_back();
+    } else {
+      out = m_freeQueue.popWait(m_stop);
+    }
+    if (!out) {
+      m_source.release(set);
+      break;
+    }
+
+    // held for the whole frame, an eviction meanwhile cannot free it
+    std::shared_ptr<const StitchLut> lut = m_luts.current();
+    out->view_pending = m_luts.pending();
+    processFrame(*set, m_levelCar, m_levelWeights, *lut, m_scratch, m_pool,
+                 m_awbStep, out->mosaic, out->times);
+    int64 t2 = cv::getTickCount();
+
+    out->index = set->index;
+    out->load_ms = set->load_ms;
+    out->ready_tick = set->ready_tick;
+    out->wait_ms = (t1 - t0) * ms;
+    out->process_ms = (t2 - t1) * ms;
+    m_source.release(set);
+
+    // display behind: drop its oldest mosaic and reuse the buffer
+    if (StitchedFrame *dropped = m_outputQueue.pushDropOldest(out)) {
+      spare.push_back(dropped);
+    }
+  }
+  m_stitchDone = true;
+}
+
+StitchedFrame *StitchPipeline::acquire() {
+  AVM_TRACE_SCOPE("pipeline_acquire");
+  int64 t0 = cv::getTickCount();
+  StitchedFrame *frame = m_outputQueue.popWait(m_stitchDone);
+  m_lastWaitMs = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+  return frame;
+}
+
+void StitchPipeline::release(StitchedFrame *frame) {
+  if (frame) {
+    m_freeQueue.tryPush(frame);
+  }
+}
+
+static QueueStatus queue_status(int size, int capacity, uint64_t pushed,
+                                uint64_t dropped) {
+  QueueStatus s;
+  s.size = size;
+  s.capacity = capacity;
+  s.pushed = pushed;
+  s.dropped = dropped;
+  return s;
+}
+
+QueueStatus StitchPipeline::captureStatus() const {
+  return queue_status(m_captureQueue.size(), m_captureQueue.capacity(),
+                      m_captureQueue.pushed(), m_captureQueue.dropped());
+}
+
+QueueStatus StitchPipeline::outputStatus() const {
+  return queue_status(m_outputQueue.size(), m_outputQueue.capacity(),
+                      m_outputQueue.pushed(), m_outputQueue.dropped());
+}
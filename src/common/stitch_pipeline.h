@@ -0,0 +1,110 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef STITCH_PIPELINE_H
+#define STITCH_PIPELINE_H
+
+#include "avm_pipeline.h"
+#include "spsc_queue.h"
+#include "view_lut_cache.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// one mosaic handed to the display stage
+struct StitchedFrame {
+  cv::Mat mosaic;
+  int64_t index;      // frame number in the source
+  double load_ms;     // decode time of the source set
+  double wait_ms;     // stitch stage waiting for the set
+  double process_ms;  // balance + stitch
+  StageTimes times;
+  int64 ready_tick;   // when the source set was decoded
+  bool view_pending;  // stitched with the last lut, the new view is building
+};
+
+// fill of one queue between two stages
+struct QueueStatus {
+  int size;
+  int capacity;
+  uint64_t pushed;
+  uint64_t dropped;
+};
+
+// capture -> balance + stitch -> display, one thread per stage and the
+// display on the caller's thread. stages are linked by lock-free spsc
+// queues that drop the oldest entry when the next stage falls behind, so
+// latency stays bounded by the queue depths.
+// the frame source ring needs captureDepth + 2 slots.
+// view luts come from a cache (lutCacheSize entries) rebuilt in the
+// background, a view change never stalls the stitch stage.
+// scale < 1 stitches a smaller mosaic straight from the frames, the full
+// size car image and weights are resized to it once at start
+class StitchPipeline {
+public:
+  StitchPipeline(FrameSource &source, cv::Mat &car_img,
+                 std::vector<cv::Mat> &merge_weights_img, CameraPrms prms[4],
+                 ThreadPool &pool, int awb_step, int captureDepth = 2,
+                 int outputDepth = 2, int lutCacheSize = 8,
+                 double scale = 1.0);
+  ~StitchPipeline();
+
+  // builds the lut for the first view (or takes a prebuilt one for it,
+  // e.g. from the rig bundle, used at full scale only), then starts the
+  // stage threads
+  bool start(const ViewpointParams &view, const StitchLut *lut = nullptr);
+  void stop();
+
+  // remap kernel and corner blend, before start()
+  void setStitchOptions(const StitchOptions &options) {
+    m_scratch.options = options;
+  }
+
+  // cached luts switch at the next frame, others once built
+  void setView(const ViewpointParams &view);
+  ViewLutCache &lutCache() { return m_luts; }
+
+  // display side. blocks until a mosaic is ready, nullptr at end of
+  // stream. the frame (and its mosaic) is the caller's until release()
+  StitchedFrame *acquire();
+  void release(StitchedFrame *frame);
+
+  // time the last acquire() spent waiting for the stitch stage
+  double lastWaitMs() const { return m_lastWaitMs; }
+  QueueStatus captureStatus() const;
+  QueueStatus outputStatus() const;
+
+private:
+  void captureLoop();
+  void stitchLoop();
+
+  FrameSource &m_source;
+  cv::Mat &m_carImg;
+  std::vector<cv::Mat> &m_weights;
+  cv::Mat m_levelCar;                 // m_carImg at the lut scale
+  std::vector<cv::Mat> m_levelWeights; // m_weights at the lut scale
+  ThreadPool &m_pool;
+  int m_awbStep;
+
+  ViewLutCache m_luts;
+  StitchScratch m_scratch; // owned by the stitch stage
+
+  std::vector<std::unique_ptr<StitchedFrame>> m_frames;
+  SpscQueue<FrameSet> m_captureQueue;     // capture -> stitch
+  SpscQueue<StitchedFrame> m_outputQueue; // stitch -> display
+  SpscQueue<StitchedFrame> m_freeQueue;   // display -> stitch, recycled
+
+  std::thread m_captureThread;
+  std::thread m_stitchThread;
+  std::atomic<bool> m_stop;
+  std::atomic<bool> m_captureDone;
+  std::atomic<bool> m_stitchDone;
+
+  double m_lastWaitMs;
+};
+
+#endif
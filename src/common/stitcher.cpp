@@ -0,0 +1,93 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "stitcher.h"
+#include "trace.h"
+
+std::shared_ptr<const StitchAssets>
+load_stitch_assets(const std::string &data_path) {
+  auto assets = std::make_shared<StitchAssets>();
+  CameraPrms prms[4];
+  StitchLut lut;
+  if (!loadAvmBundle(data_path, assets->bundle, assets->car_img,
+                     assets->merge_weights_img, prms, lut)) {
+    return nullptr;
+  }
+  return assets;
+}
+
+Stitcher::Stitcher(ThreadPool &pool, std::shared_ptr<const StitchAssets> assets)
+    : m_pool(pool), m_assets(std::move(assets)),
+      m_layout(default_rig_layout()), m_frames(0), m_firstTick(0),
+      m_lastTick(0), m_processMs(0), m_times() {}
+
+bool Stitcher::load(const StitcherConfig &config) {
+  AVM_TRACE_SCOPE("stitcher_load");
+  m_config = config;
+  if (!m_assets || !load_rig_layout(config.data_path, m_layout)) {
+    return false;
+  }
+
+  // calibration and the default view lut of this rig, car image and
+  // weights come from the shared assets only
+  if (!loadAvmCalibrationBundle(config.data_path, m_bundle, m_prms, m_lut)) {
+    return false;
+  }
+  const ViewpointParams &v = config.view;
+  const bool bundle_view = v.height == default_view.height &&
+                           v.angle == default_view.angle &&
+                           v.tilt == default_view.tilt &&
+                           v.zoom == default_view.zoom;
+  if (!bundle_view || config.scale != 1.0 ||
+      !(m_layout == default_rig_layout())) {
+    if (!updateStitchLut(m_prms, config.view, m_lut, config.scale,
+                         m_layout)) {
+      return false;
+    }
+  }
+
+  // shared as they are unless the rects differ
+  scale_stitch_assets(m_lut, m_assets->car_img, m_assets->merge_weights_img,
+                      m_carImg, m_weights);
+  m_scratch = StitchScratch();
+  m_scratch.options = config.stitch;
+  return true;
+}
+
+void Stitcher::process(FrameSet &frames, cv::Mat &out) {
+  StageTimes times;
+  int64 t0 = cv::getTickCount();
+  processFrame(frames, m_carImg, m_weights, m_lut, m_scratch, m_pool,
+               m_config.awb_step, out, times);
+  int64 t1 = cv::getTickCount();
+
+  std::lock_guard<std::mutex> lock(m_statsMutex);
+  if (m_frames == 0) {
+    m_firstTick = t0;
+  }
+  ++m_frames;
+  m_lastTick = t1;
+  m_processMs += (t1 - t0) * 1000.0 / cv::getTickFrequency();
+  m_times.balance += times.balance;
+  m_times.body += times.body;
+  m_times.corner += times.corner;
+}
+
+StitcherStats Stitcher::stats() const {
+  std::lock_guard<std::mutex> lock(m_statsMutex);
+  StitcherStats s = {m_frames, 0, 0, {0, 0, 0}};
+  if (m_frames == 0) {
+    return s;
+  }
+  const double secs = (m_lastTick - m_firstTick) / cv::getTickFrequency();
+  s.fps = secs > 0 ? m_frames / secs : 0;
+  s.process_ms = m_processMs / m_frames;
+  s.times.balance = m_times.balance / m_frames;
+  s.times.body = m_times.body / m_frames;
+  s.times.corner = m_times.corner / m_frames;
+  return s;
+}
@@ -0,0 +1,86 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef STITCHER_H
+#define STITCHER_H
+
+#include "avm_pipeline.h"
+#include <memory>
+#include <mutex>
+
+// read only assets every rig of a vehicle model stitches with, loaded once
+// and shared. the mats point into the mapping of bundle
+struct StitchAssets {
+  RigBundle bundle;
+  cv::Mat car_img;
+  std::vector<cv::Mat> merge_weights_img;
+};
+
+// car image and blend weights under data_path
+std::shared_ptr<const StitchAssets>
+load_stitch_assets(const std::string &data_path);
+
+struct StitcherConfig {
+  std::string name;      // label of the metrics
+  std::string data_path; // yaml (calibration, optional layout) of the rig
+  ViewpointParams view = default_view;
+  double scale = 1.0;
+  int awb_step = 4;
+  StitchOptions stitch; // remap kernel and corner blend of this rig
+};
+
+struct StitcherStats {
+  uint64_t frames;
+  double fps;        // since the first frame
+  double process_ms; // mean balance + stitch
+  StageTimes times;  // means
+};
+
+// one rig: calibration, layout, lut and scratch of its own, nothing in
+// globals, so any number of stitchers run side by side on one shared pool.
+// process() is called from one thread at a time, stats() from any
+class Stitcher {
+public:
+  Stitcher(ThreadPool &pool, std::shared_ptr<const StitchAssets> assets);
+
+  Stitcher(const Stitcher &) = delete;
+  Stitcher &operator=(const Stitcher &) = delete;
+
+  bool load(const StitcherConfig &config);
+  // white balance + stitching of one frame set into out
+  void process(FrameSet &frames, cv::Mat &out);
+
+  const std::string &name() const { return m_config.name; }
+  const RigLayout &layout() const { return m_layout; }
+  // size of the mosaics process() writes, known after load()
+  cv::Size mosaicSize() const { return m_lut.size; }
+  StitcherStats stats() const;
+
+private:
+  ThreadPool &m_pool;
+  std::shared_ptr<const StitchAssets> m_assets;
+  StitcherConfig m_config;
+
+  RigBundle m_bundle; // calibration bundle, the default view lut points
+                      // into it
+  CameraPrms m_prms[4];
+  RigLayout m_layout;
+  StitchLut m_lut;
+  // the shared assets, or copies resized to this rig's layout / scale
+  cv::Mat m_carImg;
+  std::vector<cv::Mat> m_weights;
+  StitchScratch m_scratch;
+
+  mutable std::mutex m_statsMutex;
+  uint64_t m_frames;
+  int64 m_firstTick;
+  int64 m_lastTick;
+  double m_processMs;
+  StageTimes m_times; // sums
+};
+
+#endif
@@ -0,0 +1,211 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// the pool and deque index of the current thread, if it is a worker
+static thread_local const ThreadPool *tls_pool = nullptr;
+static thread_local int tls_index = -1;
+
+ThreadPool::ThreadPool(int threads, const std::vector<int> &cores)
+    : m_nextQueue(0), m_steals(0), m_generation(0), m_stop(false) {
+  if (threads <= 0) {
+    threads = (int)std::thread::hardware_concurrency();
+  }
+  for (int i = 1; i < threads; ++i) {
+    m_queues.push_back(std::make_unique<Queue>());
+  }
+  for (int i = 1; i < threads; ++i) {
+    m_workers.emplace_back(&ThreadPool::workerLoop, this, i - 1);
+    if (!cores.empty()) {
+      pin_thread(m_workers.back(), cores[i % cores.size()]);
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto &t : m_workers) {
+    t.join();
+  }
+}
+
+void ThreadPool::runJob(Job &job) {
+  for (int i = job.next.fetch_add(1); i < job.count;
+       i = job.next.fetch_add(1)) {
+    (*job.fn)(i);
+    job.remaining.fetch_sub(1);
+  }
+}
+
+ThreadPool::Job *ThreadPool::findJob(int self) {
+  const int n = (int)m_queues.size();
+  for (int k = 0; k < n; ++k) {
+    const int q = (self + k) % n;
+    Queue &queue = *m_queues[q];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    // own deque newest first (nested jobs are still hot), others oldest first
+    auto take = [&](Job *job) {
+      if (job->next.load() >= job->count) {
+        return false;
+      }
+      job->refs.fetch_add(1);
+      return true;
+    };
+    if (k == 0) {
+      for (auto it = queue.jobs.rbegin(); it != queue.jobs.rend(); ++it) {
+        if (take(*it)) {
+          return *it;
+        }
+      }
+    } else {
+      for (Job *job : queue.jobs) {
+        if (take(job)) {
+          m_steals.fetch_add(1);
+          return job;
+        }
+      }
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPool::release(Job *job) {
+  // the caller may free the job as soon as refs drops, touch only the pool
+  job->refs.fetch_sub(1);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_done.notify_all();
+}
+
+void ThreadPool::workerLoop(int self) {
+  trace_thread_name("pool worker");
+  tls_pool = this;
+  tls_index = self;
+  while (true) {
+    uint64_t seen;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop) {
+        return;
+      }
+      seen = m_generation;
+    }
+
+    if (Job *job = findJob(self)) {
+      runJob(*job);
+      release(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+  }
+}
+
+void ThreadPool::parallelFor(int n, const std::function<void(int)> &fn) {
+  if (n <= 0) {
+    return;
+  }
+  if (m_workers.empty() || n == 1) {
+    for (int i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  Job job;
+  job.fn = &fn;
+  job.count = n;
+  job.next = 0;
+  job.remaining = n;
+  job.refs = 0;
+
+  // a worker keeps its nested jobs local, other threads spread them
+  const int q = tls_pool == this
+                    ? tls_index
+                    : (int)(m_nextQueue.fetch_add(1) % m_queues.size());
+  Queue &queue = *m_queues[q];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(&job);
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_generation;
+  }
+  m_wake.notify_all();
+
+  runJob(job);
+
+  // no worker can pick the job up once it is off the deque
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.erase(std::find(queue.jobs.begin(), queue.jobs.end(), &job));
+  }
+
+  // wait for the tasks and for every worker to let go of this job
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock,
+              [&] { return job.remaining.load() == 0 && job.refs.load() == 0; });
+}
+
+bool parse_core_list(const std::string &spec, std::vector<int> &cores) {
+  cores.clear();
+  std::stringstream ss(spec);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    int first = 0, last = 0;
+    char dash = 0;
+    const int n = sscanf(item.c_str(), "%d%c%d", &first, &dash, &last);
+    if (n == 1) {
+      last = first;
+    } else if (n != 3 || dash != '-') {
+      return false;
+    }
+    if (first < 0 || last < first) {
+      return false;
+    }
+    for (int c = first; c <= last; ++c) {
+      cores.push_back(c);
+    }
+  }
+  return !cores.empty();
+}
+
+#ifdef __linux__
+static bool pin_native(pthread_t thread, int core) {
+  if (core < 0 || core >= CPU_SETSIZE) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+bool pin_thread(std::thread &thread, int core) {
+  return pin_native(thread.native_handle(), core);
+}
+
+bool pin_current_thread(int core) { return pin_native(pthread_self(), core); }
+#else
+bool pin_thread(std::thread &, int) { return false; }
+
+bool pin_current_thread(int) { return false; }
+#endif
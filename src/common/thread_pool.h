@@ -0,0 +1,88 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// persistent workers for the per-frame fork/join stages.
+// threads are created once, parallelFor only wakes them up.
+// every worker owns a deque of jobs: a parallelFor from a worker goes onto
+// its own deque, others are spread round robin, and idle workers steal the
+// oldest job of the other deques. any number of threads may submit at once,
+// so one pool serves many rigs stitching side by side
+class ThreadPool {
+public:
+  // threads counts the calling thread too, <= 0 uses every core.
+  // with cores set worker i is pinned to cores[(i + 1) % cores.size()],
+  // cores[0] gets no worker. calling threads may pin themselves anywhere
+  // in the set with pin_current_thread, avm_farm spreads its rig threads
+  // over it round-robin
+  explicit ThreadPool(int threads = 0, const std::vector<int> &cores = {});
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int size() const { return (int)m_workers.size() + 1; }
+
+  // run fn(i) for i in [0, n), the caller works on its own job as well.
+  // returns once every task is done, so each call is a barrier
+  void parallelFor(int n, const std::function<void(int)> &fn);
+
+  // jobs taken from another worker's deque so far
+  uint64_t steals() const { return m_steals; }
+
+private:
+  struct Job {
+    const std::function<void(int)> *fn;
+    int count;
+    std::atomic<int> next;      // next index to claim
+    std::atomic<int> remaining; // indices not finished yet
+    std::atomic<int> refs;      // workers holding the job
+  };
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job *> jobs; // owner takes the back, thieves the front
+  };
+
+  void workerLoop(int self);
+  // claim and run indices of job until none are left
+  static void runJob(Job &job);
+  // one job with unclaimed indices from own deque or stolen, refs taken
+  Job *findJob(int self);
+  void release(Job *job);
+
+  std::vector<std::thread> m_workers;
+  std::vector<std::unique_ptr<Queue>> m_queues; // one per worker
+  std::atomic<uint32_t> m_nextQueue;
+  std::atomic<uint64_t> m_steals;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake; // workers, new job
+  std::condition_variable m_done; // callers, job finished
+  uint64_t m_generation;
+  bool m_stop;
+};
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+bool parse_core_list(const std::string &spec, std::vector<int> &cores);
+// linux only, false elsewhere or when the core does not exist
+bool pin_thread(std::thread &thread, int core);
+bool pin_current_thread(int core);
+
+#endif
@@ -0,0 +1,178 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "trace.h"
+
+#ifdef AVM_ENABLE_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> trace_detail::enabled(false);
+
+namespace {
+
+struct TraceEvent {
+  const char *name;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+};
+
+// written by its own thread only. count is published with release so the
+// dump sees complete events without taking a lock on the hot path
+struct ThreadBuffer {
+  std::vector<TraceEvent> events;
+  std::atomic<int> count{0};
+  std::atomic<int> dropped{0};
+  uint64_t session = 0;
+  int tid = 0;
+  std::string name; // guarded by registry_mutex
+};
+
+std::mutex registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+std::atomic<uint64_t> session(0);
+int capacity = 1 << 16;
+uint64_t origin_ns = 0;
+int next_tid = 1;
+
+thread_local std::shared_ptr<ThreadBuffer> tls_buffer;
+thread_local std::string tls_name;
+
+// first span of a thread in this session, the only locked step
+ThreadBuffer *attach_thread() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  auto buf = std::make_shared<ThreadBuffer>();
+  buf->events.resize(capacity);
+  buf->session = session.load(std::memory_order_relaxed);
+  buf->tid = next_tid++;
+  buf->name = tls_name;
+  registry.push_back(buf);
+  tls_buffer = buf;
+  return buf.get();
+}
+
+void write_json_string(std::ostream &os, const std::string &s) {
+  os << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      os << buf;
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+} // namespace
+
+uint64_t trace_now_ns() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void trace_start(int spans_per_thread) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  // old buffers stay alive in their threads until those record again
+  registry.clear();
+  capacity = std::max(spans_per_thread, 1);
+  origin_ns = trace_now_ns();
+  next_tid = 1;
+  session.fetch_add(1, std::memory_order_relaxed);
+  trace_detail::enabled.store(true, std::memory_order_release);
+}
+
+void trace_stop() {
+  trace_detail::enabled.store(false, std::memory_order_release);
+}
+
+void trace_thread_name(const char *name) {
+  tls_name = name;
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  if (tls_buffer) {
+    tls_buffer->name = tls_name;
+  }
+}
+
+void trace_record(const char *name, uint64_t begin_ns, uint64_t end_ns) {
+  ThreadBuffer *buf = tls_buffer.get();
+  if (!buf || buf->session != session.load(std::memory_order_relaxed)) {
+    buf = attach_thread();
+  }
+
+  int n = buf->count.load(std::memory_order_relaxed);
+  if (n >= (int)buf->events.size()) {
+    buf->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buf->events[n] = {name, begin_ns, end_ns};
+  buf->count.store(n + 1, std::memory_order_release);
+}
+
+bool trace_write_chrome(const std::string &path) {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    std::cerr << "open trace file failed " << path << "\r\n";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+  bool first = true;
+  int64_t total = 0, dropped = 0;
+  char num[64];
+  for (const auto &buf : registry) {
+    if (!first) {
+      ofs << ",";
+    }
+    first = false;
+    std::string name =
+        buf->name.empty() ? "thread " + std::to_string(buf->tid) : buf->name;
+    ofs << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << buf->tid << ",\"args\":{\"name\":";
+    write_json_string(ofs, name);
+    ofs << "}}";
+
+    const int count = buf->count.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+      const TraceEvent &e = buf->events[i];
+      // microseconds with ns resolution
+      snprintf(num, sizeof(num), "%.3f,\"dur\":%.3f",
+               (int64_t)(e.begin_ns - origin_ns) / 1000.0,
+               (e.end_ns - e.begin_ns) / 1000.0);
+      ofs << ",\n{\"name\":";
+      write_json_string(ofs, e.name);
+      ofs << ",\"cat\":\"avm\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf->tid
+          << ",\"ts\":" << num << "}";
+    }
+    total += count;
+    dropped += buf->dropped.load(std::memory_order_relaxed);
+  }
+  ofs << "\n]}\n";
+
+  std::cout << "trace: " << total << " spans from " << registry.size()
+            << " threads written to " << path;
+  if (dropped > 0) {
+    std::cout << " (" << dropped << " dropped, buffers full)";
+  }
+  std::cout << std::endl;
+  return (bool)ofs;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+// scoped span tracing for the per frame hot paths.
+//   AVM_TRACE_SCOPE("stitch_body");
+// every thread appends to its own fixed size buffer, recording a span is
+// two clock reads and a store, no lock. spans past the buffer are dropped.
+// built only with -DAVM_ENABLE_TRACE=ON, otherwise everything compiles out
+
+#ifdef AVM_ENABLE_TRACE
+
+#include <atomic>
+
+namespace trace_detail {
+extern std::atomic<bool> enabled;
+}
+
+// start recording, spans_per_thread is the buffer size of each thread
+void trace_start(int spans_per_thread = 1 << 16);
+void trace_stop();
+inline bool trace_enabled() {
+  return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+// name shown for the calling thread in the timeline
+void trace_thread_name(const char *name);
+// chrome trace-event json (chrome://tracing, perfetto), call after
+// trace_stop() or while the traced threads are idle
+bool trace_write_chrome(const std::string &path);
+
+uint64_t trace_now_ns();
+void trace_record(const char *name, uint64_t begin_ns, uint64_t end_ns);
+
+class TraceScope {
+public:
+  // name must outlive the trace (a string literal)
+  explicit TraceScope(const char *name)
+      : m_name(name), m_begin(trace_enabled() ? trace_now_ns() : 0) {}
+  ~TraceScope() {
+    if (m_begin) {
+      trace_record(m_name, m_begin, trace_now_ns());
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *m_name;
+  uint64_t m_begin;
+};
+
+#define AVM_TRACE_CAT2(a, b) a##b
+#define AVM_TRACE_CAT(a, b) AVM_TRACE_CAT2(a, b)
+#define AVM_TRACE_SCOPE(name)                                                  \
+  TraceScope AVM_TRACE_CAT(avm_trace_scope_, __LINE__)(name)
+
+#else
+
+inline void trace_start(int = 0) {}
+inline void trace_stop() {}
+inline bool trace_enabled() { return false; }
+inline void trace_thread_name(const char *) {}
+inline bool trace_write_chrome(const std::string &) { return false; }
+
+#define AVM_TRACE_SCOPE(name) ((void)0)
+
+#endif
+
+#endif
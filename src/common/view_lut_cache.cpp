@@ -0,0 +1,246 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "view_lut_cache.h"
+#include "trace.h"
+#include <cmath>
+
+ViewKey quantize_view(const ViewpointParams &view) {
+  ViewKey key;
+  key.height = (int)std::lround(view.height * 100);
+  key.angle = (int)std::lround(view.angle * 2) % 720;
+  if (key.angle < 0) {
+    key.angle += 720;
+  }
+  key.tilt = (int)std::lround(view.tilt * 2);
+  key.zoom = (int)std::lround(view.zoom * 100);
+  return key;
+}
+
+ViewpointParams dequantize_view(const ViewKey &key) {
+  ViewpointParams view;
+  view.height = key.height / 100.0f;
+  view.angle = key.angle / 2.0f;
+  view.tilt = key.tilt / 2.0f;
+  view.zoom = key.zoom / 100.0f;
+  return view;
+}
+
+std::vector<ViewpointParams> default_view_presets() {
+  std::vector<ViewpointParams> views;
+  for (int i = 0; i < 4; ++i) {
+    ViewpointParams view = default_view;
+    view.angle = 90.0f * i;
+    views.push_back(view);
+  }
+  return views;
+}
+
+ViewLutCache::ViewLutCache(CameraPrms prms[4], int capacity, double scale)
+    : m_prms(prms), m_capacity(std::max(capacity, 1)), m_scale(scale),
+      m_wanted(),
+      m_currentKey(), m_buildWanted(false), m_buildingKey(),
+      m_building(false), m_running(false), m_hits(0),
+      m_misses(0), m_builds(0), m_buildMs(0) {}
+
+ViewLutCache::~ViewLutCache() { stop(); }
+
+void ViewLutCache::start() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_running) {
+    return;
+  }
+  m_running = true;
+  m_worker = std::thread(&ViewLutCache::workerLoop, this);
+}
+
+void ViewLutCache::stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+  }
+  m_cond.notify_all();
+  if (m_worker.joinable()) {
+    m_worker.join();
+  }
+}
+
+std::shared_ptr<const StitchLut> ViewLutCache::find(const ViewKey &key) {
+  // a handful of entries, a linear scan is cheaper than hashing
+  for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+    if (it->key == key) {
+      m_entries.splice(m_entries.begin(), m_entries, it);
+      return it->lut;
+    }
+  }
+  return nullptr;
+}
+
+void ViewLutCache::store(const ViewKey &key,
+                         std::shared_ptr<const StitchLut> lut) {
+  if (find(key)) {
+    m_entries.front().lut = lut;
+    return;
+  }
+  m_entries.push_front(Entry{key, lut});
+  while ((int)m_entries.size() > m_capacity) {
+    m_entries.pop_back();
+  }
+}
+
+std::shared_ptr<const StitchLut> ViewLutCache::build(const ViewKey &key) {
+  AVM_TRACE_SCOPE("build_view_lut");
+  int64 t0 = cv::getTickCount();
+  auto lut = std::make_shared<StitchLut>();
+  if (!updateStitchLut(m_prms, dequantize_view(key), *lut, m_scale)) {
+    return nullptr;
+  }
+  double ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_buildMs += ms;
+  ++m_builds;
+  return lut;
+}
+
+bool ViewLutCache::load(const ViewpointParams &view) {
+  const ViewKey key = quantize_view(view);
+  std::shared_ptr<const StitchLut> lut;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    lut = find(key);
+  }
+  if (!lut && !(lut = build(key))) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  store(key, lut);
+  m_wanted = key;
+  m_currentKey = key;
+  m_buildWanted = false;
+  std::atomic_store(&m_current, lut);
+  return true;
+}
+
+void ViewLutCache::insert(const ViewpointParams &view,
+                          std::shared_ptr<const StitchLut> lut) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  store(quantize_view(view), lut);
+}
+
+void ViewLutCache::prebake(const std::vector<ViewpointParams> &views) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto &view : views) {
+      m_presets.push_back(quantize_view(view));
+    }
+  }
+  m_cond.notify_all();
+}
+
+void ViewLutCache::request(const ViewpointParams &view) {
+  const ViewKey key = quantize_view(view);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (key == m_wanted) {
+      return;
+    }
+    m_wanted = key;
+    if (auto lut = find(key)) {
+      ++m_hits;
+      m_currentKey = key;
+      m_buildWanted = false;
+      std::atomic_store(&m_current, lut);
+      return;
+    }
+    ++m_misses;
+    // already on the worker, it is swapped in when done
+    m_buildWanted = !(m_building && m_buildingKey == key);
+  }
+  m_cond.notify_all();
+}
+
+bool ViewLutCache::pending() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_currentKey != m_wanted;
+}
+
+ViewLutCacheStats ViewLutCache::stats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ViewLutCacheStats s;
+  s.size = (int)m_entries.size();
+  s.capacity = m_capacity;
+  s.hits = m_hits;
+  s.misses = m_misses;
+  s.builds = m_builds;
+  s.build_ms = m_builds ? m_buildMs / m_builds : 0;
+  return s;
+}
+
+void ViewLutCache::workerLoop() {
+  trace_thread_name("view_lut");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_cond.wait(lock, [this] {
+      return !m_running || m_buildWanted || !m_presets.empty();
+    });
+    if (!m_running) {
+      break;
+    }
+
+    // the requested view goes before presets
+    const bool interactive = m_buildWanted;
+    ViewKey key;
+    if (interactive) {
+      key = m_wanted;
+      m_buildWanted = false;
+    } else {
+      key = m_presets.front();
+      m_presets.pop_front();
+      // presets stay behind the views already in use
+      bool cached = false;
+      for (const auto &e : m_entries) {
+        cached = cached || e.key == key;
+      }
+      if (cached || (int)m_entries.size() >= m_capacity) {
+        continue;
+      }
+    }
+
+    m_building = true;
+    m_buildingKey = key;
+    lock.unlock();
+    std::shared_ptr<const StitchLut> lut = build(key);
+    lock.lock();
+    m_building = false;
+
+    if (!lut) {
+      std::cerr << "build view lut failed, keeping the last view\r\n";
+      // fall back to the current view, so pending() clears and a later
+      // request() for the failed view builds it again
+      if (key == m_wanted) {
+        m_wanted = m_currentKey;
+      }
+      continue;
+    }
+    if (interactive || key == m_wanted) {
+      store(key, lut);
+    } else {
+      // lowest priority, only fills free entries
+      m_entries.push_back(Entry{key, lut});
+      while ((int)m_entries.size() > m_capacity) {
+        m_entries.pop_back();
+      }
+    }
+    // swap in only if still wanted, a newer request may have come meanwhile
+    if (key == m_wanted && key != m_currentKey) {
+      m_currentKey = key;
+      std::atomic_store(&m_current, lut);
+    }
+  }
+}
@@ -0,0 +1,124 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef VIEW_LUT_CACHE_H
+#define VIEW_LUT_CACHE_H
+
+#include "avm_pipeline.h"
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// viewpoint quantized to the lut resolution, the cache key
+struct ViewKey {
+  int height; // 1/100
+  int angle;  // 1/2 deg, [0, 720)
+  int tilt;   // 1/2 deg
+  int zoom;   // 1/100
+
+  bool operator==(const ViewKey &o) const {
+    return height == o.height && angle == o.angle && tilt == o.tilt &&
+           zoom == o.zoom;
+  }
+  bool operator!=(const ViewKey &o) const { return !(*this == o); }
+};
+
+ViewKey quantize_view(const ViewpointParams &view);
+// the view a key's lut is built for
+ViewpointParams dequantize_view(const ViewKey &key);
+
+// default view turned by 90 degree steps
+std::vector<ViewpointParams> default_view_presets();
+
+struct ViewLutCacheStats {
+  int size;         // luts held
+  int capacity;
+  uint64_t hits;    // requests answered from the cache
+  uint64_t misses;  // requests that needed a build
+  uint64_t builds;  // incl. presets
+  double build_ms;  // average build time
+};
+
+// lru cache of stitch luts keyed by quantized viewpoint.
+// luts are built on a worker thread, the stitcher keeps the last valid lut
+// until the requested one is ready and swapped in. luts are immutable and
+// shared, so one evicted while a frame still uses it stays alive until
+// that frame is done. luts are built at scale, see build_stitch_lut
+class ViewLutCache {
+public:
+  ViewLutCache(CameraPrms prms[4], int capacity = 8, double scale = 1.0);
+  ~ViewLutCache();
+
+  ViewLutCache(const ViewLutCache &) = delete;
+  ViewLutCache &operator=(const ViewLutCache &) = delete;
+
+  void start();
+  void stop();
+
+  // blocking, for the first view: cached or built on the caller's thread,
+  // becomes current
+  bool load(const ViewpointParams &view);
+  // adds a lut built elsewhere (e.g. from the rig bundle)
+  void insert(const ViewpointParams &view,
+              std::shared_ptr<const StitchLut> lut);
+  // queued behind interactive requests
+  void prebake(const std::vector<ViewpointParams> &views);
+
+  // switch to view. a cached lut becomes current at once, otherwise it is
+  // built in the background and the latest request wins
+  void request(const ViewpointParams &view);
+
+  // lut to stitch the next frame with, lock free
+  std::shared_ptr<const StitchLut> current() const {
+    return std::atomic_load(&m_current);
+  }
+  // the current lut is not the requested view yet
+  bool pending() const;
+
+  ViewLutCacheStats stats() const;
+  double scale() const { return m_scale; }
+
+private:
+  struct Entry {
+    ViewKey key;
+    std::shared_ptr<const StitchLut> lut;
+  };
+
+  // callers hold m_mutex
+  std::shared_ptr<const StitchLut> find(const ViewKey &key);
+  void store(const ViewKey &key, std::shared_ptr<const StitchLut> lut);
+
+  std::shared_ptr<const StitchLut> build(const ViewKey &key);
+  void workerLoop();
+
+  CameraPrms *m_prms;
+  const int m_capacity;
+  const double m_scale;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::list<Entry> m_entries; // most recently used first
+  ViewKey m_wanted;           // last requested view
+  ViewKey m_currentKey;
+  bool m_buildWanted;         // m_wanted is not cached yet
+  ViewKey m_buildingKey;      // on the worker right now
+  bool m_building;
+  std::list<ViewKey> m_presets;
+  bool m_running;
+  std::thread m_worker;
+
+  std::shared_ptr<const StitchLut> m_current; // atomic_load / atomic_store
+
+  uint64_t m_hits;
+  uint64_t m_misses;
+  uint64_t m_builds;
+  double m_buildMs;
+};
+
+#endif
@@ -0,0 +1,374 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#include "yuv_stitch.h"
+#include "blend_simd.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+// black in limited range yuv, the border value of the samplers
+static const uchar black_y = 16;
+static const uchar black_c = 128;
+
+// one plane of a yuv frame, samples pstride bytes apart. for chroma the
+// v sample follows u at voff
+struct YuvPlane {
+  const uchar *data;
+  size_t step;
+  int pstride;
+  int voff;
+  int width;
+  int height;
+};
+
+static void yuv_planes(const cv::Mat &img, PixelFormat format, YuvPlane &luma,
+                       YuvPlane &chroma, int &chroma_vshift) {
+  const cv::Size size = yuv_frame_size(img, format);
+  if (format == PIX_YUYV) {
+    luma = {img.data, img.step, 2, 0, size.width, size.height};
+    chroma = {img.data + 1, img.step, 4, 2, size.width / 2, size.height};
+    chroma_vshift = 0;
+  } else {
+    luma = {img.data, img.step, 1, 0, size.width, size.height};
+    chroma = {img.data + size.height * img.step, img.step, 2, 1,
+              size.width / 2, size.height / 2};
+    chroma_vshift = 1;
+  }
+}
+
+cv::Size yuv_frame_size(const cv::Mat &img, PixelFormat format) {
+  switch (format) {
+  case PIX_NV12:
+    return cv::Size(img.cols, img.rows * 2 / 3);
+  default:
+    return img.size();
+  }
+}
+
+void bgr_to_nv12(const cv::Mat &bgr, cv::Mat &nv12) {
+  cv::Mat i420;
+  cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+
+  // i420 keeps u and v as two quarter planes, nv12 interleaves them
+  const int w = bgr.cols, h = bgr.rows;
+  nv12.create(h * 3 / 2, w, CV_8UC1);
+  i420.rowRange(0, h).copyTo(nv12.rowRange(0, h));
+  const uchar *u = i420.ptr(h);
+  const uchar *v = u + (w / 2) * (h / 2);
+  for (int y = 0; y < h / 2; ++y) {
+    uchar *o = nv12.ptr(h + y);
+    for (int x = 0; x < w / 2; ++x) {
+      o[2 * x + 0] = *u++;
+      o[2 * x + 1] = *v++;
+    }
+  }
+}
+
+void bgr_to_yuyv(const cv::Mat &bgr, cv::Mat &yuyv) {
+  cv::Mat i420;
+  cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+
+  const int w = bgr.cols, h = bgr.rows;
+  yuyv.create(h, w, CV_8UC2);
+  const uchar *u = i420.ptr(h);
+  const uchar *v = u + (w / 2) * (h / 2);
+  for (int y = 0; y < h; ++y) {
+    const uchar *l = i420.ptr(y);
+    const uchar *cu = u + (y / 2) * (w / 2);
+    const uchar *cv_ = v + (y / 2) * (w / 2);
+    uchar *o = yuyv.ptr(y);
+    for (int x = 0; x < w / 2; ++x, o += 4) {
+      o[0] = l[2 * x];
+      o[1] = cu[x];
+      o[2] = l[2 * x + 1];
+      o[3] = cv_[x];
+    }
+  }
+}
+
+void nv12_to_bgr(const cv::Mat &nv12, cv::Mat &bgr) {
+  AVM_TRACE_SCOPE("nv12_to_bgr");
+  cv::cvtColor(nv12, bgr, cv::COLOR_YUV2BGR_NV12);
+}
+
+// ---------------------------------------------------------------------------
+
+// mean y, u, v over every step-th row and column
+static void yuv_info_statics(const cv::Mat &src, PixelFormat format,
+                             double mean[3], int step) {
+  mean[0] = 16;
+  mean[1] = mean[2] = 128;
+  if (src.empty()) {
+    return;
+  }
+
+  YuvPlane luma, chroma;
+  int vshift;
+  yuv_planes(src, format, luma, chroma, vshift);
+
+  uint64_t sum[3] = {0, 0, 0};
+  int64_t nums = 0, cnums = 0;
+  for (int y = step / 2; y < luma.height; y += step) {
+    const uchar *l = luma.data + y * luma.step;
+    for (int x = step / 2; x < luma.width; x += step) {
+      sum[0] += l[x * luma.pstride];
+      ++nums;
+    }
+  }
+  for (int y = step / 2; y < chroma.height; y += step) {
+    const uchar *c = chroma.data + y * chroma.step;
+    for (int x = step / 2; x < chroma.width; x += step) {
+      sum[1] += c[x * chroma.pstride];
+      sum[2] += c[x * chroma.pstride + chroma.voff];
+      ++cnums;
+    }
+  }
+  if (nums > 0 && cnums > 0) {
+    mean[0] = (double)sum[0] / nums;
+    mean[1] = (double)sum[1] / cnums;
+    mean[2] = (double)sum[2] / cnums;
+  }
+}
+
+static inline uchar clamp_u8(double v) {
+  return (uchar)std::min(std::max(v + 0.5, 0.0), 255.0);
+}
+
+static void identity_yuv_lut(YuvGainLut &lut) {
+  for (int v = 0; v < 256; ++v) {
+    lut.y[v] = lut.u[v] = lut.v[v] = (uchar)v;
+  }
+}
+
+static const YuvGainLut &identity_lut() {
+  static const YuvGainLut lut = [] {
+    YuvGainLut l;
+    identity_yuv_lut(l);
+    return l;
+  }();
+  return lut;
+}
+
+void yuv_gain_luts(const std::vector<cv::Mat *> &srcs, PixelFormat format,
+                   YuvGainLut luts[4], int step, ThreadPool *pool) {
+  AVM_TRACE_SCOPE("yuv_gain_luts");
+  for (int i = 0; i < 4; ++i) {
+    identity_yuv_lut(luts[i]);
+  }
+  if (srcs.size() != 4) {
+    return;
+  }
+  for (int i = 0; i < 4; ++i) {
+    if (srcs[i] == nullptr) {
+      return;
+    }
+  }
+  step = std::max(step, 1);
+
+  double mean[4][3];
+  auto statics = [&](int i) {
+    AVM_TRACE_SCOPE("awb_statics");
+    yuv_info_statics(*srcs[i], format, mean[i], step);
+  };
+  if (pool) {
+    pool->parallelFor(4, statics);
+  } else {
+    for (int i = 0; i < 4; ++i) {
+      statics(i);
+    }
+  }
+
+  // means to bgr, then the gains of the bgr gray world
+  BgrSts sts[4];
+  for (int i = 0; i < 4; ++i) {
+    const double y = 1.164 * (mean[i][0] - 16);
+    const double u = mean[i][1] - 128, v = mean[i][2] - 128;
+    sts[i].b = (int)(y + 2.017 * u);
+    sts[i].g = (int)(y - 0.392 * u - 0.813 * v);
+    sts[i].r = (int)(y + 1.596 * v);
+    // a black frame would divide by zero, keep it as is
+    if (sts[i].b <= 0 || sts[i].g <= 0 || sts[i].r <= 0) {
+      return;
+    }
+  }
+  BgrGain gains[4];
+  awb_gains(sts, gains);
+
+  for (int i = 0; i < 4; ++i) {
+    const double b = sts[i].b * gains[i].b, g = sts[i].g * gains[i].g,
+                 r = sts[i].r * gains[i].r;
+    const double ty = 16 + 0.257 * r + 0.504 * g + 0.098 * b;
+    const double tu = 128 - 0.148 * r - 0.291 * g + 0.439 * b;
+    const double tv = 128 + 0.439 * r - 0.368 * g - 0.071 * b;
+    const double ygain = (ty - 16) / std::max(mean[i][0] - 16, 1.0);
+    for (int k = 0; k < 256; ++k) {
+      luts[i].y[k] = clamp_u8(16 + (k - 16) * ygain);
+      luts[i].u[k] = clamp_u8(k + tu - mean[i][1]);
+      luts[i].v[k] = clamp_u8(k + tv - mean[i][2]);
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+
+// fraction bits of the remap lut
+static const int lut_bits = 4;
+
+// bilinear tap of nch samples at 1 / 16 fixed point coords, same weights
+// and rounding as remap_tiled. taps off the plane read border
+static inline void sample_plane(const YuvPlane &p, int fx_, int fy_, int nch,
+                                const uchar border, int out[2]) {
+  const int bits = lut_bits;
+  const int mask = (1 << bits) - 1;
+  const int sx = fx_ >> bits, sy = fy_ >> bits;
+  const int fx = fx_ & mask, fy = fy_ & mask;
+  const int w[4] = {((1 << bits) - fx) * ((1 << bits) - fy),
+                    fx * ((1 << bits) - fy), ((1 << bits) - fx) * fy,
+                    fx * fy};
+  const int off[2] = {0, p.voff};
+
+  if (sx >= 0 && sy >= 0 && sx < p.width - 1 && sy < p.height - 1) {
+    const uchar *p0 = p.data + sy * p.step + sx * p.pstride;
+    const uchar *p1 = p0 + p.step;
+    for (int c = 0; c < nch; ++c) {
+      out[c] = p0[off[c]] * w[0] + p0[off[c] + p.pstride] * w[1] +
+               p1[off[c]] * w[2] + p1[off[c] + p.pstride] * w[3];
+    }
+    return;
+  }
+
+  const int tx[4] = {sx, sx + 1, sx, sx + 1};
+  const int ty[4] = {sy, sy, sy + 1, sy + 1};
+  out[0] = out[1] = 0;
+  for (int t = 0; t < 4; ++t) {
+    for (int c = 0; c < nch; ++c) {
+      int v = border;
+      if (tx[t] >= 0 && ty[t] >= 0 && tx[t] < p.width && ty[t] < p.height) {
+        v = p.data[ty[t] * p.step + tx[t] * p.pstride + off[c]];
+      }
+      out[c] += v * w[t];
+    }
+  }
+}
+
+// sample one lut region into a luma rect and its interleaved uv rect
+static void sample_region_yuv(const cv::Mat &src, PixelFormat format,
+                              const LutRegion &region, cv::Mat dst_y,
+                              cv::Mat dst_uv, const YuvGainLut *gain) {
+  const int bits = lut_bits;
+  const int one = 1 << bits;
+  const int mask = one - 1;
+  const int round = 1 << (2 * bits - 1);
+  YuvPlane luma, chroma;
+  int vshift;
+  yuv_planes(src, format, luma, chroma, vshift);
+
+  if (!gain) {
+    gain = &identity_lut();
+  }
+
+  for (int y = 0; y < dst_y.rows; ++y) {
+    const short *xy = region.remap.xy.ptr<short>(y);
+    const uchar *fxy = region.remap.frac.ptr(y);
+    uchar *o = dst_y.ptr(y);
+    for (int x = 0; x < dst_y.cols; ++x) {
+      int acc[2];
+      sample_plane(luma, xy[2 * x] * one + (fxy[x] & mask),
+                   xy[2 * x + 1] * one + (fxy[x] >> bits), 1, black_y, acc);
+      o[x] = gain->y[(acc[0] + round) >> (2 * bits)];
+    }
+  }
+
+  // chroma of each 2x2 block follows the lut entry of its top-left pixel
+  for (int y = 0; y < dst_uv.rows; ++y) {
+    const short *xy = region.remap.xy.ptr<short>(2 * y);
+    const uchar *fxy = region.remap.frac.ptr(2 * y);
+    uchar *o = dst_uv.ptr(y);
+    for (int x = 0; x < dst_uv.cols / 2; ++x) {
+      const int k = 2 * x;
+      const int fx = xy[2 * k] * one + (fxy[k] & mask);
+      const int fy = xy[2 * k + 1] * one + (fxy[k] >> bits);
+      int acc[2];
+      sample_plane(chroma, fx >> 1, fy >> vshift, 2, black_c, acc);
+      o[2 * x + 0] = gain->u[(acc[0] + round) >> (2 * bits)];
+      o[2 * x + 1] = gain->v[(acc[1] + round) >> (2 * bits)];
+    }
+  }
+}
+
+// uv rect of a luma rect
+static cv::Mat nv12_chroma(cv::Mat &nv12, int height, const cv::Rect &roi) {
+  return nv12(cv::Rect(roi.x, height + roi.y / 2, roi.width, roi.height / 2));
+}
+
+void stitch_prepare_nv12(const StitchLut &lut, const cv::Mat &car_nv12,
+                         cv::Mat &out) {
+  AVM_TRACE_SCOPE("stitch_prepare");
+  const int h = lut.size.height;
+  out.create(h * 3 / 2, lut.size.width, CV_8UC1);
+
+  const int ch = car_nv12.rows * 2 / 3;
+  car_nv12.rowRange(0, ch).copyTo(out(lut.car));
+  car_nv12.rowRange(ch, car_nv12.rows)
+      .copyTo(nv12_chroma(out, h, lut.car));
+}
+
+void stitch_body_yuv(const std::vector<cv::Mat *> &srcs, PixelFormat format,
+                     const StitchLut &lut, int i, cv::Mat &out,
+                     const YuvGainLut *gains) {
+  AVM_TRACE_SCOPE("stitch_body");
+  const LutRegion &region = lut.body[i];
+  const int h = lut.size.height;
+  sample_region_yuv(*srcs[region.cam], format, region,
+                    out(region.roi),
+                    nv12_chroma(out, h, region.roi),
+                    gains ? &gains[region.cam] : nullptr);
+}
+
+void stitch_corner_yuv(const std::vector<cv::Mat *> &srcs, PixelFormat format,
+                       const StitchLut &lut, int i,
+                       const std::vector<cv::Mat> &merge_weights_img,
+                       cv::Mat &out, StitchScratch &scratch,
+                       const YuvGainLut *gains) {
+  AVM_TRACE_SCOPE("stitch_corner");
+  const cv::Rect roi = lut.corner[i][0].roi;
+  const cv::Rect local(0, 0, roi.width, roi.height);
+
+  // both cameras into nv12 scratch of the corner size
+  for (int j = 0; j < 2; ++j) {
+    const LutRegion &region = lut.corner[i][j];
+    cv::Mat &tmp = scratch.corner[i][j];
+    tmp.create(roi.height * 3 / 2, roi.width, CV_8UC1);
+    sample_region_yuv(*srcs[region.cam], format, region,
+                      tmp(local),
+                      nv12_chroma(tmp, roi.height, local),
+                      gains ? &gains[region.cam] : nullptr);
+  }
+
+  const cv::Mat &w = merge_weights_img[lut.corner_weight[i]];
+  if (w.type() != CV_8UC1 || w.rows < roi.height || w.cols < roi.width) {
+    return;
+  }
+  const cv::Mat &a = scratch.corner[i][0];
+  const cv::Mat &b = scratch.corner[i][1];
+  cv::Mat oy = out(roi);
+  cv::Mat ouv = nv12_chroma(out, lut.size.height, roi);
+
+  for (int y = 0; y < roi.height; ++y) {
+    blend_row(a.ptr(y), b.ptr(y), w.ptr(y), oy.ptr(y), roi.width);
+  }
+  // chroma takes the weight of the top-left pixel of its block for u and v
+  std::vector<uchar> wuv(roi.width);
+  for (int y = 0; y < roi.height / 2; ++y) {
+    const uchar *wr = w.ptr(2 * y);
+    for (int x = 0; x + 1 < roi.width; x += 2) {
+      wuv[x] = wuv[x + 1] = wr[x];
+    }
+    blend_row(a.ptr(roi.height + y), b.ptr(roi.height + y), wuv.data(),
+              ouv.ptr(y), roi.width);
+  }
+}
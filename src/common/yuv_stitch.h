@@ -0,0 +1,53 @@
+/***
+ * function: 360 surrond view combine c++ demo
+ * author: joker.mao
+ * date: 2023/07/15
+ * copyright: ADAS_EYES all right reserved
+ */
+
+#ifndef YUV_STITCH_H
+#define YUV_STITCH_H
+
+#include "frame_source.h"
+#include "stitch_lut.h"
+
+// stitching straight from camera yuv (nv12 or yuyv) into an nv12 mosaic.
+// luma is sampled per pixel like the bgr path, chroma once per 2x2 block
+// from the lut entry of its top-left pixel, so chroma costs a quarter of
+// the samples. bt.601 limited range, same as opencv's nv12 / yuy2 decoders.
+// nv12 mats are CV_8UC1 of h * 3 / 2 rows (luma, then interleaved uv),
+// yuyv mats are CV_8UC2. widths and heights are even
+
+// luma size of a frame
+cv::Size yuv_frame_size(const cv::Mat &img, PixelFormat format);
+
+void bgr_to_nv12(const cv::Mat &bgr, cv::Mat &nv12);
+void bgr_to_yuyv(const cv::Mat &bgr, cv::Mat &yuyv);
+void nv12_to_bgr(const cv::Mat &nv12, cv::Mat &bgr);
+
+// gray world in the yuv domain: luma is scaled and chroma shifted so the
+// mean of every camera lands on the balanced mean of the bgr path
+struct YuvGainLut {
+  uchar y[256];
+  uchar u[256];
+  uchar v[256];
+};
+
+void yuv_gain_luts(const std::vector<cv::Mat *> &srcs, PixelFormat format,
+                   YuvGainLut luts[4], int step = 4,
+                   ThreadPool *pool = nullptr);
+
+// same steps as stitch_prepare / stitch_body / stitch_corner, the mosaic
+// is nv12 and car_nv12 the car image from bgr_to_nv12
+void stitch_prepare_nv12(const StitchLut &lut, const cv::Mat &car_nv12,
+                         cv::Mat &out);
+void stitch_body_yuv(const std::vector<cv::Mat *> &srcs, PixelFormat format,
+                     const StitchLut &lut, int i, cv::Mat &out,
+                     const YuvGainLut *gains = nullptr);
+void stitch_corner_yuv(const std::vector<cv::Mat *> &srcs, PixelFormat format,
+                       const StitchLut &lut, int i,
+                       const std::vector<cv::Mat> &merge_weights_img,
+                       cv::Mat &out, StitchScratch &scratch,
+                       const YuvGainLut *gains = nullptr);
+
+#endif
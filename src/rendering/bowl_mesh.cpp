@@ -0,0 +1,287 @@
+#include "bowl_mesh.h"
+#include "trace.h"
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+// 径向剖面: 第 j 环离地面边缘的水平距离、高度和沿碗壁的弧长, 与角度无关
+struct BowlRing {
+  float scale;    // 地面环: 椭圆边缘的比例; 碗壁环: 1
+  float offset;   // 碗壁环: 离地面边缘的水平距离, 米
+  float height;
+  float unrolled; // 碗壁环: 展开回地面的距离, 米
+};
+
+static std::vector<BowlRing> bowlProfile(const BowlParams &p) {
+  std::vector<BowlRing> rings(p.ground_rings + p.wall_rings + 1);
+  for (int j = 0; j <= p.ground_rings; ++j) {
+    rings[j] = {(float)j / p.ground_rings, 0.0f, 0.0f, 0.0f};
+  }
+  float arc = 0.0f;
+  for (int j = 1; j <= p.wall_rings; ++j) {
+    const float s = (float)j / p.wall_rings;
+    BowlRing &r = rings[p.ground_rings + j];
+    const BowlRing &prev = rings[p.ground_rings + j - 1];
+    r.scale = 1.0f;
+    r.offset = p.wall_width * s;
+    r.height = p.wall_height * std::pow(s, p.wall_curve);
+    arc += std::hypot(r.offset - prev.offset, r.height - prev.height);
+    r.unrolled = arc;
+  }
+  return rings;
+}
+
+void build_bowl_grid(BowlParams &params, std::vector<BowlVertex> &vertices,
+                     std::vector<uint32_t> &indices,
+                     std::vector<BowlLod> &lods) {
+  // 最粗的层次也要落在地面边缘和碗口上
+  params.lods = std::max(params.lods, 1);
+  const int unit = 1 << (params.lods - 1);
+  auto roundUp = [unit](int v) {
+    return (std::max(v, 1) + unit - 1) / unit * unit;
+  };
+  params.angular = std::max(roundUp(params.angular), 4 * unit);
+  params.ground_rings = roundUp(params.ground_rings);
+  params.wall_rings = roundUp(params.wall_rings);
+
+  const std::vector<BowlRing> rings = bowlProfile(params);
+  const int n = params.angular;
+  vertices.assign(rings.size() * n, BowlVertex());
+  for (size_t j = 0; j < rings.size(); ++j) {
+    const BowlRing &r = rings[j];
+    for (int k = 0; k < n; ++k) {
+      const float a = 2.0f * (float)CV_PI * k / n;
+      const float ex = params.ground_rx * std::cos(a);
+      const float ez = params.ground_rz * std::sin(a);
+      const float len = std::hypot(ex, ez);
+      BowlVertex &v = vertices[j * n + k];
+      v.position[0] = ex * r.scale + ex / len * r.offset;
+      v.position[1] = r.height;
+      v.position[2] = ez * r.scale + ez / len * r.offset;
+    }
+  }
+
+  // 每个层次一段索引, 第 j 环第 k 个顶点为 j * n + k % n
+  indices.clear();
+  lods.clear();
+  for (int l = 0; l < params.lods; ++l) {
+    const int step = 1 << l;
+    BowlLod lod = {(uint32_t)indices.size(), 0};
+    for (size_t j = 0; j + step < rings.size(); j += step) {
+      for (int k = 0; k < n; k += step) {
+        const uint32_t i00 = (uint32_t)(j * n + k);
+        const uint32_t i01 = (uint32_t)(j * n + (k + step) % n);
+        const uint32_t i10 = (uint32_t)((j + step) * n + k);
+        const uint32_t i11 = (uint32_t)((j + step) * n + (k + step) % n);
+        // 逆时针朝向碗内 (上方). 中心环的点重合, 只需要一个三角形
+        if (j != 0) {
+          indices.insert(indices.end(), {i00, i01, i10});
+        }
+        indices.insert(indices.end(), {i01, i11, i10});
+      }
+    }
+    lod.count = (uint32_t)indices.size() - lod.first;
+    lods.push_back(lod);
+  }
+}
+
+// 拼接图上点所在的区域: 单相机区域返回相机, 重叠角返回 4 + 角号,
+// 车辆区域返回 -1. 拼接图之外按边界线延伸
+static int mosaicRegion(const RigLayout &layout, double gx, double gy) {
+  const int col = gx < layout.xl ? 0 : gx < layout.xr ? 1 : 2;
+  const int row = gy < layout.yt ? 0 : gy < layout.yb ? 1 : 2;
+  static const int regions[3][3] = {{4, 0, 5}, {1, -1, 3}, {6, 2, 7}};
+  return regions[row][col];
+}
+
+bool bake_bowl_cameras(const BowlParams &params, const CameraPrms prms[4],
+                       const RigLayout &layout,
+                       const std::vector<cv::Mat> &merge_weights_img,
+                       std::vector<BowlVertex> &vertices) {
+  AVM_TRACE_SCOPE("bake_bowl_cameras");
+  const std::vector<BowlRing> rings = bowlProfile(params);
+  const int n = params.angular;
+  if (vertices.size() != rings.size() * n) {
+    std::cerr << "bake_bowl_cameras: grid does not match params" << std::endl;
+    return false;
+  }
+
+  // 1. 每个顶点展开回地面, 换算到拼接图像素, 车辆矩形中心为原点,
+  //    x 向右, z 向车头 (拼接图上方)
+  const double cx = (layout.xl + layout.xr) * 0.5;
+  const double cy = (layout.yt + layout.yb) * 0.5;
+  std::vector<cv::Point2d> ground(vertices.size());
+  for (size_t j = 0; j < rings.size(); ++j) {
+    const BowlRing &r = rings[j];
+    for (int k = 0; k < n; ++k) {
+      const float a = 2.0f * (float)CV_PI * k / n;
+      const double ex = params.ground_rx * std::cos(a);
+      const double ez = params.ground_rz * std::sin(a);
+      const double len = std::hypot(ex, ez);
+      const double x = ex * r.scale + ex / len * r.unrolled;
+      const double z = ez * r.scale + ez / len * r.unrolled;
+      ground[j * n + k] = cv::Point2d(cx + x / params.meters_per_px,
+                                      cy - z / params.meters_per_px);
+    }
+  }
+
+  // 2. 4 路相机的原始帧坐标, 与拼接查找表同一套投影
+  std::vector<cv::Point2f> raw[4];
+  std::vector<uchar> valid[4];
+  for (int cam = 0; cam < 4; ++cam) {
+    if (!project_mosaic_points(prms[cam], prms[cam].project_matrix, cam,
+                               layout, ground, raw[cam], valid[cam])) {
+      std::cerr << "bake_bowl_cameras: projection failed for "
+                << prms[cam].name << std::endl;
+      return false;
+    }
+  }
+
+  // 3. 权重: 单相机区域为 1, 重叠角取 2D 拼接的权重图 (拼接图外夹到
+  //    角区域的边缘), 看不到该点的相机去掉后重新归一化
+  const cv::Rect corners[4] = {
+      cv::Rect(0, 0, layout.xl, layout.yt),
+      cv::Rect(layout.xr, 0, layout.total_w - layout.xr, layout.yt),
+      cv::Rect(0, layout.yb, layout.xl, layout.total_h - layout.yb),
+      cv::Rect(layout.xr, layout.yb, layout.total_w - layout.xr,
+               layout.total_h - layout.yb)};
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    BowlVertex &v = vertices[i];
+    float w[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const int region = mosaicRegion(layout, ground[i].x, ground[i].y);
+    if (region >= 4) {
+      const int c = region - 4;
+      const cv::Mat &plane = merge_weights_img[stitch_corner_weights[c]];
+      float w0 = 0.5f;
+      if (plane.size() == corners[c].size()) {
+        const int px = (int)(ground[i].x - corners[c].x);
+        const int py = (int)(ground[i].y - corners[c].y);
+        w0 = plane.ptr(std::min(std::max(py, 0), plane.rows - 1))
+                 [std::min(std::max(px, 0), plane.cols - 1) *
+                  plane.channels()] /
+             255.0f;
+      }
+      w[stitch_corner_cams[c][0]] = w0;
+      w[stitch_corner_cams[c][1]] = 1.0f - w0;
+    } else if (region >= 0) {
+      w[region] = 1.0f;
+    }
+
+    float sum = 0.0f;
+    for (int cam = 0; cam < 4; ++cam) {
+      const cv::Size &size = prms[cam].size;
+      const cv::Point2f &p = raw[cam][i];
+      const bool seen = valid[cam][i] && p.x >= 0 && p.y >= 0 &&
+                        p.x <= size.width - 1 && p.y <= size.height - 1;
+      // 帧外的坐标也保留, 三角形内插值不会被拉向原点
+      v.uv[cam][0] = valid[cam][i] ? (p.x + 0.5f) / size.width : 0.0f;
+      v.uv[cam][1] = valid[cam][i] ? (p.y + 0.5f) / size.height : 0.0f;
+      if (!seen) {
+        w[cam] = 0.0f;
+      }
+      sum += w[cam];
+    }
+    for (int cam = 0; cam < 4; ++cam) {
+      v.weight[cam] = sum > 0.0f ? w[cam] / sum : 0.0f;
+    }
+  }
+  return true;
+}
+
+BowlMesh::BowlMesh() : m_vao(0), m_vbo(0), m_ebo(0) {}
+
+BowlMesh::~BowlMesh() { cleanup(); }
+
+bool BowlMesh::init(const BowlParams &params, const CameraPrms prms[4],
+                    const RigLayout &layout,
+                    const std::vector<cv::Mat> &merge_weights_img) {
+  cleanup();
+  m_params = params;
+  m_layout = layout;
+  // 权重图可能指向标定包的映射, 重新烘焙时还要用, 留一份拷贝
+  m_weights.clear();
+  for (const cv::Mat &w : merge_weights_img) {
+    m_weights.push_back(w.clone());
+  }
+
+  std::vector<uint32_t> indices;
+  build_bowl_grid(m_params, m_vertices, indices, m_lods);
+  int64 t0 = cv::getTickCount();
+  if (!bake_bowl_cameras(m_params, prms, m_layout, m_weights, m_vertices)) {
+    return false;
+  }
+  const double bake_ms =
+      (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+
+  glGenVertexArrays(1, &m_vao);
+  glGenBuffers(1, &m_vbo);
+  glGenBuffers(1, &m_ebo);
+  glBindVertexArray(m_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(BowlVertex),
+               m_vertices.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t),
+               indices.data(), GL_STATIC_DRAW);
+
+  // 0: 位置, 1: 相机 0/1 的纹理坐标, 2: 相机 2/3 的纹理坐标, 3: 权重
+  const GLsizei stride = sizeof(BowlVertex);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                        (void *)offsetof(BowlVertex, position));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void *)offsetof(BowlVertex, uv[0]));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void *)offsetof(BowlVertex, uv[2]));
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride,
+                        (void *)offsetof(BowlVertex, weight));
+  glBindVertexArray(0);
+
+  std::cout << "BowlMesh: " << m_vertices.size() << " vertices, "
+            << m_lods.size() << " lods, " << m_lods[0].count / 3
+            << " triangles at lod 0, baked in " << bake_ms << " ms"
+            << std::endl;
+  return true;
+}
+
+bool BowlMesh::rebake(const CameraPrms prms[4]) {
+  AVM_TRACE_SCOPE("BowlMesh::rebake");
+  if (m_vbo == 0 ||
+      !bake_bowl_cameras(m_params, prms, m_layout, m_weights, m_vertices)) {
+    return false;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, m_vertices.size() * sizeof(BowlVertex),
+                  m_vertices.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return true;
+}
+
+void BowlMesh::draw(int lod) {
+  if (m_vao == 0 || m_lods.empty()) {
+    return;
+  }
+  const BowlLod &l = m_lods[std::min(std::max(lod, 0), lodCount() - 1)];
+  glBindVertexArray(m_vao);
+  glDrawElements(GL_TRIANGLES, l.count, GL_UNSIGNED_INT,
+                 (void *)(l.first * sizeof(uint32_t)));
+  glBindVertexArray(0);
+}
+
+void BowlMesh::cleanup() {
+  if (m_vao != 0) {
+    glDeleteVertexArrays(1, &m_vao);
+    m_vao = 0;
+  }
+  if (m_vbo != 0) {
+    glDeleteBuffers(1, &m_vbo);
+    m_vbo = 0;
+  }
+  if (m_ebo != 0) {
+    glDeleteBuffers(1, &m_ebo);
+    m_ebo = 0;
+  }
+}
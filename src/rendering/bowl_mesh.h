@@ -0,0 +1,80 @@
+#ifndef BOWL_MESH_H
+#define BOWL_MESH_H
+
+#include "stitch_lut.h"
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+// 环视碗: 平坦的椭圆地面加上弯曲的碗壁. 每个顶点在构建时算好 4 路相机
+// 的纹理坐标和融合权重, 片段着色器只做插值和采样.
+// 碗壁上的点按沿碗壁的弧长展开回地平面, 用同一套俯视标定取相机坐标,
+// 地面部分与 2D 拼接的结果一致
+struct BowlParams {
+  float ground_rx = 5.0f;   // 地面椭圆半轴, 米 (x 向右)
+  float ground_rz = 7.0f;   // (z 向车头)
+  float wall_width = 4.0f;  // 碗壁的水平延伸, 米
+  float wall_height = 3.0f; // 碗壁高度, 米
+  float wall_curve = 2.0f;  // 碗壁曲率, 高度 = h * t^curve
+  int angular = 128;        // 一圈的顶点数
+  int ground_rings = 16;    // 地面 (中心到边缘) 的环数
+  int wall_rings = 16;      // 碗壁的环数
+  int lods = 3;             // 细节层次, 每层角向和径向减半
+  float meters_per_px = 0.01f; // 拼接图一个像素对应的地面尺寸
+};
+
+struct BowlVertex {
+  float position[3];
+  float uv[4][2];   // 各相机原始帧的纹理坐标
+  float weight[4];  // 各相机的融合权重, 和为 1, 看不到的相机为 0
+};
+
+// 一个细节层次在索引缓冲中的范围
+struct BowlLod {
+  uint32_t first;
+  uint32_t count;
+};
+
+// 顶点网格和各层次的索引, 只依赖参数. 角向和径向的数量向上取整到
+// 2^(lods - 1) 的倍数, 粗的层次复用细层次的顶点
+void build_bowl_grid(BowlParams &params, std::vector<BowlVertex> &vertices,
+                     std::vector<uint32_t> &indices,
+                     std::vector<BowlLod> &lods);
+
+// 按标定烘焙每个顶点的相机纹理坐标和权重, 网格本身不变.
+// merge_weights_img 为全尺寸拼接图的角区域权重 (load_blend_weights)
+bool bake_bowl_cameras(const BowlParams &params, const CameraPrms prms[4],
+                       const RigLayout &layout,
+                       const std::vector<cv::Mat> &merge_weights_img,
+                       std::vector<BowlVertex> &vertices);
+
+class BowlMesh {
+public:
+  BowlMesh();
+  ~BowlMesh();
+
+  bool init(const BowlParams &params, const CameraPrms prms[4],
+            const RigLayout &layout,
+            const std::vector<cv::Mat> &merge_weights_img);
+  // 标定变化后重新烘焙, 只更新顶点缓冲
+  bool rebake(const CameraPrms prms[4]);
+
+  // lod 0 最精细
+  void draw(int lod = 0);
+  int lodCount() const { return (int)m_lods.size(); }
+
+  void cleanup();
+
+private:
+  BowlParams m_params;
+  RigLayout m_layout;
+  std::vector<cv::Mat> m_weights;
+  std::vector<BowlVertex> m_vertices;
+  std::vector<BowlLod> m_lods;
+
+  GLuint m_vao;
+  GLuint m_vbo;
+  GLuint m_ebo;
+};
+
+#endif // BOWL_MESH_H
@@ -0,0 +1,431 @@
+#include "frame_timer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+// 直方图 1 ms 一格, 最后一格收 >= 100 ms
+const int kHistogramBins = 100;
+
+double elapsedMs(std::chrono::steady_clock::time_point start,
+                 std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+} // namespace
+
+FrameTimer::FrameTimer(int history, int latency)
+    : m_latency(std::max(latency, 2)), m_inited(false), m_gpuActive(-1),
+      m_frame(0), m_gpuDropped(0) {
+  // 查询结果回来时对应的帧还要在窗口里
+  m_records.resize(std::max(history, m_latency));
+  setBudgets({1000.0 / 60.0, 1000.0 / 30.0});
+}
+
+FrameTimer::~FrameTimer() { cleanup(); }
+
+int FrameTimer::addPhase(const std::string &name, bool gpu) {
+  m_phases.push_back(Phase{name, gpu});
+  return (int)m_phases.size() - 1;
+}
+
+bool FrameTimer::init() {
+  cleanup();
+  const size_t phases = m_phases.size();
+  for (Record &r : m_records) {
+    r.frame = -1;
+    r.cpuMs.assign(phases, 0.0);
+    r.gpuMs.assign(phases, -1.0);
+  }
+  m_phaseStart.assign(phases, Clock::time_point());
+  m_slots.assign(m_latency, QuerySlot());
+  for (QuerySlot &slot : m_slots) {
+    slot.queries.assign(phases, 0);
+    slot.issued.assign(phases, false);
+    slot.frame = -1;
+    slot.pending = false;
+    for (size_t i = 0; i < phases; ++i) {
+      if (m_phases[i].gpu) {
+        glGenQueries(1, &slot.queries[i]);
+      }
+    }
+  }
+  m_frame = 0;
+  m_gpuDropped = 0;
+  m_overBudget.assign(m_budgets.size(), 0);
+  m_inited = true;
+  return glGetError() == GL_NO_ERROR;
+}
+
+void FrameTimer::beginFrame() {
+  if (!m_inited) {
+    return;
+  }
+  collect();
+
+  Record &r = m_records[m_frame % m_records.size()];
+  r.frame = m_frame;
+  r.frameMs = 0.0;
+  std::fill(r.cpuMs.begin(), r.cpuMs.end(), 0.0);
+  std::fill(r.gpuMs.begin(), r.gpuMs.end(), -1.0);
+
+  // 环转了一圈, 这一格的查询还没完成: 放弃那一帧的 GPU 时间, 直接复用
+  QuerySlot &slot = m_slots[m_frame % m_latency];
+  if (slot.pending && !collectSlot(slot)) {
+    slot.pending = false;
+    ++m_gpuDropped;
+  }
+  std::fill(slot.issued.begin(), slot.issued.end(), false);
+  slot.frame = m_frame;
+  m_gpuActive = -1;
+  m_frameStart = Clock::now();
+}
+
+void FrameTimer::endFrame() {
+  if (!m_inited) {
+    return;
+  }
+  if (m_gpuActive >= 0) {
+    endPhase(m_gpuActive);
+  }
+  Record &r = m_records[m_frame % m_records.size()];
+  r.frameMs = elapsedMs(m_frameStart, Clock::now());
+  for (size_t i = 0; i < m_budgets.size(); ++i) {
+    if (r.frameMs > m_budgets[i]) {
+      ++m_overBudget[i];
+    }
+  }
+  QuerySlot &slot = m_slots[m_frame % m_latency];
+  slot.pending =
+      std::find(slot.issued.begin(), slot.issued.end(), true) !=
+      slot.issued.end();
+  ++m_frame;
+}
+
+void FrameTimer::beginPhase(int phase) {
+  if (!m_inited) {
+    return;
+  }
+  m_phaseStart[phase] = Clock::now();
+  // 每帧每个阶段一次查询, 并且不能和另一个 gpu 阶段重叠
+  QuerySlot &slot = m_slots[m_frame % m_latency];
+  if (m_phases[phase].gpu && m_gpuActive < 0 && !slot.issued[phase]) {
+    glBeginQuery(GL_TIME_ELAPSED, slot.queries[phase]);
+    slot.issued[phase] = true;
+    m_gpuActive = phase;
+  }
+}
+
+void FrameTimer::endPhase(int phase) {
+  if (!m_inited) {
+    return;
+  }
+  // 同一帧里多次进入的阶段累加
+  m_records[m_frame % m_records.size()].cpuMs[phase] +=
+      elapsedMs(m_phaseStart[phase], Clock::now());
+  if (m_gpuActive == phase) {
+    glEndQuery(GL_TIME_ELAPSED);
+    m_gpuActive = -1;
+  }
+}
+
+void FrameTimer::collect() {
+  // GPU 按提交顺序完成, 从最旧的一帧开始, 遇到未完成的就停
+  for (int64_t f = std::max<int64_t>(0, m_frame - m_latency); f < m_frame;
+       ++f) {
+    QuerySlot &slot = m_slots[f % m_latency];
+    if (slot.pending && slot.frame == f && !collectSlot(slot)) {
+      break;
+    }
+  }
+}
+
+bool FrameTimer::collectSlot(QuerySlot &slot) {
+  for (size_t i = 0; i < m_phases.size(); ++i) {
+    if (slot.issued[i]) {
+      GLint available = 0;
+      glGetQueryObjectiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE,
+                         &available);
+      if (!available) {
+        return false;
+      }
+    }
+  }
+  Record &r = m_records[slot.frame % m_records.size()];
+  for (size_t i = 0; i < m_phases.size(); ++i) {
+    if (!m_phases[i].gpu) {
+      continue;
+    }
+    // 这一帧没进入的 gpu 阶段记 0, 合计仍然有效
+    GLuint64 ns = 0;
+    if (slot.issued[i]) {
+      glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &ns);
+    }
+    if (r.frame == slot.frame) {
+      r.gpuMs[i] = ns / 1e6;
+    }
+  }
+  slot.pending = false;
+  return true;
+}
+
+std::vector<double> FrameTimer::samples(int metric) const {
+  const int phases = (int)m_phases.size();
+  std::vector<double> values;
+  values.reserve(m_records.size());
+  for (const Record &r : m_records) {
+    if (r.frame < 0 || r.frame >= m_frame) {
+      continue; // 空的或还没结束的一帧
+    }
+    if (metric < 0) {
+      values.push_back(r.frameMs);
+    } else if (metric < phases) {
+      values.push_back(r.cpuMs[metric]);
+    } else if (metric < 2 * phases) {
+      if (r.gpuMs[metric - phases] >= 0.0) {
+        values.push_back(r.gpuMs[metric - phases]);
+      }
+    } else {
+      double total = 0.0;
+      bool valid = true;
+      for (int i = 0; i < phases && valid; ++i) {
+        if (m_phases[i].gpu) {
+          valid = r.gpuMs[i] >= 0.0;
+          total += r.gpuMs[i];
+        }
+      }
+      if (valid) {
+        values.push_back(total);
+      }
+    }
+  }
+  return values;
+}
+
+std::string FrameTimer::metricName(int metric) const {
+  const int phases = (int)m_phases.size();
+  if (metric < 0) {
+    return "frame";
+  }
+  if (metric < phases) {
+    return "cpu." + m_phases[metric].name;
+  }
+  if (metric < 2 * phases) {
+    return "gpu." + m_phases[metric - phases].name;
+  }
+  return "gpu.total";
+}
+
+FrameTimer::Stats FrameTimer::computeStats(std::vector<double> &values) {
+  Stats s = {values.size(), 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  if (values.empty()) {
+    return s;
+  }
+  std::sort(values.begin(), values.end());
+  // nearest rank
+  auto rank = [&](double p) {
+    const size_t k = (size_t)std::ceil(p * values.size());
+    return values[std::min(values.size() - 1, k > 0 ? k - 1 : 0)];
+  };
+  for (double v : values) {
+    s.mean += v;
+  }
+  s.mean /= values.size();
+  s.p50 = rank(0.50);
+  s.p90 = rank(0.90);
+  s.p95 = rank(0.95);
+  s.p99 = rank(0.99);
+  s.max = values.back();
+  return s;
+}
+
+// 要报告的项: 整帧, 每个 CPU 阶段, 每个 gpu 阶段, 有 gpu 阶段时加合计
+static std::vector<int> metricList(int phases, const std::vector<bool> &gpu) {
+  std::vector<int> metrics = {-1};
+  for (int i = 0; i < phases; ++i) {
+    metrics.push_back(i);
+  }
+  bool any = false;
+  for (int i = 0; i < phases; ++i) {
+    if (gpu[i]) {
+      metrics.push_back(phases + i);
+      any = true;
+    }
+  }
+  if (any) {
+    metrics.push_back(2 * phases);
+  }
+  return metrics;
+}
+
+void FrameTimer::printSummary(std::ostream &os) const {
+  std::vector<bool> gpu;
+  for (const Phase &p : m_phases) {
+    gpu.push_back(p.gpu);
+  }
+  const std::vector<double> frameMs = samples(-1);
+  char line[160];
+  snprintf(line, sizeof(line), "frame timing: %llu frames, last %zu:",
+           (unsigned long long)m_frame, frameMs.size());
+  os << line << std::endl;
+  for (int metric : metricList((int)m_phases.size(), gpu)) {
+    std::vector<double> values = samples(metric);
+    const Stats s = computeStats(values);
+    snprintf(line, sizeof(line),
+             "  %-14s p50 %7.3f  p99 %7.3f  max %7.3f ms  (%zu samples)",
+             metricName(metric).c_str(), s.p50, s.p99, s.max, s.count);
+    os << line << std::endl;
+  }
+  for (size_t i = 0; i < m_budgets.size(); ++i) {
+    const size_t over = std::count_if(frameMs.begin(), frameMs.end(),
+                                      [&](double v) { return v > m_budgets[i]; });
+    snprintf(line, sizeof(line),
+             "  over %.1f ms: %zu of last %zu, %llu since start",
+             m_budgets[i], over, frameMs.size(),
+             (unsigned long long)m_overBudget[i]);
+    os << line << std::endl;
+  }
+  if (m_gpuDropped > 0) {
+    os << "  gpu timings dropped: " << m_gpuDropped << std::endl;
+  }
+}
+
+bool FrameTimer::dump(const std::string &path) const {
+  const bool json = path.size() >= 5 && path.substr(path.size() - 5) == ".json";
+  const bool ok = json ? dumpJson(path) : dumpCsv(path);
+  if (ok) {
+    std::cout << "frame timing written to " << path << std::endl;
+  }
+  return ok;
+}
+
+bool FrameTimer::dumpCsv(const std::string &path) const {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    std::cerr << "FrameTimer Error: cannot open " << path << std::endl;
+    return false;
+  }
+  bool anyGpu = false;
+  ofs << "frame,frame_ms";
+  for (const Phase &p : m_phases) {
+    ofs << ",cpu_" << p.name;
+  }
+  for (const Phase &p : m_phases) {
+    if (p.gpu) {
+      ofs << ",gpu_" << p.name;
+      anyGpu = true;
+    }
+  }
+  ofs << (anyGpu ? ",gpu_total\n" : "\n");
+
+  // 窗口内的帧, 从旧到新. GPU 未取回或被放弃的格子留空
+  char num[32];
+  const int64_t first =
+      std::max<int64_t>(0, m_frame - (int64_t)m_records.size());
+  for (int64_t f = first; f < m_frame; ++f) {
+    const Record &r = m_records[f % m_records.size()];
+    if (r.frame != f) {
+      continue;
+    }
+    snprintf(num, sizeof(num), "%.3f", r.frameMs);
+    ofs << f << "," << num;
+    for (double ms : r.cpuMs) {
+      snprintf(num, sizeof(num), "%.3f", ms);
+      ofs << "," << num;
+    }
+    double total = 0.0;
+    bool valid = true;
+    for (size_t i = 0; i < m_phases.size(); ++i) {
+      if (!m_phases[i].gpu) {
+        continue;
+      }
+      ofs << ",";
+      if (r.gpuMs[i] >= 0.0) {
+        snprintf(num, sizeof(num), "%.3f", r.gpuMs[i]);
+        ofs << num;
+        total += r.gpuMs[i];
+      } else {
+        valid = false;
+      }
+    }
+    if (anyGpu) {
+      ofs << ",";
+      if (valid) {
+        snprintf(num, sizeof(num), "%.3f", total);
+        ofs << num;
+      }
+    }
+    ofs << "\n";
+  }
+  return (bool)ofs;
+}
+
+bool FrameTimer::dumpJson(const std::string &path) const {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    std::cerr << "FrameTimer Error: cannot open " << path << std::endl;
+    return false;
+  }
+  std::vector<bool> gpu;
+  for (const Phase &p : m_phases) {
+    gpu.push_back(p.gpu);
+  }
+  const std::vector<double> frameMs = samples(-1);
+  char num[256];
+
+  ofs << "{\"frames\":" << m_frame << ",\"window\":" << frameMs.size()
+      << ",\"gpu_dropped\":" << m_gpuDropped << ",\n\"budgets\":[";
+  for (size_t i = 0; i < m_budgets.size(); ++i) {
+    const size_t over = std::count_if(frameMs.begin(), frameMs.end(),
+                                      [&](double v) { return v > m_budgets[i]; });
+    snprintf(num, sizeof(num),
+             "%s\n{\"ms\":%.3f,\"over\":%zu,\"over_total\":%llu}",
+             i ? "," : "", m_budgets[i], over,
+             (unsigned long long)m_overBudget[i]);
+    ofs << num;
+  }
+  ofs << "],\n\"metrics\":{";
+
+  bool first = true;
+  for (int metric : metricList((int)m_phases.size(), gpu)) {
+    std::vector<double> values = samples(metric);
+    const Stats s = computeStats(values);
+    snprintf(num, sizeof(num),
+             "%s\n\"%s\":{\"count\":%zu,\"mean\":%.3f,\"p50\":%.3f,"
+             "\"p90\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f,",
+             first ? "" : ",", metricName(metric).c_str(), s.count, s.mean,
+             s.p50, s.p90, s.p95, s.p99, s.max);
+    ofs << num;
+    first = false;
+
+    // 只写非空的格子: [起点 ms, 帧数]
+    std::vector<int> bins(kHistogramBins + 1, 0);
+    for (double v : values) {
+      ++bins[std::min((int)v, kHistogramBins)];
+    }
+    ofs << "\"histogram\":[";
+    bool firstBin = true;
+    for (int b = 0; b <= kHistogramBins; ++b) {
+      if (bins[b] > 0) {
+        ofs << (firstBin ? "" : ",") << "[" << b << "," << bins[b] << "]";
+        firstBin = false;
+      }
+    }
+    ofs << "]}";
+  }
+  ofs << "\n}}\n";
+  return (bool)ofs;
+}
+
+void FrameTimer::cleanup() {
+  for (QuerySlot &slot : m_slots) {
+    for (GLuint q : slot.queries) {
+      if (q != 0) {
+        glDeleteQueries(1, &q);
+      }
+    }
+  }
+  m_slots.clear();
+  m_inited = false;
+}
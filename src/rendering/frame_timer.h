@@ -0,0 +1,113 @@
+#ifndef FRAME_TIMER_H
+#define FRAME_TIMER_H
+
+#include <glad/glad.h>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// 渲染循环的帧时间: 每个阶段的 CPU 时间, 以及 GL_TIME_ELAPSED 查询得到的
+// GPU 时间. 查询对象按帧组成环, 结果晚几帧才取, 取时只看
+// GL_QUERY_RESULT_AVAILABLE, 从不阻塞; 环转一圈还没完成的那一帧放弃 GPU
+// 时间. 最近 history 帧保存在滚动窗口里, 按需算分位数和直方图,
+// 导出 csv (逐帧) 或 json (汇总)
+class FrameTimer {
+public:
+  // history: 滚动窗口的帧数. latency: 查询环的帧数, 即 GPU 结果最多晚几帧
+  explicit FrameTimer(int history = 600, int latency = 4);
+  ~FrameTimer();
+
+  FrameTimer(const FrameTimer &) = delete;
+  FrameTimer &operator=(const FrameTimer &) = delete;
+
+  // init 之前注册阶段, 返回阶段号. gpu 的阶段之间不能嵌套
+  // (GL_TIME_ELAPSED 同时只能有一个)
+  int addPhase(const std::string &name, bool gpu);
+  // 需要当前 GL 上下文, 生成查询对象
+  bool init();
+  // 帧时间预算 (ms), 统计超出的帧数. 默认 60 / 30 fps
+  void setBudgets(const std::vector<double> &budgetsMs) {
+    m_budgets = budgetsMs;
+    m_overBudget.assign(budgetsMs.size(), 0);
+  }
+
+  void beginFrame();
+  void endFrame();
+  void beginPhase(int phase);
+  void endPhase(int phase);
+
+  // beginPhase / endPhase 的作用域版本
+  class Scope {
+  public:
+    Scope(FrameTimer &timer, int phase) : m_timer(timer), m_phase(phase) {
+      m_timer.beginPhase(m_phase);
+    }
+    ~Scope() { m_timer.endPhase(m_phase); }
+
+  private:
+    FrameTimer &m_timer;
+    int m_phase;
+  };
+
+  // 窗口内每项的 p50 / p99 / max 和预算超出情况
+  void printSummary(std::ostream &os) const;
+  // .json 写汇总 (分位数、直方图、预算), 其他扩展名写逐帧 csv
+  bool dump(const std::string &path) const;
+  void cleanup();
+
+  uint64_t frames() const { return m_frame; }
+  // 查询环转一圈仍未完成而放弃的 GPU 帧数
+  uint64_t gpuDropped() const { return m_gpuDropped; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Phase {
+    std::string name;
+    bool gpu;
+  };
+  struct Record {
+    int64_t frame; // -1 表示空
+    double frameMs;
+    std::vector<double> cpuMs;
+    std::vector<double> gpuMs; // 结果未取回时为负
+  };
+  struct QuerySlot {
+    std::vector<GLuint> queries; // 每个阶段一个, 非 gpu 阶段为 0
+    std::vector<bool> issued;    // 这一帧是否提交过
+    int64_t frame;
+    bool pending;
+  };
+  struct Stats {
+    size_t count;
+    double mean, p50, p90, p95, p99, max;
+  };
+
+  // 取回已完成的查询, 不等待
+  void collect();
+  bool collectSlot(QuerySlot &slot);
+  // 窗口内某一项的全部有效样本: -1 整帧, [0, P) CPU 阶段,
+  // [P, 2P) GPU 阶段, 2P GPU 合计
+  std::vector<double> samples(int metric) const;
+  std::string metricName(int metric) const;
+  static Stats computeStats(std::vector<double> &values);
+  bool dumpCsv(const std::string &path) const;
+  bool dumpJson(const std::string &path) const;
+
+  std::vector<Phase> m_phases;
+  std::vector<Record> m_records; // 环, 第 frame % history 个
+  std::vector<QuerySlot> m_slots; // 环, 第 frame % latency 个
+  int m_latency;
+  bool m_inited;
+  int m_gpuActive; // 正在计时的 gpu 阶段, -1 没有
+  int64_t m_frame;  // 下一帧的序号, 也是已开始的帧数
+  Clock::time_point m_frameStart;
+  std::vector<Clock::time_point> m_phaseStart;
+  std::vector<double> m_budgets;
+  std::vector<uint64_t> m_overBudget; // 开始以来超出各预算的帧数
+  uint64_t m_gpuDropped;
+};
+
+#endif // FRAME_TIMER_H
@@ -0,0 +1,308 @@
+#include "gpu_stitcher.h"
+#include "shader.h"
+#include "trace.h"
+#include <cmath>
+#include <iostream>
+
+// 空纹理或从 data 上传, rowLength 为一行的像素数 (0 = 紧密排列)
+static GLuint createTexture(GLenum internalFormat, cv::Size size,
+                            GLenum format, GLenum type, const void *data,
+                            int rowLength, GLint filter) {
+  GLuint id = 0;
+  glGenTextures(1, &id);
+  glBindTexture(GL_TEXTURE_2D, id);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size.width, size.height, 0,
+               format, type, data);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return id;
+}
+
+// 查找表的一个区域写入样本 slot (0 = a, 1 = b). remap 的整数坐标和
+// 4 位小数还原为 1/16 像素的源坐标 x, 存为 16 位的 (x + 1) / (w + 1):
+// 帧外一个像素内的样本仍与边框黑色插值, 与 cv::remap 的 BORDER_CONSTANT 一致.
+// 完全落在帧外的样本记为相机 255, 着色器直接输出黑色
+static void fillLutRegion(const LutRegion &region, int slot,
+                          cv::Size frameSize, cv::Mat &coords,
+                          cv::Mat &meta) {
+  const float tab = 1.0f / 16;
+  const cv::Rect &roi = region.roi;
+  for (int y = 0; y < roi.height; ++y) {
+    const short *m1 = region.remap.xy.ptr<short>(y);
+    const uchar *m2 = region.remap.frac.ptr(y);
+    ushort *c = coords.ptr<ushort>(roi.y + y) + 4 * roi.x;
+    uchar *m = meta.ptr(roi.y + y) + 4 * roi.x;
+    for (int x = 0; x < roi.width; ++x) {
+      const float fx = m1[2 * x + 0] + (m2[x] & 15) * tab;
+      const float fy = m1[2 * x + 1] + (m2[x] >> 4) * tab;
+      const bool inside = fx > -1 && fy > -1 && fx < frameSize.width &&
+                          fy < frameSize.height;
+      c[4 * x + 2 * slot + 0] = cv::saturate_cast<ushort>(
+          (fx + 1) / (frameSize.width + 1) * 65535.0f);
+      c[4 * x + 2 * slot + 1] = cv::saturate_cast<ushort>(
+          (fy + 1) / (frameSize.height + 1) * 65535.0f);
+      m[4 * x + slot] = inside ? (uchar)region.cam : 255;
+    }
+  }
+}
+
+GpuStitcher::GpuStitcher()
+    : m_meanLod(0), m_awb(true), m_dirty(false),
+      m_mipDirty(false), m_cameraTex(0),
+      m_coordTex(0), m_metaTex(0), m_carTex(0), m_mosaicTex(0), m_fbo(0),
+      m_vao(0) {}
+
+GpuStitcher::~GpuStitcher() { cleanup(); }
+
+bool GpuStitcher::buildLutTextures(
+    const StitchLut &lut, const std::vector<cv::Mat> &merge_weights_img) {
+  // RGBA16: 样本 a / b 的坐标; RGBA8: 相机 a, 相机 b, a 的权重.
+  // 默认相机 255 (不覆盖, 黑色), 单相机区域 b 与 a 相同
+  cv::Mat coords(lut.size, CV_16UC4, cv::Scalar::all(0));
+  cv::Mat meta(lut.size, CV_8UC4, cv::Scalar::all(255));
+
+  for (int i = 0; i < 4; ++i) {
+    const LutRegion &body = lut.body[i];
+    if (body.remap.xy.size() != body.roi.size()) {
+      std::cerr << "GpuStitcher: bad lut region " << i << std::endl;
+      return false;
+    }
+    fillLutRegion(body, 0, m_frameSize, coords, meta);
+    fillLutRegion(body, 1, m_frameSize, coords, meta);
+
+    const cv::Rect &roi = lut.corner[i][0].roi;
+    const cv::Mat &w = merge_weights_img[lut.corner_weight[i]];
+    if (w.size() != roi.size() || w.depth() != CV_8U) {
+      std::cerr << "GpuStitcher: corner weight size mismatch " << i
+                << std::endl;
+      return false;
+    }
+    fillLutRegion(lut.corner[i][0], 0, m_frameSize, coords, meta);
+    fillLutRegion(lut.corner[i][1], 1, m_frameSize, coords, meta);
+    for (int y = 0; y < roi.height; ++y) {
+      const uchar *src = w.ptr(y);
+      uchar *m = meta.ptr(roi.y + y) + 4 * roi.x;
+      for (int x = 0; x < roi.width; ++x) {
+        m[4 * x + 2] = src[x * w.channels()];
+      }
+    }
+  }
+
+  m_coordTex = createTexture(GL_RGBA16, lut.size, GL_RGBA, GL_UNSIGNED_SHORT,
+                             coords.data, 0, GL_NEAREST);
+  m_metaTex = createTexture(GL_RGBA8, lut.size, GL_RGBA, GL_UNSIGNED_BYTE,
+                            meta.data, 0, GL_NEAREST);
+  return m_coordTex != 0 && m_metaTex != 0;
+}
+
+bool GpuStitcher::init(const std::string &shaderBasePath, const StitchLut &lut,
+                       const cv::Mat &car_img,
+                       const std::vector<cv::Mat> &merge_weights_img,
+                       cv::Size frameSize) {
+  AVM_TRACE_SCOPE("GpuStitcher::init");
+  cleanup();
+
+  // 1. 拼接着色器
+  m_shader = std::make_unique<Shader>((shaderBasePath + "stitch.vert").c_str(),
+                                      (shaderBasePath + "stitch.frag").c_str());
+  if (!m_shader || m_shader->ID == 0) {
+    std::cerr << "GpuStitcher Error: Failed to load stitch shader."
+              << std::endl;
+    return false;
+  }
+
+  if (frameSize.area() <= 0 || lut.size.area() <= 0 ||
+      car_img.size() != lut.car.size() || car_img.type() != CV_8UC3) {
+    std::cerr << "GpuStitcher Error: bad frame size or car image."
+              << std::endl;
+    return false;
+  }
+  m_frameSize = frameSize;
+  m_mosaicSize = lut.size;
+  m_carRect = lut.car;
+
+  // 2. 查找表和车辆图, 之后不再变化
+  if (!buildLutTextures(lut, merge_weights_img)) {
+    return false;
+  }
+  m_carTex = createTexture(GL_RGB8, car_img.size(), GL_BGR, GL_UNSIGNED_BYTE,
+                           car_img.data, (int)(car_img.step / 3), GL_NEAREST);
+
+  // 3. 4 路相机帧, 一个纹理数组. 白平衡时生成 mipmap, 1x1 层即均值
+  m_meanLod = (int)std::floor(
+      std::log2((double)std::max(frameSize.width, frameSize.height)));
+  glGenTextures(1, &m_cameraTex);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_cameraTex);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, frameSize.width,
+               frameSize.height, 4, 0, GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S,
+                  GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T,
+                  GL_CLAMP_TO_BORDER);
+  const float black[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, black);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  // 4. 拼接结果, 渲染目标
+  m_mosaicTex = createTexture(GL_RGB8, m_mosaicSize, GL_RGB, GL_UNSIGNED_BYTE,
+                              nullptr, 0, GL_LINEAR);
+  GLint prevFbo = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFbo);
+  glGenFramebuffers(1, &m_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         m_mosaicTex, 0);
+  const bool complete =
+      glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  if (complete) {
+    // 第一组帧到达前显示黑色
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
+  if (!complete) {
+    std::cerr << "GpuStitcher Error: mosaic framebuffer incomplete."
+              << std::endl;
+    return false;
+  }
+
+  glGenVertexArrays(1, &m_vao);
+
+  m_shader->use();
+  m_shader->setInt("cameras", 0);
+  m_shader->setInt("lutCoords", 1);
+  m_shader->setInt("lutMeta", 2);
+  m_shader->setInt("carImage", 3);
+  glUniform4i(glGetUniformLocation(m_shader->ID, "carRect"), m_carRect.x,
+              m_carRect.y, m_carRect.width, m_carRect.height);
+  m_shader->setInt("meanLod", m_meanLod);
+  glUseProgram(0);
+
+  std::cout << "GpuStitcher: " << m_mosaicSize.width << "x"
+            << m_mosaicSize.height << " mosaic from " << frameSize.width
+            << "x" << frameSize.height << " frames" << std::endl;
+  return true;
+}
+
+bool GpuStitcher::upload(const FrameSet &frames) {
+  AVM_TRACE_SCOPE("GpuStitcher::upload");
+  if (m_cameraTex == 0) {
+    return false;
+  }
+  if (frames.format != PIX_BGR) {
+    std::cerr << "GpuStitcher: bgr frames only" << std::endl;
+    return false;
+  }
+  for (int i = 0; i < 4; ++i) {
+    if (frames.img[i].size() != m_frameSize ||
+        frames.img[i].type() != CV_8UC3) {
+      std::cerr << "GpuStitcher: frame size mismatch, camera " << i
+                << std::endl;
+      return false;
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_cameraTex);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (int i = 0; i < 4; ++i) {
+    const cv::Mat &img = frames.img[i];
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(img.step / 3));
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, img.cols, img.rows, 1,
+                    GL_BGR, GL_UNSIGNED_BYTE, img.data);
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  m_dirty = true;
+  m_mipDirty = true;
+  return true;
+}
+
+void GpuStitcher::prepareFrames() {
+  if (!m_mipDirty) {
+    return;
+  }
+  // 白平衡统计: mipmap 到 1x1, 没有白平衡时只保留第 0 层
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_cameraTex);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                  m_awb ? m_meanLod : 0);
+  if (m_awb) {
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  }
+  m_mipDirty = false;
+}
+
+void GpuStitcher::stitch() {
+  if (!m_dirty) {
+    return;
+  }
+  AVM_TRACE_SCOPE("GpuStitcher::stitch");
+
+  prepareFrames();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, m_cameraTex);
+
+  GLint prevFbo = 0;
+  GLint viewport[4];
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFbo);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glViewport(0, 0, m_mosaicSize.width, m_mosaicSize.height);
+  glDisable(GL_DEPTH_TEST);
+
+  m_shader->use();
+  m_shader->setBool("awb", m_awb);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_coordTex);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, m_metaTex);
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(GL_TEXTURE_2D, m_carTex);
+
+  glBindVertexArray(m_vao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glBindVertexArray(0);
+
+  // 恢复调用者的状态
+  glActiveTexture(GL_TEXTURE0);
+  glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  if (depthTest) {
+    glEnable(GL_DEPTH_TEST);
+  }
+  m_dirty = false;
+}
+
+void GpuStitcher::cleanup() {
+  GLuint textures[5] = {m_cameraTex, m_coordTex, m_metaTex, m_carTex,
+                        m_mosaicTex};
+  for (GLuint &tex : textures) {
+    if (tex != 0) {
+      glDeleteTextures(1, &tex);
+    }
+  }
+  m_cameraTex = m_coordTex = m_metaTex = m_carTex = m_mosaicTex = 0;
+  if (m_fbo != 0) {
+    glDeleteFramebuffers(1, &m_fbo);
+    m_fbo = 0;
+  }
+  if (m_vao != 0) {
+    glDeleteVertexArrays(1, &m_vao);
+    m_vao = 0;
+  }
+  m_shader.reset();
+  m_dirty = false;
+  m_mipDirty = false;
+}
@@ -0,0 +1,66 @@
+#ifndef GPU_STITCHER_H
+#define GPU_STITCHER_H
+
+#include "frame_source.h"
+#include "stitch_lut.h"
+#include <glad/glad.h>
+#include <memory>
+#include <string>
+
+class Shader;
+
+// GPU 拼接: 4 路原始帧作为纹理上传, 去畸变、投影、白平衡和重叠角融合
+// 全部在片段着色器里按查找表纹理完成, CPU 只负责拷贝帧数据.
+// 只用 GL 3.3 core 的功能, Mesa 的软件实现 (llvmpipe) 上同样可用
+class GpuStitcher {
+public:
+  GpuStitcher();
+  ~GpuStitcher();
+
+  // lut / car_img / merge_weights_img 与 CPU 拼接相同 (loadAvmBundle),
+  // 上传后不再引用. frameSize 为 4 路相机帧的尺寸, 必须一致
+  bool init(const std::string &shaderBasePath, const StitchLut &lut,
+            const cv::Mat &car_img,
+            const std::vector<cv::Mat> &merge_weights_img,
+            cv::Size frameSize);
+
+  // 上传一组 bgr 帧, 下一次 stitch() 使用
+  bool upload(const FrameSet &frames);
+  // 有新帧时重新拼接到 mosaicTexture(), 结束后恢复原来的 framebuffer
+  // 和 viewport
+  void stitch();
+  // 只准备相机纹理 (白平衡统计), 供直接采样原始帧的绘制 (碗面) 使用
+  void prepareFrames();
+
+  void setAwb(bool enable) { m_awb = enable; }
+  bool awb() const { return m_awb; }
+  int meanLod() const { return m_meanLod; }
+  GLuint cameraTexture() const { return m_cameraTex; }
+  GLuint mosaicTexture() const { return m_mosaicTex; }
+  cv::Size mosaicSize() const { return m_mosaicSize; }
+
+  void cleanup();
+
+private:
+  bool buildLutTextures(const StitchLut &lut,
+                        const std::vector<cv::Mat> &merge_weights_img);
+
+  std::unique_ptr<Shader> m_shader;
+  cv::Size m_frameSize;
+  cv::Size m_mosaicSize;
+  cv::Rect m_carRect;
+  int m_meanLod; // 1x1 的 mipmap 层
+  bool m_awb;
+  bool m_dirty;    // 上传了新帧, 还没拼接
+  bool m_mipDirty; // 上传了新帧, 还没生成白平衡统计
+
+  GLuint m_cameraTex; // GL_TEXTURE_2D_ARRAY, 4 层
+  GLuint m_coordTex;
+  GLuint m_metaTex;
+  GLuint m_carTex;
+  GLuint m_mosaicTex;
+  GLuint m_fbo;
+  GLuint m_vao; // core profile 绘制需要绑定一个 (空的) VAO
+};
+
+#endif // GPU_STITCHER_H
@@ -1,20 +1,31 @@
 #include "mesh.h"
+#include "trace.h"
 #include <glad/glad.h>
+#include <cstdint>
 #include <iostream> // For potential error messages
 
 Mesh::Mesh(const std::vector<Vertex> &vertices,
            const std::vector<unsigned int> &indices,
            const std::vector<TextureInfo> &textures)
     : vertices(vertices), indices(indices), textures(textures), VAO(0), VBO(0),
-      EBO(0) {
-  setupMesh();
+      EBO(0), indexCount(indices.size()), indexType(GL_UNSIGNED_INT) {
+  setupMesh(vertices.data(), vertices.size(), indices.data());
+}
+
+Mesh::Mesh(const Vertex *vertexData, size_t vertexCount,
+           const void *indexData, size_t indexCount, GLenum indexType,
+           const std::vector<TextureInfo> &textures)
+    : textures(textures), VAO(0), VBO(0), EBO(0), indexCount(indexCount),
+      indexType(indexType) {
+  setupMesh(vertexData, vertexCount, indexData);
 }
 
 Mesh::~Mesh() {
   // cleanup(); // 析构函数可以调用 cleanup，或者依赖外部调用
 }
 
-void Mesh::setupMesh() {
+void Mesh::setupMesh(const Vertex *vertexData, size_t vertexCount,
+                     const void *indexData) {
   // 1. 创建缓冲和数组对象
   glGenVertexArrays(1, &VAO);
   glGenBuffers(1, &VBO);
@@ -25,13 +36,15 @@ void Mesh::setupMesh() {
 
   // 3. 绑定 VBO 并加载顶点数据
   glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0],
+  glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData,
                GL_STATIC_DRAW);
 
   // 4. 绑定 EBO 并加载索引数据
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-               &indices[0], GL_STATIC_DRAW);
+  const size_t indexSize =
+      indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indexData,
+               GL_STATIC_DRAW);
 
   // 5. 设置顶点属性指针
   // a. 位置属性 (location = 0)
@@ -55,13 +68,14 @@ void Mesh::setupMesh() {
 }
 
 void Mesh::draw() {
+  AVM_TRACE_SCOPE("Mesh::draw");
   // 假设 Renderer 已经绑定了正确的着色器和激活/绑定了纹理单元
 
   // 绑定此网格的 VAO
   glBindVertexArray(VAO);
   // 执行绘制调用
-  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()),
-                 GL_UNSIGNED_INT, 0);
+  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indexCount), indexType,
+                 0);
   // 解绑 VAO
   glBindVertexArray(0);
 
@@ -34,6 +34,12 @@ public:
   Mesh(const std::vector<Vertex> &vertices,
        const std::vector<unsigned int> &indices,
        const std::vector<TextureInfo> &textures);
+  // 直接从内存 (如 mmap 的模型缓存) 上传, 不保留 CPU 端的拷贝,
+  // vertices / indices 成员为空. indexType 为 GL_UNSIGNED_SHORT 或
+  // GL_UNSIGNED_INT
+  Mesh(const Vertex *vertexData, size_t vertexCount, const void *indexData,
+       size_t indexCount, GLenum indexType,
+       const std::vector<TextureInfo> &textures);
   ~Mesh(); // 添加析构函数声明
 
   // 渲染网格 (由 Renderer 调用)
@@ -46,9 +52,12 @@ public:
 private:
   // 渲染对象
   GLuint VBO, EBO;
+  size_t indexCount;
+  GLenum indexType;
 
   // 初始化和设置缓冲
-  void setupMesh();
+  void setupMesh(const Vertex *vertexData, size_t vertexCount,
+                 const void *indexData);
 };
 
 #endif // MESH_H
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "offscreen.h"
+#include "trace.h"
+#include <chrono>
+#include <iostream>
+
+OffscreenTarget::OffscreenTarget()
+    : m_width(0), m_height(0), m_fbo(0), m_color(0), m_depth(0) {}
+
+OffscreenTarget::~OffscreenTarget() { cleanup(); }
+
+bool OffscreenTarget::init(int width, int height) {
+  cleanup();
+  m_width = width;
+  m_height = height;
+
+  glGenRenderbuffers(1, &m_color);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &m_depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &m_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, m_color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, m_depth);
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "OffscreenTarget Error: framebuffer incomplete 0x" << std::hex
+              << status << std::dec << std::endl;
+    cleanup();
+    return false;
+  }
+  return true;
+}
+
+void OffscreenTarget::bind() {
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glViewport(0, 0, m_width, m_height);
+}
+
+void OffscreenTarget::unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+
+void OffscreenTarget::cleanup() {
+  if (m_fbo != 0) {
+    glDeleteFramebuffers(1, &m_fbo);
+    m_fbo = 0;
+  }
+  if (m_color != 0) {
+    glDeleteRenderbuffers(1, &m_color);
+    m_color = 0;
+  }
+  if (m_depth != 0) {
+    glDeleteRenderbuffers(1, &m_depth);
+    m_depth = 0;
+  }
+}
+
+AsyncReadback::AsyncReadback()
+    : m_width(0), m_height(0), m_bytes(0), m_head(0), m_pending(0),
+      m_completed(0), m_stalls(0), m_stallMs(0.0) {}
+
+AsyncReadback::~AsyncReadback() { cleanup(); }
+
+bool AsyncReadback::init(int width, int height, int depth,
+                         const Callback &callback) {
+  cleanup();
+  if (width <= 0 || height <= 0 || depth < 1) {
+    std::cerr << "AsyncReadback Error: bad size " << width << "x" << height
+              << " or depth " << depth << std::endl;
+    return false;
+  }
+  m_width = width;
+  m_height = height;
+  m_bytes = (size_t)width * height * 3;
+  m_callback = callback;
+
+  m_slots.assign(depth, Slot{0, nullptr, -1});
+  for (Slot &slot : m_slots) {
+    glGenBuffers(1, &slot.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    // GPU 写, CPU 读
+    glBufferData(GL_PIXEL_PACK_BUFFER, m_bytes, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return true;
+}
+
+void AsyncReadback::read(int64_t tag) {
+  AVM_TRACE_SCOPE("AsyncReadback::read");
+  if (m_pending == (int)m_slots.size()) {
+    // 环满: 最旧的一个必须先交出才能复用它的缓冲
+    const auto start = std::chrono::steady_clock::now();
+    deliver(m_slots[m_head]);
+    m_stallMs += std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    ++m_stalls;
+  }
+
+  Slot &slot = m_slots[(m_head + m_pending) % m_slots.size()];
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  // 行紧密排列, 和 cv::Mat 的 bgr 一致
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, m_width, m_height, GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.tag = tag;
+  ++m_pending;
+  // 让驱动开始执行, 否则 fence 可能一直留在命令缓冲里
+  glFlush();
+}
+
+int AsyncReadback::poll(bool wait) {
+  int delivered = 0;
+  while (m_pending > 0) {
+    Slot &slot = m_slots[m_head];
+    if (!wait) {
+      const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        break;
+      }
+    }
+    deliver(slot);
+    ++delivered;
+  }
+  return delivered;
+}
+
+void AsyncReadback::deliver(Slot &slot) {
+  AVM_TRACE_SCOPE("AsyncReadback::deliver");
+  glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  const void *data =
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_bytes, GL_MAP_READ_BIT);
+  if (data) {
+    // GL 的第一行在底部, 拷贝的同时上下翻转
+    const cv::Mat mapped(m_height, m_width, CV_8UC3, (void *)data);
+    cv::Mat image;
+    cv::flip(mapped, image, 0);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    ++m_completed;
+    if (m_callback) {
+      m_callback(slot.tag, image);
+    }
+  } else {
+    std::cerr << "AsyncReadback Error: failed to map pixel buffer for "
+              << slot.tag << std::endl;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  m_head = (m_head + 1) % (int)m_slots.size();
+  --m_pending;
+}
+
+void AsyncReadback::cleanup() {
+  for (Slot &slot : m_slots) {
+    if (slot.fence) {
+      glDeleteSync(slot.fence);
+    }
+    glDeleteBuffers(1, &slot.pbo);
+  }
+  m_slots.clear();
+  m_head = 0;
+  m_pending = 0;
+}
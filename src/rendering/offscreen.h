@@ -0,0 +1,85 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <functional>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// 离屏渲染目标: FBO + RGBA8 颜色 / 24 位深度 renderbuffer,
+// 没有窗口 (surfaceless 上下文) 时代替默认 framebuffer
+class OffscreenTarget {
+public:
+  OffscreenTarget();
+  ~OffscreenTarget();
+
+  OffscreenTarget(const OffscreenTarget &) = delete;
+  OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+  bool init(int width, int height);
+  // 绑定为读写 framebuffer 并设置 viewport
+  void bind();
+  void unbind();
+  void cleanup();
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+
+private:
+  int m_width;
+  int m_height;
+  GLuint m_fbo;
+  GLuint m_color;
+  GLuint m_depth;
+};
+
+// 异步回读: 像素缓冲 (PBO) 组成的环. read 只提交 glReadPixels 到下一个
+// 缓冲并插入 fence, 不等 GPU; poll 把 fence 已完成的缓冲按提交顺序映射,
+// 翻转成自上而下的 bgr 图交给回调. 环满时 read 先等最旧的一个
+class AsyncReadback {
+public:
+  // tag 是 read 时传入的标识. 回调可以把 image 移走
+  using Callback = std::function<void(int64_t tag, cv::Mat &image)>;
+
+  AsyncReadback();
+  ~AsyncReadback();
+
+  AsyncReadback(const AsyncReadback &) = delete;
+  AsyncReadback &operator=(const AsyncReadback &) = delete;
+
+  bool init(int width, int height, int depth, const Callback &callback);
+  // 读当前 GL_READ_FRAMEBUFFER 的 (0, 0, width, height)
+  void read(int64_t tag);
+  // 交出已完成的回读, wait 时等所有已提交的. 返回交出的个数
+  int poll(bool wait);
+  void cleanup();
+
+  uint64_t completed() const { return m_completed; }
+  // 环满时 read 等待的次数和总时间
+  uint64_t stalls() const { return m_stalls; }
+  double stallMs() const { return m_stallMs; }
+
+private:
+  struct Slot {
+    GLuint pbo;
+    GLsync fence;
+    int64_t tag;
+  };
+
+  // 映射 slot, 拷贝给回调, 释放 fence
+  void deliver(Slot &slot);
+
+  int m_width;
+  int m_height;
+  size_t m_bytes;
+  Callback m_callback;
+  std::vector<Slot> m_slots;
+  int m_head;    // 最旧的未交出的回读
+  int m_pending; // 已提交未交出的个数
+  uint64_t m_completed;
+  uint64_t m_stalls;
+  double m_stallMs;
+};
+
+#endif // OFFSCREEN_H
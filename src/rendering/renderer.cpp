@@ -1,16 +1,22 @@
 #include "renderer.h"
+#include "avm_pipeline.h"
 #include "common.h"
+#include "gpu_stitcher.h"
 #include "mesh.h"
+#include "mesh_cache.h"
 #include "model_loader.h"
 #include "shader.h"
+#include "streaming_texture.h"
 #include "texture_utils.h"
+#include "trace.h"
 #include <glad/glad.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <vector>
 
-Renderer::Renderer(const std::string &dataPath)
-    : m_dataPath(dataPath), m_sampleTextureId(0) {} // 初始化 texture ID
+Renderer::Renderer(const std::string &dataPath, bool gpuStitch, bool bowl)
+    : m_dataPath(dataPath), m_sampleTextureId(0),
+      m_gpuStitch(gpuStitch || bowl), m_bowl(bowl), m_bowlLod(0) {}
 
 Renderer::~Renderer() {
   cleanup(); // 确保 cleanup 被调用
@@ -27,9 +33,46 @@ bool Renderer::init() {
   }
   std::cout << "Renderer: Basic shader loaded successfully." << std::endl;
 
-  // 2. 加载纹理 (保持不变)
+  // 2. 加载纹理. GPU 拼接时贴图为拼接结果, 查找表等与 CPU 拼接相同
   std::string texturePath = m_dataPath + "/textures/sample_front.png";
-  m_sampleTextureId = loadTexture(texturePath.c_str());
+  if (m_gpuStitch) {
+    RigBundle bundle;
+    cv::Mat car_img;
+    std::vector<cv::Mat> weights;
+    CameraPrms prms[4];
+    StitchLut lut;
+    if (!loadAvmBundle(m_dataPath, bundle, car_img, weights, prms, lut)) {
+      std::cerr << "Renderer Error: Failed to load rig data." << std::endl;
+      return false;
+    }
+    // 4 路帧共用一个纹理数组
+    for (int i = 1; i < 4; ++i) {
+      if (prms[i].size != prms[0].size) {
+        std::cerr << "Renderer Error: gpu stitching needs equal frame sizes."
+                  << std::endl;
+        return false;
+      }
+    }
+    m_stitcher = std::make_unique<GpuStitcher>();
+    if (!m_stitcher->init(shaderBasePath, lut, car_img, weights,
+                          prms[0].size)) {
+      std::cerr << "Renderer Error: Failed to init gpu stitching."
+                << std::endl;
+      return false;
+    }
+    if (m_bowl) {
+      // 碗面代替拼接图, 车模保留自己的贴图
+      if (!initBowl(shaderBasePath, prms, weights)) {
+        return false;
+      }
+      m_sampleTextureId = loadTexture(texturePath.c_str());
+    } else {
+      m_sampleTextureId = m_stitcher->mosaicTexture();
+      texturePath = "gpu_stitch";
+    }
+  } else {
+    m_sampleTextureId = loadTexture(texturePath.c_str());
+  }
   if (m_sampleTextureId == 0) {
     std::cerr << "Renderer Warning: Failed to load sample texture. Continuing "
                  "without texture."
@@ -40,12 +83,16 @@ bool Renderer::init() {
               << std::endl;
   }
 
-  // 3. 加载模型数据
+  // 3. 加载模型数据. 优先用 mmap 的二进制缓存 (首次运行时从 obj 生成),
+  //    缓存里的顶点和索引直接上传, 缓存不可用时才解析 obj
   std::vector<Vertex> loadedVertices;
   std::vector<unsigned int> loadedIndices;
   std::string modelPath =
       m_dataPath + "/models/car.obj"; // <--- 修改为你的模型路径
-  if (!loadModel(modelPath, loadedVertices, loadedIndices)) {
+  MeshCache modelCache;
+  const bool cached =
+      loadModelCached(modelPath, m_dataPath + "/cache/car.mesh", modelCache);
+  if (!cached && !loadModel(modelPath, loadedVertices, loadedIndices)) {
     std::cerr << "Renderer Error: Failed to load model: " << modelPath
               << std::endl;
     // 如果模型加载失败，可以选择创建一个默认的平面或返回错误
@@ -66,8 +113,15 @@ bool Renderer::init() {
   }
 
   // 5. 创建 Mesh 对象 (使用加载的数据或后备数据)
-  m_surroundMesh =
-      std::make_unique<Mesh>(loadedVertices, loadedIndices, textures);
+  if (cached) {
+    m_surroundMesh = std::make_unique<Mesh>(
+        modelCache.vertices(), modelCache.vertexCount(), modelCache.indices(),
+        modelCache.indexCount(), modelCache.indexType(), textures);
+    modelCache.close();
+  } else {
+    m_surroundMesh =
+        std::make_unique<Mesh>(loadedVertices, loadedIndices, textures);
+  }
   if (!m_surroundMesh || m_surroundMesh->VAO == 0) {
     std::cerr << "Renderer Error: Failed to create surround mesh." << std::endl;
     return false;
@@ -76,10 +130,83 @@ bool Renderer::init() {
 
   return true;
 }
+StreamingTexture *Renderer::enableMosaicStream(int width, int height) {
+  if (m_gpuStitch) {
+    std::cerr << "Renderer Error: mosaic streaming and gpu stitching are "
+                 "exclusive."
+              << std::endl;
+    return nullptr;
+  }
+  auto stream = std::make_unique<StreamingTexture>();
+  if (!stream->init(width, height)) {
+    return nullptr;
+  }
+  if (m_sampleTextureId != 0) {
+    glDeleteTextures(1, &m_sampleTextureId);
+  }
+  m_stream = std::move(stream);
+  m_sampleTextureId = m_stream->texture();
+  return m_stream.get();
+}
+
+bool Renderer::initBowl(const std::string &shaderBasePath,
+                        const CameraPrms prms[4],
+                        const std::vector<cv::Mat> &weights) {
+  m_bowlShader =
+      std::make_unique<Shader>((shaderBasePath + "bowl.vert").c_str(),
+                               (shaderBasePath + "bowl.frag").c_str());
+  if (!m_bowlShader || m_bowlShader->ID == 0) {
+    std::cerr << "Renderer Error: Failed to load bowl shader." << std::endl;
+    return false;
+  }
+  RigLayout layout;
+  if (!load_rig_layout(m_dataPath, layout)) {
+    std::cerr << "Renderer Error: Failed to load rig layout." << std::endl;
+    return false;
+  }
+  m_bowlMesh = std::make_unique<BowlMesh>();
+  if (!m_bowlMesh->init(m_bowlParams, prms, layout, weights)) {
+    std::cerr << "Renderer Error: Failed to create bowl mesh." << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Renderer::uploadFrames(const FrameSet &frames) {
+  return m_stitcher && m_stitcher->upload(frames);
+}
+
 void Renderer::draw(const glm::mat4 &view, const glm::mat4 &projection) {
+  AVM_TRACE_SCOPE("Renderer::draw");
+  // 新帧先拼接到贴图, 拼接结束时恢复当前 framebuffer
+  // 碗面直接采样原始帧, 不需要拼接图
+  if (m_bowlMesh) {
+    m_stitcher->prepareFrames();
+  } else if (m_stitcher) {
+    m_stitcher->stitch();
+  }
+  // 流式贴图: 上传生产者最新写完的一帧, 没有新帧时沿用上一帧
+  if (m_stream) {
+    m_stream->update();
+  }
   glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+  if (m_bowlMesh && m_bowlShader) {
+    AVM_TRACE_SCOPE("Renderer::drawBowl");
+    m_bowlShader->use();
+    m_bowlShader->setMat4("model", glm::mat4(1.0f));
+    m_bowlShader->setMat4("view", view);
+    m_bowlShader->setMat4("projection", projection);
+    m_bowlShader->setInt("meanLod", m_stitcher->meanLod());
+    m_bowlShader->setBool("awb", m_stitcher->awb());
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_stitcher->cameraTexture());
+    m_bowlShader->setInt("cameras", 0);
+    m_bowlMesh->draw(m_bowlLod);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  }
+
   if (!m_basicShader || !m_surroundMesh) {
     std::cerr << "Renderer Error: Shader or Mesh not ready for drawing."
               << std::endl;
@@ -123,7 +250,26 @@ void Renderer::cleanup() {
     m_surroundMesh.reset();
   }
 
-  // 删除纹理
+  if (m_bowlMesh) {
+    m_bowlMesh->cleanup();
+    m_bowlMesh.reset();
+  }
+  m_bowlShader.reset();
+
+  if (m_stream) {
+    m_stream->cleanup();
+    m_stream.reset();
+    m_sampleTextureId = 0;
+  }
+
+  // 删除纹理, GPU 拼接的贴图由 GpuStitcher 释放
+  if (m_stitcher) {
+    if (m_sampleTextureId == m_stitcher->mosaicTexture()) {
+      m_sampleTextureId = 0;
+    }
+    m_stitcher->cleanup();
+    m_stitcher.reset();
+  }
   if (m_sampleTextureId != 0) {
     glDeleteTextures(1, &m_sampleTextureId);
     m_sampleTextureId = 0;
@@ -2,6 +2,7 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include "bowl_mesh.h"
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <memory>
@@ -10,13 +11,29 @@
 
 class Shader;
 class Mesh; // 前向声明 Mesh
+class GpuStitcher;
+class StreamingTexture;
+struct FrameSet;
 
 class Renderer {
 public:
-  Renderer(const std::string &dataPath);
+  // gpuStitch: 网格贴图换成 GPU 拼接的环视图, 帧由 uploadFrames 送入.
+  // bowl: 在车模周围画 3D 碗面, 直接采样原始帧 (隐含 gpuStitch)
+  Renderer(const std::string &dataPath, bool gpuStitch = false,
+           bool bowl = false);
   ~Renderer();
 
+  // 碗面的形状和分辨率, 在 init 之前设置
+  void setBowlParams(const BowlParams &params) { m_bowlParams = params; }
+  // 碗面的细节层次, 0 最精细, 超出范围时取最近的一层
+  void setBowlLod(int lod) { m_bowlLod = lod; }
+
   bool init();
+  // 网格贴图换成流式纹理, 由其他线程 (CPU 拼接) 写入, init 之后调用.
+  // 纹理归 Renderer 所有, 生产者线程要在 cleanup 之前退出
+  StreamingTexture *enableMosaicStream(int width, int height);
+  // 一组原始相机帧, 下一次 draw 时在 GPU 上拼接 (仅 gpuStitch)
+  bool uploadFrames(const FrameSet &frames);
   void draw(const glm::mat4 &view, const glm::mat4 &projection);
   void cleanup();
 
@@ -26,6 +43,17 @@ private:
   // std::unique_ptr<Mesh> m_triangleMesh; // 移除旧的三角形 VAO/VBO
   std::unique_ptr<Mesh> m_surroundMesh; // 用于环视的网格
   GLuint m_sampleTextureId;             // 存储加载的纹理 ID
+  bool m_gpuStitch;
+  std::unique_ptr<GpuStitcher> m_stitcher;
+  std::unique_ptr<StreamingTexture> m_stream;
+  bool m_bowl;
+  BowlParams m_bowlParams;
+  int m_bowlLod;
+  std::unique_ptr<Shader> m_bowlShader;
+  std::unique_ptr<BowlMesh> m_bowlMesh;
+
+  bool initBowl(const std::string &shaderBasePath, const CameraPrms prms[4],
+                const std::vector<cv::Mat> &weights);
 
   // 移除 setupTriangle
   // bool setupTriangle();
@@ -0,0 +1,247 @@
+#include "streaming_texture.h"
+#include "trace.h"
+#include <chrono>
+#include <iostream>
+
+StreamingTexture::StreamingTexture()
+    : m_width(0), m_height(0), m_bytes(0), m_persistent(false), m_texture(0),
+      m_stopped(false), m_seq(0), m_uploaded(0), m_dropped(0) {}
+
+StreamingTexture::~StreamingTexture() { cleanup(); }
+
+bool StreamingTexture::init(int width, int height, int slots) {
+  cleanup();
+  if (width <= 0 || height <= 0 || slots < 2) {
+    std::cerr << "StreamingTexture Error: bad size " << width << "x" << height
+              << " or slot count " << slots << std::endl;
+    return false;
+  }
+  m_width = width;
+  m_height = height;
+  m_bytes = (size_t)width * height * 3;
+  m_persistent = GLAD_GL_VERSION_4_4 != 0;
+
+  glGenTextures(1, &m_texture);
+  glBindTexture(GL_TEXTURE_2D, m_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_BGR,
+               GL_UNSIGNED_BYTE, nullptr);
+  // 每帧都在变, 不生成 mipmap
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  m_slots.assign(slots, Slot{0, nullptr, nullptr, SLOT_UNMAPPED, 0});
+  for (Slot &slot : m_slots) {
+    glGenBuffers(1, &slot.pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+    if (m_persistent) {
+      // 一直映射, coherent 让之后的 GL 命令看到 CPU 的写入
+      const GLbitfield flags =
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, m_bytes, nullptr, flags);
+      slot.data = (uint8_t *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                              m_bytes, flags);
+    } else {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, m_bytes, nullptr, GL_STREAM_DRAW);
+      slot.data = (uint8_t *)glMapBufferRange(
+          GL_PIXEL_UNPACK_BUFFER, 0, m_bytes,
+          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+    if (!slot.data) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      std::cerr << "StreamingTexture Error: failed to map pixel buffer."
+                << std::endl;
+      cleanup();
+      return false;
+    }
+    slot.state = SLOT_FREE;
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  std::cout << "StreamingTexture: " << width << "x" << height << ", "
+            << slots << " pixel buffers, "
+            << (m_persistent ? "persistent" : "remapped") << " mapping"
+            << std::endl;
+  return true;
+}
+
+uint8_t *StreamingTexture::beginWrite(int &slot, int timeoutMs) {
+  AVM_TRACE_SCOPE("StreamingTexture::beginWrite");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  int found = -1;
+  m_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] {
+    if (m_stopped) {
+      return true;
+    }
+    // 空闲的优先, 否则接管最旧的未上传帧
+    int oldest = -1;
+    for (int i = 0; i < (int)m_slots.size(); ++i) {
+      if (m_slots[i].state == SLOT_FREE) {
+        found = i;
+        return true;
+      }
+      if (m_slots[i].state == SLOT_READY &&
+          (oldest < 0 || m_slots[i].seq < m_slots[oldest].seq)) {
+        oldest = i;
+      }
+    }
+    if (oldest >= 0) {
+      found = oldest;
+      ++m_dropped;
+    }
+    return found >= 0;
+  });
+  if (m_stopped || found < 0) {
+    return nullptr;
+  }
+  slot = found;
+  m_slots[found].state = SLOT_WRITING;
+  return m_slots[found].data;
+}
+
+void StreamingTexture::endWrite(int slot) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_slots[slot].state = SLOT_READY;
+  m_slots[slot].seq = ++m_seq;
+}
+
+void StreamingTexture::cancelWrite(int slot) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slots[slot].state = SLOT_FREE;
+  }
+  m_cond.notify_one();
+}
+
+void StreamingTexture::stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopped = true;
+  }
+  m_cond.notify_all();
+}
+
+bool StreamingTexture::mapSlot(Slot &slot) {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+  // fence 已过, GPU 不再读这块缓冲, 不需要驱动再同步
+  slot.data = (uint8_t *)glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, m_bytes,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  return slot.data != nullptr;
+}
+
+bool StreamingTexture::update() {
+  if (m_texture == 0) {
+    return false;
+  }
+  AVM_TRACE_SCOPE("StreamingTexture::update");
+
+  // 1. GPU 已读完的缓冲还给生产者, 不等待未完成的 fence.
+  //    UNMAPPED / UPLOADING 只有渲染线程会改, GL 调用不用持锁
+  std::vector<int> pending;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int i = 0; i < (int)m_slots.size(); ++i) {
+      if (m_slots[i].state == SLOT_UNMAPPED ||
+          m_slots[i].state == SLOT_UPLOADING) {
+        pending.push_back(i);
+      }
+    }
+  }
+  bool freed = false;
+  for (int i : pending) {
+    Slot &slot = m_slots[i];
+    if (slot.fence) {
+      const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        continue;
+      }
+      glDeleteSync(slot.fence);
+      slot.fence = nullptr;
+    }
+    const bool mapped = m_persistent || mapSlot(slot);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    slot.state = mapped ? SLOT_FREE : SLOT_UNMAPPED;
+    freed |= mapped;
+  }
+  if (freed) {
+    m_cond.notify_all();
+  }
+
+  // 2. 最新写完的一帧开始上传, 更旧的直接丢弃
+  int next = -1;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int i = 0; i < (int)m_slots.size(); ++i) {
+      if (m_slots[i].state == SLOT_READY &&
+          (next < 0 || m_slots[i].seq > m_slots[next].seq)) {
+        next = i;
+      }
+    }
+    if (next < 0) {
+      return false;
+    }
+    for (Slot &slot : m_slots) {
+      if (slot.state == SLOT_READY && &slot != &m_slots[next]) {
+        slot.state = SLOT_FREE;
+        ++m_dropped;
+      }
+    }
+    m_slots[next].state = SLOT_UPLOADING;
+    ++m_uploaded;
+  }
+  m_cond.notify_all();
+
+  Slot &slot = m_slots[next];
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+  if (!m_persistent) {
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    slot.data = nullptr;
+  }
+  glBindTexture(GL_TEXTURE_2D, m_texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, GL_BGR,
+                  GL_UNSIGNED_BYTE, nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  return true;
+}
+
+uint64_t StreamingTexture::uploaded() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_uploaded;
+}
+
+uint64_t StreamingTexture::dropped() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_dropped;
+}
+
+void StreamingTexture::cleanup() {
+  stop();
+  if (!m_slots.empty()) {
+    for (Slot &slot : m_slots) {
+      if (slot.fence) {
+        glDeleteSync(slot.fence);
+      }
+      if (slot.data) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      }
+      glDeleteBuffers(1, &slot.pbo);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    m_slots.clear();
+  }
+  if (m_texture != 0) {
+    glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stopped = false;
+}
@@ -0,0 +1,83 @@
+#ifndef STREAMING_TEXTURE_H
+#define STREAMING_TEXTURE_H
+
+#include <glad/glad.h>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// 流式纹理: 2-3 个像素缓冲 (PBO) 组成的环, 生产者线程直接写映射好的
+// 缓冲, 渲染线程从 PBO 异步 glTexSubImage2D, 用 fence 判断 GPU 何时读完
+// 可以复用. 渲染线程不等待拷贝, 也没有多一次的 CPU 拷贝.
+// GL 4.4 (glBufferStorage) 时缓冲持久映射; 3.3 时每次上传前解除映射,
+// fence 完成后再映射回来交给生产者
+class StreamingTexture {
+public:
+  StreamingTexture();
+  ~StreamingTexture();
+
+  StreamingTexture(const StreamingTexture &) = delete;
+  StreamingTexture &operator=(const StreamingTexture &) = delete;
+
+  // 渲染线程 (持有 GL 上下文). bgr 8 位, 行距 width * 3
+  bool init(int width, int height, int slots = 3);
+
+  // 生产者线程: 取一个可写的缓冲, 没有空闲时接管最旧的未上传帧 (丢帧),
+  // 都在上传中时等待. 超时或 stop() 后返回 nullptr
+  uint8_t *beginWrite(int &slot, int timeoutMs = 100);
+  // 写完, 下一次 update() 上传最新写完的一帧
+  void endWrite(int slot);
+  // 放弃写入, 缓冲还给空闲队列
+  void cancelWrite(int slot);
+  // 唤醒并拒绝之后的 beginWrite, cleanup 之前调用并等生产者退出
+  void stop();
+
+  // 渲染线程, 每帧一次: 回收 GPU 已读完的缓冲, 上传最新的一帧.
+  // 有新帧上传时返回 true
+  bool update();
+
+  GLuint texture() const { return m_texture; }
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  int stride() const { return m_width * 3; }
+  bool persistent() const { return m_persistent; }
+  uint64_t uploaded() const;
+  uint64_t dropped() const;
+
+  void cleanup();
+
+private:
+  enum SlotState {
+    SLOT_UNMAPPED,  // 3.3: 等渲染线程映射
+    SLOT_FREE,      // 已映射, 生产者可写
+    SLOT_WRITING,   // 生产者正在写
+    SLOT_READY,     // 写完, 等上传
+    SLOT_UPLOADING, // 已提交上传, 等 fence
+  };
+  struct Slot {
+    GLuint pbo;
+    uint8_t *data; // 映射的地址, 未映射时为 nullptr
+    GLsync fence;
+    SlotState state;
+    uint64_t seq; // 写完的顺序, 只上传最新的
+  };
+
+  bool mapSlot(Slot &slot);
+
+  int m_width;
+  int m_height;
+  size_t m_bytes;
+  bool m_persistent;
+  GLuint m_texture;
+  std::vector<Slot> m_slots;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cond;
+  bool m_stopped;
+  uint64_t m_seq;
+  uint64_t m_uploaded;
+  uint64_t m_dropped;
+};
+
+#endif // STREAMING_TEXTURE_H
@@ -1,4 +1,6 @@
 #include "camera.h"
+#include <algorithm>
+#include <glm/gtc/constants.hpp>
 #include <vector> // 虽然当前实现未使用，但未来处理输入可能需要
 
 // --- 构造函数实现 ---
@@ -54,4 +56,65 @@ void Camera::updateCameraVectors() {
   Right = glm::normalize(glm::cross(Front, WorldUp));
   // Up 向量 = Right 向量与 Front 向量的叉积 (标准化)
   Up = glm::normalize(glm::cross(Right, Front));
-}
\ No newline at end of file
+}
+
+bool setCameraPreset(Camera &camera, int viewIndex) {
+  const float distance =
+      8.0f; // Distance from the car center (adjust as needed)
+  const float angle45 = glm::radians(45.0f);
+  const float height = distance * glm::sin(angle45);         // Approx 5.65
+  const float horizontalDist = distance * glm::cos(angle45); // Approx 5.65
+  const float sideOffset =
+      distance * glm::cos(angle45) * glm::cos(angle45); // Approx 4.0
+
+  switch (viewIndex) {
+  case 1: // 车正上方俯视
+    camera.Position = glm::vec3(0.0f, distance, 0.0f);
+    camera.Yaw = -90.0f;
+    camera.Pitch = -89.9f; // Almost straight down
+    break;
+  case 2: // 从车头前上方 俯视45度看着自车中心
+    camera.Position = glm::vec3(0.0f, height, horizontalDist);
+    camera.Yaw = -90.0f;
+    camera.Pitch = -45.0f;
+    break;
+  case 3: // 从车尾后上方 俯视45度看着自车中心
+    camera.Position = glm::vec3(0.0f, height, -horizontalDist);
+    // Looking from -Z towards origin (+Z direction relative to camera's
+    // forward)
+    camera.Yaw = 90.0f; // Adjusted Yaw
+    camera.Pitch = -45.0f;
+    break;
+  case 4: // 从左侧后上方 俯视45度看着自车中心
+    camera.Position = glm::vec3(-sideOffset, height, -sideOffset);
+    // Looking from -X, -Z towards origin (+X, +Z direction relative to camera's
+    // forward)
+    camera.Yaw = 45.0f; // Adjusted Yaw
+    camera.Pitch = -45.0f;
+    break;
+  case 5: // 从右侧后上方 俯视45度看着自车中心
+    camera.Position = glm::vec3(sideOffset, height, -sideOffset);
+    // Looking from +X, -Z towards origin (-X, +Z direction relative to camera's
+    // forward)
+    camera.Yaw = 135.0f; // Adjusted Yaw
+    camera.Pitch = -45.0f;
+    break;
+  default:
+    return false; // Ignore other keys
+  }
+
+  // After setting position and angles, update the camera's internal vectors
+  camera.updateCameraVectors();
+  return true;
+}
+
+void setCameraOrbit(Camera &camera, int index, int count, float distance,
+                    float height) {
+  const float angle = glm::two_pi<float>() * index / std::max(count, 1);
+  camera.Position = glm::vec3(distance * glm::cos(angle), height,
+                              distance * glm::sin(angle));
+  // 朝向与位置方向相反, 俯仰角让视线穿过中心
+  camera.Yaw = glm::degrees(angle) + 180.0f;
+  camera.Pitch = -glm::degrees(glm::atan(height, distance));
+  camera.updateCameraVectors();
+}
@@ -51,4 +51,12 @@ public:
   void updateCameraVectors();
 };
 
+// 预设视角, 都看向自车中心: 1 正上方俯视, 2 车头前上方, 3 车尾后上方,
+// 4 左侧后上方, 5 右侧后上方. viewIndex 无效时返回 false, 相机不变
+bool setCameraPreset(Camera &camera, int viewIndex);
+// 绕自车中心一圈均分 count 个视角中的第 index 个, 水平距离 distance,
+// 高度 height, 看向中心
+void setCameraOrbit(Camera &camera, int index, int count, float distance,
+                    float height);
+
 #endif // CAMERA_H
\ No newline at end of file
@@ -0,0 +1,398 @@
+#include "mesh_cache.h"
+#include "model_loader.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// 文件布局: 头, 然后 64 字节对齐的顶点段和索引段
+struct MeshCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t source_size; // 源 obj 的大小和修改时间 (纳秒)
+  int64_t source_mtime;
+  uint64_t file_size;
+  uint32_t vertex_size; // sizeof(Vertex), 结构变化时缓存失效
+  uint32_t index_size;  // 2 或 4
+  uint64_t vertex_count;
+  uint64_t index_count;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+};
+
+const char mesh_magic[4] = {'A', 'V', 'M', 'M'};
+const uint32_t mesh_version = 1;
+const size_t mesh_align = 64;
+
+size_t alignUp(size_t v) { return (v + mesh_align - 1) & ~(mesh_align - 1); }
+
+bool sourceStamp(const std::string &path, uint64_t &size, int64_t &mtime) {
+  std::error_code ec;
+  size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return false;
+  }
+  auto t = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return false;
+  }
+  mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              t.time_since_epoch())
+              .count();
+  return true;
+}
+
+// Forsyth 的顶点评分: 刚用过的三个顶点固定分, 之后按在缓存中的位置
+// 衰减; 剩余三角形少的顶点加分, 尽早用完以腾出缓存
+const int kScoreCacheSize = 32;
+
+float vertexScore(int cachePos, int remaining) {
+  if (remaining == 0) {
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if (cachePos >= 0) {
+    score = cachePos < 3
+                ? 0.75f
+                : std::pow(1.0f - (float)(cachePos - 3) /
+                                      (kScoreCacheSize - 3),
+                           1.5f);
+  }
+  return score + 2.0f / std::sqrt((float)remaining);
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - t0)
+      .count();
+}
+
+} // namespace
+
+void optimizeVertexCache(std::vector<unsigned int> &indices,
+                         size_t vertexCount) {
+  const size_t triCount = indices.size() / 3;
+  if (triCount == 0) {
+    return;
+  }
+
+  // 每个顶点相邻的三角形, 输出一个三角形就从它三个顶点的列表中移除
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (unsigned int v : indices) {
+    ++remaining[v];
+  }
+  std::vector<uint32_t> adjOffset(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    adjOffset[v + 1] = adjOffset[v] + remaining[v];
+  }
+  std::vector<uint32_t> adj(indices.size());
+  {
+    std::vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      adj[fill[indices[i]]++] = (uint32_t)(i / 3);
+    }
+  }
+
+  std::vector<int> cachePos(vertexCount, -1);
+  std::vector<float> score(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    score[v] = vertexScore(-1, (int)remaining[v]);
+  }
+  std::vector<float> triScore(triCount);
+  for (size_t t = 0; t < triCount; ++t) {
+    triScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] +
+                  score[indices[3 * t + 2]];
+  }
+  std::vector<char> emitted(triCount, 0);
+
+  std::vector<unsigned int> out;
+  out.reserve(indices.size());
+  std::vector<uint32_t> cache, next;
+  cache.reserve(kScoreCacheSize + 3);
+  next.reserve(kScoreCacheSize + 3);
+  size_t cursor = 0; // 缓存里没有候选时, 按原顺序找下一个未输出的三角形
+  int64_t best = 0;
+  for (size_t t = 1; t < triCount; ++t) {
+    if (triScore[t] > triScore[best]) {
+      best = (int64_t)t;
+    }
+  }
+
+  for (size_t n = 0; n < triCount; ++n) {
+    if (best < 0) {
+      while (emitted[cursor]) {
+        ++cursor;
+      }
+      best = (int64_t)cursor;
+    }
+    const unsigned int *tri = &indices[3 * best];
+    out.insert(out.end(), tri, tri + 3);
+    emitted[best] = 1;
+
+    // 三角形的顶点放到缓存最前面, 其余依次后移
+    next.clear();
+    for (int k = 0; k < 3; ++k) {
+      if (std::find(next.begin(), next.end(), tri[k]) == next.end()) {
+        next.push_back(tri[k]);
+      }
+    }
+    for (uint32_t v : cache) {
+      if (v != tri[0] && v != tri[1] && v != tri[2]) {
+        next.push_back(v);
+      }
+    }
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = tri[k];
+      uint32_t *begin = &adj[adjOffset[v]];
+      uint32_t *end = begin + remaining[v];
+      *std::find(begin, end, (uint32_t)best) = end[-1];
+      --remaining[v];
+    }
+
+    // 更新缓存中顶点的分数, 挤出缓存的顶点分数归为不在缓存
+    for (size_t i = 0; i < next.size(); ++i) {
+      const uint32_t v = next[i];
+      cachePos[v] = i < (size_t)kScoreCacheSize ? (int)i : -1;
+      const float s = vertexScore(cachePos[v], (int)remaining[v]);
+      const float delta = s - score[v];
+      score[v] = s;
+      for (uint32_t a = 0; a < remaining[v]; ++a) {
+        triScore[adj[adjOffset[v] + a]] += delta;
+      }
+    }
+    if (next.size() > (size_t)kScoreCacheSize) {
+      next.resize(kScoreCacheSize);
+    }
+    cache.swap(next);
+
+    // 下一个三角形只在缓存顶点的相邻三角形中找
+    best = -1;
+    float bestScore = -1.0f;
+    for (uint32_t v : cache) {
+      for (uint32_t a = 0; a < remaining[v]; ++a) {
+        const uint32_t t = adj[adjOffset[v] + a];
+        if (triScore[t] > bestScore) {
+          bestScore = triScore[t];
+          best = (int64_t)t;
+        }
+      }
+    }
+  }
+  indices.swap(out);
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+                         std::vector<unsigned int> &indices) {
+  const unsigned int unused = ~0u;
+  std::vector<unsigned int> remap(vertices.size(), unused);
+  std::vector<Vertex> out;
+  out.reserve(vertices.size());
+  for (unsigned int &v : indices) {
+    if (remap[v] == unused) {
+      remap[v] = (unsigned int)out.size();
+      out.push_back(vertices[v]);
+    }
+    v = remap[v];
+  }
+  vertices.swap(out);
+}
+
+float averageCacheMissRatio(const std::vector<unsigned int> &indices,
+                            size_t vertexCount, int cacheSize) {
+  if (indices.size() < 3) {
+    return 0.0f;
+  }
+  // 顶点进入缓存时的时间戳, 落后超过 cacheSize 次未命中即被挤出
+  std::vector<int64_t> stamp(vertexCount, INT64_MIN / 2);
+  int64_t misses = 0;
+  for (unsigned int v : indices) {
+    if (misses - stamp[v] >= cacheSize) {
+      stamp[v] = misses++;
+    }
+  }
+  return (float)misses / (indices.size() / 3);
+}
+
+bool writeMeshCache(const std::string &cachePath,
+                    const std::string &objPath) {
+  const auto t0 = std::chrono::steady_clock::now();
+  MeshCacheHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  if (!sourceStamp(objPath, hdr.source_size, hdr.source_mtime)) {
+    std::cerr << "MeshCache Error: source missing " << objPath << std::endl;
+    return false;
+  }
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  if (!loadModel(objPath, vertices, indices) || indices.empty()) {
+    return false;
+  }
+  const double parseMs = elapsedMs(t0);
+
+  const float acmrBefore = averageCacheMissRatio(indices, vertices.size());
+  optimizeVertexCache(indices, vertices.size());
+  optimizeVertexFetch(vertices, indices);
+  const float acmrAfter = averageCacheMissRatio(indices, vertices.size());
+
+  memcpy(hdr.magic, mesh_magic, 4);
+  hdr.version = mesh_version;
+  hdr.vertex_size = sizeof(Vertex);
+  hdr.index_size = vertices.size() <= 0xffff ? 2 : 4;
+  hdr.vertex_count = vertices.size();
+  hdr.index_count = indices.size();
+  hdr.vertex_offset = alignUp(sizeof(hdr));
+  hdr.index_offset =
+      alignUp(hdr.vertex_offset + vertices.size() * sizeof(Vertex));
+  hdr.file_size = alignUp(hdr.index_offset + indices.size() * hdr.index_size);
+
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(cachePath).parent_path(), ec);
+
+  // 先写临时文件再改名, 中断时不会留下半个缓存
+  const std::string tmp = cachePath + ".tmp";
+  {
+    std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+      std::cerr << "MeshCache Error: open " << tmp << " failed" << std::endl;
+      return false;
+    }
+    const char zeros[mesh_align] = {0};
+    auto padTo = [&](size_t pos) {
+      const size_t cur = (size_t)ofs.tellp();
+      if (pos > cur) {
+        ofs.write(zeros, pos - cur);
+      }
+    };
+    ofs.write((const char *)&hdr, sizeof(hdr));
+    padTo(hdr.vertex_offset);
+    ofs.write((const char *)vertices.data(), vertices.size() * sizeof(Vertex));
+    padTo(hdr.index_offset);
+    if (hdr.index_size == 2) {
+      std::vector<uint16_t> shorts(indices.begin(), indices.end());
+      ofs.write((const char *)shorts.data(), shorts.size() * 2);
+    } else {
+      ofs.write((const char *)indices.data(), indices.size() * 4);
+    }
+    padTo(hdr.file_size);
+    if (!ofs) {
+      std::cerr << "MeshCache Error: write " << tmp << " failed" << std::endl;
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, cachePath, ec);
+  if (ec) {
+    return false;
+  }
+  std::cout << "MeshCache: wrote " << cachePath << ", " << vertices.size()
+            << " vertices, " << indices.size() << " " << hdr.index_size * 8
+            << "-bit indices, acmr " << acmrBefore << " -> " << acmrAfter
+            << ", parse " << parseMs << " ms, total " << elapsedMs(t0)
+            << " ms" << std::endl;
+  return true;
+}
+
+MeshCache::MeshCache() : m_data(nullptr), m_size(0) {}
+
+MeshCache::~MeshCache() { close(); }
+
+bool MeshCache::open(const std::string &cachePath,
+                     const std::string &objPath) {
+  close();
+
+  const int fd = ::open(cachePath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MeshCacheHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  // 整个文件马上要上传给 GL
+  madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+  m_data = (const uint8_t *)data;
+  m_size = (size_t)st.st_size;
+
+  const MeshCacheHeader *hdr = (const MeshCacheHeader *)m_data;
+  bool ok = !memcmp(hdr->magic, mesh_magic, 4) &&
+            hdr->version == mesh_version && hdr->file_size == m_size &&
+            hdr->vertex_size == sizeof(Vertex) &&
+            (hdr->index_size == 2 || hdr->index_size == 4) &&
+            hdr->vertex_offset + hdr->vertex_count * sizeof(Vertex) <=
+                hdr->index_offset &&
+            hdr->index_offset + hdr->index_count * hdr->index_size <= m_size;
+  if (ok && !objPath.empty()) {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    ok = !sourceStamp(objPath, size, mtime) ||
+         (size == hdr->source_size && mtime == hdr->source_mtime);
+  }
+  if (!ok) {
+    close();
+  }
+  return ok;
+}
+
+void MeshCache::close() {
+  if (m_data) {
+    munmap((void *)m_data, m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+const Vertex *MeshCache::vertices() const {
+  return m_data ? (const Vertex *)(m_data + ((const MeshCacheHeader *)m_data)
+                                                ->vertex_offset)
+                : nullptr;
+}
+
+size_t MeshCache::vertexCount() const {
+  return m_data ? ((const MeshCacheHeader *)m_data)->vertex_count : 0;
+}
+
+const void *MeshCache::indices() const {
+  return m_data ? m_data + ((const MeshCacheHeader *)m_data)->index_offset
+                : nullptr;
+}
+
+size_t MeshCache::indexCount() const {
+  return m_data ? ((const MeshCacheHeader *)m_data)->index_count : 0;
+}
+
+GLenum MeshCache::indexType() const {
+  return m_data && ((const MeshCacheHeader *)m_data)->index_size == 2
+             ? GL_UNSIGNED_SHORT
+             : GL_UNSIGNED_INT;
+}
+
+bool loadModelCached(const std::string &objPath, const std::string &cachePath,
+                     MeshCache &cache) {
+  const auto t0 = std::chrono::steady_clock::now();
+  // 源 obj 不在时 (只部署了缓存) 直接使用缓存
+  if (!cache.open(cachePath, objPath)) {
+    std::cout << "MeshCache: missing or stale, converting " << objPath
+              << std::endl;
+    if (!writeMeshCache(cachePath, objPath) || !cache.open(cachePath, "")) {
+      return false;
+    }
+  }
+  std::cout << "MeshCache: mapped " << cachePath << " in " << elapsedMs(t0)
+            << " ms" << std::endl;
+  return true;
+}
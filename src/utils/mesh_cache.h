@@ -0,0 +1,55 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "mesh.h" // 需要 Vertex 结构
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 模型的二进制缓存: 去重后的顶点和按顶点缓存重排过的索引, 顶点数不超过
+// 65535 时索引存为 16 位. 文件 mmap 后直接交给 GL 上传, 不解析也不拷贝.
+// 文件记录源 obj 的大小和修改时间, 任意一个变化时视为过期重建
+
+// 重排三角形顺序 (Forsyth 线性算法), 提高变换后顶点缓存的命中率
+void optimizeVertexCache(std::vector<unsigned int> &indices,
+                         size_t vertexCount);
+// 顶点按索引中第一次出现的顺序重排, 未被引用的顶点丢弃
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+                         std::vector<unsigned int> &indices);
+// 每个三角形平均的顶点缓存未命中数 (FIFO 缓存), 0.5 ~ 3, 越小越好
+float averageCacheMissRatio(const std::vector<unsigned int> &indices,
+                            size_t vertexCount, int cacheSize = 16);
+
+// 解析 obj, 优化后写缓存文件
+bool writeMeshCache(const std::string &cachePath, const std::string &objPath);
+
+class MeshCache {
+public:
+  MeshCache();
+  ~MeshCache();
+
+  MeshCache(const MeshCache &) = delete;
+  MeshCache &operator=(const MeshCache &) = delete;
+
+  // 映射并检查文件. objPath 非空时还要与源 obj 一致
+  bool open(const std::string &cachePath, const std::string &objPath);
+  void close();
+  bool isOpen() const { return m_data != nullptr; }
+
+  // 以下指针指向映射的内存, close() 之前有效
+  const Vertex *vertices() const;
+  size_t vertexCount() const;
+  const void *indices() const;
+  size_t indexCount() const;
+  GLenum indexType() const; // GL_UNSIGNED_SHORT 或 GL_UNSIGNED_INT
+
+private:
+  const uint8_t *m_data;
+  size_t m_size;
+};
+
+// 优先用缓存, 缓存缺失或过期时从 obj 重新生成 (首次运行)
+bool loadModelCached(const std::string &objPath, const std::string &cachePath,
+                     MeshCache &cache);
+
+#endif // MESH_CACHE_H
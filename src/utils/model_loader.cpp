@@ -1,42 +1,148 @@
 #include "model_loader.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <tinyobjloader/tiny_obj_loader.h>
-#include <unordered_map> // 用于优化顶点去重
-
-// Helper function for vertex uniqueness (optional but recommended for
-// performance)
-namespace std {
-template <> struct hash<Vertex> {
-  size_t operator()(Vertex const &vertex) const {
-    size_t seed = 0;
-    // Simple hash combination - consider a more robust one if needed
-    auto hashCombine = [&](size_t &seed, size_t hash) {
-      seed ^= hash + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    };
-
-    hashCombine(seed, hash<float>()(vertex.Position.x));
-    hashCombine(seed, hash<float>()(vertex.Position.y));
-    hashCombine(seed, hash<float>()(vertex.Position.z));
-    hashCombine(seed, hash<float>()(vertex.Normal.x));
-    hashCombine(seed, hash<float>()(vertex.Normal.y));
-    hashCombine(seed, hash<float>()(vertex.Normal.z));
-    hashCombine(seed, hash<float>()(vertex.TexCoords.x));
-    hashCombine(seed, hash<float>()(vertex.TexCoords.y));
-    return seed;
+
+namespace {
+
+static_assert(sizeof(Vertex) % sizeof(uint64_t) == 0,
+              "Vertex is hashed as whole 64-bit words");
+
+// 顶点原始字节上的 64 位哈希: 每 8 字节乘法混合, 最后 murmur3 的 fmix64.
+// 按位比较, -0.0 与 0.0 视为不同的顶点
+uint64_t hashVertex(const Vertex &v) {
+  uint64_t words[sizeof(Vertex) / sizeof(uint64_t)];
+  memcpy(words, &v, sizeof(Vertex));
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+  for (uint64_t w : words) {
+    h ^= w;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// 开放寻址 (线性探测) 的去重表, 槽里存顶点下标和哈希的高 32 位,
+// 高位不同时不用比较顶点本身. 装载率超过 1/2 时容量翻倍
+class VertexTable {
+public:
+  explicit VertexTable(size_t expected) {
+    size_t capacity = 64;
+    while (capacity < expected * 2) {
+      capacity *= 2;
+    }
+    m_slots.assign(capacity, Slot{kEmpty, 0});
+  }
+
+  uint32_t insert(const Vertex &v, std::vector<Vertex> &vertices) {
+    if ((vertices.size() + 1) * 2 > m_slots.size()) {
+      grow(vertices);
+    }
+    const uint64_t h = hashVertex(v);
+    const uint32_t tag = (uint32_t)(h >> 32);
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      Slot &slot = m_slots[i];
+      if (slot.index == kEmpty) {
+        slot.index = (uint32_t)vertices.size();
+        slot.tag = tag;
+        vertices.push_back(v);
+        return slot.index;
+      }
+      if (slot.tag == tag &&
+          memcmp(&vertices[slot.index], &v, sizeof(Vertex)) == 0) {
+        return slot.index;
+      }
+    }
   }
+
+private:
+  static const uint32_t kEmpty = 0xffffffffu;
+  struct Slot {
+    uint32_t index;
+    uint32_t tag;
+  };
+
+  void grow(const std::vector<Vertex> &vertices) {
+    m_slots.assign(m_slots.size() * 2, Slot{kEmpty, 0});
+    const size_t mask = m_slots.size() - 1;
+    for (uint32_t index = 0; index < (uint32_t)vertices.size(); ++index) {
+      const uint64_t h = hashVertex(vertices[index]);
+      size_t i = h & mask;
+      while (m_slots[i].index != kEmpty) {
+        i = (i + 1) & mask;
+      }
+      m_slots[i] = Slot{index, (uint32_t)(h >> 32)};
+    }
+  }
+
+  std::vector<Slot> m_slots;
+};
+
+// 一个 shape 组装出的顶点和 shape 内的索引
+struct ShapeMesh {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
 };
-} // namespace std
 
-// Equality operator for Vertex needed for unordered_map
-bool operator==(const Vertex &lhs, const Vertex &rhs) {
-  return lhs.Position == rhs.Position && lhs.Normal == rhs.Normal &&
-         lhs.TexCoords == rhs.TexCoords;
+void buildShape(const tinyobj::attrib_t &attrib, const tinyobj::shape_t &shape,
+                ShapeMesh &out) {
+  const size_t corners = shape.mesh.indices.size();
+  // 平滑网格每个顶点大约被 6 个三角形共用
+  VertexTable table(corners / 4);
+  out.vertices.reserve(corners / 4);
+  out.indices.resize(corners);
+  for (size_t c = 0; c < corners; ++c) {
+    const tinyobj::index_t &index = shape.mesh.indices[c];
+    Vertex vertex{};
+
+    // --- 位置 ---
+    vertex.Position = {attrib.vertices[3 * index.vertex_index + 0],
+                       attrib.vertices[3 * index.vertex_index + 1],
+                       attrib.vertices[3 * index.vertex_index + 2]};
+
+    // --- 法线 (检查是否存在) ---
+    if (index.normal_index >= 0 && !attrib.normals.empty()) {
+      vertex.Normal = {attrib.normals[3 * index.normal_index + 0],
+                       attrib.normals[3 * index.normal_index + 1],
+                       attrib.normals[3 * index.normal_index + 2]};
+    } else {
+      vertex.Normal = {0.0f, 1.0f, 0.0f}; // Example: Default up
+    }
+
+    // --- 纹理坐标 (检查是否存在) ---
+    if (index.texcoord_index >= 0 && !attrib.texcoords.empty()) {
+      vertex.TexCoords = {attrib.texcoords[2 * index.texcoord_index + 0],
+                          1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+    } else {
+      vertex.TexCoords = {0.0f, 0.0f}; // Default if no tex coords
+    }
+
+    // --- 顶点去重 ---
+    out.indices[c] = table.insert(vertex, out.vertices);
+  }
 }
 
-// ... (includes and hash function) ...
+double elapsedMs(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - t0)
+      .count();
+}
+
+} // namespace
 
 bool loadModel(const std::string &path, std::vector<Vertex> &outVertices,
-               std::vector<unsigned int> &outIndices) {
+               std::vector<unsigned int> &outIndices, ModelLoadStats *stats,
+               ThreadPool *pool) {
+  const auto t0 = std::chrono::steady_clock::now();
   tinyobj::attrib_t attrib;
   std::vector<tinyobj::shape_t> shapes;
   std::vector<tinyobj::material_t> materials;
@@ -68,48 +174,64 @@ bool loadModel(const std::string &path, std::vector<Vertex> &outVertices,
   std::cout << "  > Shapes: " << shapes.size() << std::endl;
   std::cout << "  > Materials: " << materials.size() << std::endl;
 
-  outVertices.clear();
-  outIndices.clear();
-  std::unordered_map<Vertex, uint32_t> uniqueVertices{}; // 用于顶点去重
-
-  for (const auto &shape : shapes) {
-    for (const auto &index : shape.mesh.indices) {
-      Vertex vertex{};
-
-      // --- 位置 ---
-      vertex.Position = {attrib.vertices[3 * index.vertex_index + 0],
-                         attrib.vertices[3 * index.vertex_index + 1],
-                         attrib.vertices[3 * index.vertex_index + 2]};
-
-      // --- 法线 (检查是否存在) ---
-      if (index.normal_index >= 0 && !attrib.normals.empty()) {
-        vertex.Normal = {attrib.normals[3 * index.normal_index + 0],
-                         attrib.normals[3 * index.normal_index + 1],
-                         attrib.normals[3 * index.normal_index + 2]};
-      } else {
-        vertex.Normal = {0.0f, 1.0f, 0.0f}; // Example: Default up
-      }
+  ModelLoadStats st = {};
+  st.parseMs = elapsedMs(t0);
+  st.shapes = shapes.size();
 
-      // --- 纹理坐标 (检查是否存在) ---
-      if (index.texcoord_index >= 0 && !attrib.texcoords.empty()) {
-        vertex.TexCoords = {attrib.texcoords[2 * index.texcoord_index + 0],
-                            1.0f -
-                                attrib.texcoords[2 * index.texcoord_index + 1]};
-      } else {
-        vertex.TexCoords = {0.0f, 0.0f}; // Default if no tex coords
-      }
-
-      // --- 顶点去重 ---
-      if (uniqueVertices.count(vertex) == 0) {
-        uniqueVertices[vertex] = static_cast<uint32_t>(outVertices.size());
-        outVertices.push_back(vertex);
-      }
-      outIndices.push_back(uniqueVertices[vertex]);
-    }
+  // 1. 各 shape 并行组装顶点并去重, 大的 shape 先开始
+  const auto t1 = std::chrono::steady_clock::now();
+  std::unique_ptr<ThreadPool> localPool;
+  if (!pool) {
+    localPool = std::make_unique<ThreadPool>();
+    pool = localPool.get();
+  }
+  st.threads = pool->size();
+  std::vector<int> order(shapes.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = (int)i;
   }
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return shapes[a].mesh.indices.size() > shapes[b].mesh.indices.size();
+  });
+  std::vector<ShapeMesh> parts(shapes.size());
+  pool->parallelFor((int)order.size(), [&](int i) {
+    buildShape(attrib, shapes[order[i]], parts[order[i]]);
+  });
+  st.dedupMs = elapsedMs(t1);
+
+  // 2. 按 shape 顺序拼接, 索引加上前面 shape 的顶点数
+  const auto t2 = std::chrono::steady_clock::now();
+  std::vector<size_t> vertexBase(parts.size() + 1, 0);
+  std::vector<size_t> indexBase(parts.size() + 1, 0);
+  for (size_t i = 0; i < parts.size(); ++i) {
+    vertexBase[i + 1] = vertexBase[i] + parts[i].vertices.size();
+    indexBase[i + 1] = indexBase[i] + parts[i].indices.size();
+  }
+  outVertices.resize(vertexBase.back());
+  outIndices.resize(indexBase.back());
+  pool->parallelFor((int)parts.size(), [&](int i) {
+    const ShapeMesh &part = parts[i];
+    std::copy(part.vertices.begin(), part.vertices.end(),
+              outVertices.begin() + vertexBase[i]);
+    const unsigned int base = (unsigned int)vertexBase[i];
+    unsigned int *dst = outIndices.data() + indexBase[i];
+    for (size_t k = 0; k < part.indices.size(); ++k) {
+      dst[k] = part.indices[k] + base;
+    }
+  });
+  st.mergeMs = elapsedMs(t2);
+  st.corners = outIndices.size();
+  st.vertices = outVertices.size();
+
   std::cout << "TinyObjLoader: Processed " << outVertices.size()
             << " unique vertices and " << outIndices.size() << " indices."
             << std::endl;
+  std::cout << "  > Parse: " << st.parseMs << " ms, dedup: " << st.dedupMs
+            << " ms (" << st.shapes << " shapes on " << st.threads
+            << " threads), merge: " << st.mergeMs << " ms" << std::endl;
+  if (stats) {
+    *stats = st;
+  }
 
   return true;
 }
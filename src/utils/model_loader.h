@@ -1,9 +1,30 @@
 // filepath: /home/wind/Projects/SourrondView360/src/common/common.h
 // 或者 model_loader.h
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
 #include "mesh.h" // 需要 Vertex 结构
 #include <string>
 #include <vector>
 
-// 函数：从 OBJ 文件加载模型数据
+class ThreadPool;
+
+// 加载耗时统计 (毫秒)
+struct ModelLoadStats {
+  double parseMs;  // tinyobjloader 解析文本
+  double dedupMs;  // 各 shape 并行组装顶点并去重
+  double mergeMs;  // 合并到最终的顶点和索引数组
+  size_t shapes;
+  size_t corners;  // 去重前的顶点数 (三角形角点)
+  size_t vertices; // 去重后
+  int threads;
+};
+
+// 函数：从 OBJ 文件加载模型数据.
+// 各 shape 并行处理, 每个 shape 一张开放寻址的去重表 (顶点原始字节的
+// 64 位哈希), 只在同一 shape 内去重. pool 为空时临时建一个
 bool loadModel(const std::string &path, std::vector<Vertex> &outVertices,
-               std::vector<unsigned int> &outIndices);
\ No newline at end of file
+               std::vector<unsigned int> &outIndices,
+               ModelLoadStats *stats = nullptr, ThreadPool *pool = nullptr);
+
+#endif // MODEL_LOADER_H